@@ -1,17 +1,21 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <cstring>
 #include <cstdlib>
 
 #define MAX_LINE_INPUT 1024
 #define MAX_LOCAL_BUFFER 100
+#define MIN_BUFFER_SIZE 1024
+#define BUFFER_BLOCK 64
 
 using namespace std;
 
 /// Write the header to the output stream. The header is common among all glueVars files.
 /// @param glueVars The output stream to write to.
-void generateHeader(ostream& glueVars)
+/// @param bufferSize The number of positions of the OpenPLC buffers.
+void generateHeader(ostream& glueVars, int bufferSize = MIN_BUFFER_SIZE)
 {
 	glueVars << 	"\
 //-----------------------------------------------------------------------------\r\n\
@@ -45,7 +49,7 @@ extern unsigned long long common_ticktime__;\r\n\
 \r\n\
 //Internal buffers for I/O and memory. These buffers are defined in the\r\n\
 //auto-generated glueVars.cpp file\r\n\
-#define BUFFER_SIZE		1024\r\n\
+#define BUFFER_SIZE		" << bufferSize << "\r\n\
 \r\n\
 //Booleans\r\n\
 IEC_BOOL *bool_input[BUFFER_SIZE][8];\r\n\
@@ -67,14 +71,51 @@ IEC_LINT *lint_memory[BUFFER_SIZE];\r\n\
 //Special Functions\r\n\
 IEC_LINT *special_functions[BUFFER_SIZE];\r\n\
 \r\n\
-\r\n\
+\r\n";
+}
+
+/// Write the storage of the located variables. Each variable gets its own
+/// global, and the pointer used by the IEC program points to it.
+/// @param glueVars The output stream to write to.
+void generateStorage(ostream& glueVars)
+{
+	glueVars << "\
 #define __LOCATED_VAR(type, name, ...) type __##name;\r\n\
 #include \"LOCATED_VARIABLES.h\"\r\n\
 #undef __LOCATED_VAR\r\n\
 #define __LOCATED_VAR(type, name, ...) type* name = &__##name;\r\n\
 #include \"LOCATED_VARIABLES.h\"\r\n\
 #undef __LOCATED_VAR\r\n\
-\r\n\
+\r\n";
+}
+
+/// Write the arrays of the compact process image. In compact mode the
+/// located variables are stored in these arrays, at the position of their
+/// address, so the runtime can copy whole areas at once.
+/// @param glueVars The output stream to write to.
+void generateCompactImage(ostream& glueVars)
+{
+	glueVars << "\
+//Compact process image. Located variables are stored in these arrays, at\r\n\
+//the position of their address\r\n\
+IEC_BOOL compact_bool_input[BUFFER_SIZE][8] __attribute__((aligned(64)));\r\n\
+IEC_BOOL compact_bool_output[BUFFER_SIZE][8] __attribute__((aligned(64)));\r\n\
+IEC_BYTE compact_byte_input[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_BYTE compact_byte_output[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_UINT compact_int_input[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_UINT compact_int_output[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_UINT compact_int_memory[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_DINT compact_dint_memory[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_LINT compact_lint_memory[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+IEC_LINT compact_special_functions[BUFFER_SIZE] __attribute__((aligned(64)));\r\n\
+\r\n";
+}
+
+/// Write the start of the glueVars() function.
+/// @param glueVars The output stream to write to.
+void generateGlueStart(ostream& glueVars)
+{
+	glueVars << "\
 void glueVars()\r\n\
 {\r\n";
 }
@@ -215,6 +256,109 @@ void glueVar(ostream& glueVars, char *varName, char *varType)
 	}
 }
 
+/// Write the storage of a located variable in compact mode. Variables that
+/// have no place in the compact image get their own global, as usual.
+void compactVar(ostream& glueVars, char *varName, char *varType, int bufferSize = MIN_BUFFER_SIZE)
+{
+	int pos1, pos2;
+	const char *area = NULL;
+	int index = 0;
+
+	findPositions(varName, &pos1, &pos2);
+	if (varName[2] == 'I')
+	{
+		switch (varName[3])
+		{
+			case 'X': area = "compact_bool_input"; break;
+			case 'B': area = "compact_byte_input"; break;
+			case 'W': area = "compact_int_input"; break;
+		}
+	}
+	else if (varName[2] == 'Q')
+	{
+		switch (varName[3])
+		{
+			case 'X': area = "compact_bool_output"; break;
+			case 'B': area = "compact_byte_output"; break;
+			case 'W': area = "compact_int_output"; break;
+		}
+	}
+	else if (varName[2] == 'M')
+	{
+		switch (varName[3])
+		{
+			case 'W': area = "compact_int_memory"; break;
+			case 'D': area = "compact_dint_memory"; break;
+			case 'L':
+				if (pos1 > 1023)
+				{
+					area = "compact_special_functions";
+					index = 1024;
+				}
+				else
+				{
+					area = "compact_lint_memory";
+				}
+				break;
+		}
+	}
+
+	pos1 -= index;
+	if (area == NULL || pos1 < 0 || pos1 >= bufferSize || pos2 >= 8)
+	{
+		glueVars << varType << " __" << varName << ";\r\n";
+		glueVars << varType << "* " << varName << " = &__" << varName << ";\r\n";
+	}
+	else if (varName[3] == 'X')
+	{
+		glueVars << varType << "* " << varName << " = (" << varType << " *)&" << area << "[" << pos1 << "][" << pos2 << "];\r\n";
+	}
+	else
+	{
+		glueVars << varType << "* " << varName << " = (" << varType << " *)&" << area << "[" << pos1 << "];\r\n";
+	}
+}
+
+/// Find the number of buffer positions needed by the located variables.
+/// The result is never smaller than the classic 1024 positions, which the
+/// protocol address maps rely on, and is rounded up to whole 64 position
+/// blocks. %ML1024 and above are special functions and don't count.
+/// All areas share this size and the tables stay dense, so a single high
+/// address of any area grows every table.
+int findBufferSize(istream& locatedVars)
+{
+	char iecVar_name[100];
+	char iecVar_type[100];
+	int bufferSize = MIN_BUFFER_SIZE;
+
+	while (parseIecVars(locatedVars, iecVar_name, iecVar_type))
+	{
+		int pos1, pos2;
+		findPositions(iecVar_name, &pos1, &pos2);
+		if (iecVar_name[2] == 'M' && iecVar_name[3] == 'L' && pos1 > 1023)
+			continue;
+
+		if (pos1 >= bufferSize)
+			bufferSize = (pos1 / BUFFER_BLOCK + 1) * BUFFER_BLOCK;
+	}
+
+	return bufferSize;
+}
+
+/// Write the header with the buffer size shared by the runtime.
+/// @param glueVarsHeader The output stream to write to.
+/// @param bufferSize The number of positions of the OpenPLC buffers.
+void generateSizeHeader(ostream& glueVarsHeader, int bufferSize)
+{
+	glueVarsHeader << "\
+//-----------------------------------------------------------------------------\r\n\
+// Size of the OpenPLC buffers for the current program. It is automatically\r\n\
+// generated by the glue_generator program. PLEASE DON'T EDIT THIS FILE!\r\n\
+//-----------------------------------------------------------------------------\r\n\
+\r\n\
+#define BUFFER_SIZE\t\t" << bufferSize << "\r\n";
+}
+
 void generateBottom(ostream& glueVars)
 {
 	glueVars << "}\r\n\
@@ -242,6 +386,17 @@ void generateBody(istream& locatedVars, ostream& glueVars) {
     }
 }
 
+void generateCompactStorage(istream& locatedVars, ostream& glueVars, int bufferSize = MIN_BUFFER_SIZE) {
+    char iecVar_name[100];
+    char iecVar_type[100];
+
+    while (parseIecVars(locatedVars, iecVar_name, iecVar_type))
+    {
+        compactVar(glueVars, iecVar_name, iecVar_type, bufferSize);
+    }
+    glueVars << "\r\n";
+}
+
 /// This is our main function. We define it with a different name and then
 /// call it from the main function so that we can mock it for the purpose
 /// of testing.
@@ -249,24 +404,41 @@ int mainImpl(int argc, char *argv[])
 {
 	// Parse the command line arguments - if they exist. Show the help if there are too many arguments
     // or if the first argument is for help.
-    bool show_help = argc >= 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0);
-    if (show_help || (argc != 1 && argc != 3)) {
+    bool show_help = false;
+    bool compact = false;
+    char *paths[2];
+    int num_paths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            show_help = true;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            compact = true;
+        } else if (num_paths < 2) {
+            paths[num_paths++] = argv[i];
+        } else {
+            show_help = true;
+        }
+    }
+
+    if (show_help || num_paths == 1) {
 		cout << "Usage " << endl << endl;
 		cout << "  glue_generator [options] <path-to-located-variables.h> <path-to-glue-vars.cpp>" << endl << endl;
 		cout << "Reads the LOCATED_VARIABLES.h file generated by the MATIEC compiler and produces" << endl;
-		cout << "glueVars.cpp for the OpenPLC runtime. If not specified, paths are relative to" << endl;
-		cout << "the current directory." << endl << endl;
+		cout << "glueVars.cpp for the OpenPLC runtime, plus glueVars.h with the buffer size" << endl;
+		cout << "next to it. If not specified, paths are relative to the current directory." << endl << endl;
 		cout << "Options" << endl;
 		cout << "  --help,-h   = Print usage information and exit." << endl;
+		cout << "  --compact   = Store the located variables in contiguous arrays indexed by" << endl;
+		cout << "                address (compact process image)." << endl;
 		return 0;
 	}
 
-	// If we have 3 arguments, then the user provided input and output paths
+	// If we have two paths, then the user provided input and output paths
 	string input_file_name("LOCATED_VARIABLES.h");
 	string output_file_name("glueVars.cpp");
-	if (argc == 3) {
-		input_file_name = argv[1];
-		output_file_name = argv[2];
+	if (num_paths == 2) {
+		input_file_name = paths[0];
+		output_file_name = paths[1];
 	}
 
 	// Try to open the files for reading and writing.
@@ -281,8 +453,43 @@ int mainImpl(int argc, char *argv[])
 		return 2;
 	}
 
-    generateHeader(glueVars);
-    generateBody(locatedVars, glueVars);
+    // The located variables are read more than once: to size the buffers,
+    // for their storage in compact mode and for the pointer tables
+    stringstream locatedVarsCopy;
+    locatedVarsCopy << locatedVars.rdbuf();
+    locatedVarsCopy.clear();
+    int bufferSize = findBufferSize(locatedVarsCopy);
+    locatedVarsCopy.clear();
+    locatedVarsCopy.seekg(0);
+    if (bufferSize > MIN_BUFFER_SIZE) {
+        cout << "Located variables use addresses above 1023. All OpenPLC buffers are sized to "
+             << bufferSize << " positions" << endl;
+    }
+
+    // The runtime picks the buffer size up from glueVars.h, next to glueVars.cpp
+    string header_file_name("glueVars.h");
+    size_t separator = output_file_name.find_last_of("/\\");
+    if (separator != string::npos) {
+        header_file_name = output_file_name.substr(0, separator + 1) + header_file_name;
+    }
+    ofstream glueVarsHeader(header_file_name, ios::trunc);
+    if (!glueVarsHeader.is_open()) {
+		cout << "Error opening glue variables header at " << header_file_name << endl;
+		return 2;
+    }
+    generateSizeHeader(glueVarsHeader, bufferSize);
+
+    generateHeader(glueVars, bufferSize);
+    if (compact) {
+        generateCompactImage(glueVars);
+        generateCompactStorage(locatedVarsCopy, glueVars, bufferSize);
+        locatedVarsCopy.clear();
+        locatedVarsCopy.seekg(0);
+    } else {
+        generateStorage(glueVars);
+    }
+    generateGlueStart(glueVars);
+    generateBody(locatedVarsCopy, glueVars);
 	generateBottom(glueVars);
 
 	return 0;
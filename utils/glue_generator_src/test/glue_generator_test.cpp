@@ -113,3 +113,57 @@ SCENARIO("", "") {
         }
     }
 }
+
+SCENARIO("Compact process image", "[compact]") {
+    GIVEN("IO as streams") {
+        std::stringstream output_stream;
+        WHEN("Contains single BOOL at %IX0.1") {
+            std::stringstream input_stream("__LOCATED_VAR(BOOL,__IX0_1,I,X,0,1)");
+            generateCompactStorage(input_stream, output_stream);
+            REQUIRE(output_stream.str() == "BOOL* __IX0_1 = (BOOL *)&compact_bool_input[0][1];\r\n\r\n");
+        }
+
+        WHEN("Contains single INT at %QW3") {
+            std::stringstream input_stream("__LOCATED_VAR(INT,__QW3,Q,W,3)");
+            generateCompactStorage(input_stream, output_stream);
+            REQUIRE(output_stream.str() == "INT* __QW3 = (INT *)&compact_int_output[3];\r\n\r\n");
+        }
+
+        WHEN("Contains single REAL at %MD2") {
+            std::stringstream input_stream("__LOCATED_VAR(REAL,__MD2,M,D,2)");
+            generateCompactStorage(input_stream, output_stream);
+            REQUIRE(output_stream.str() == "REAL* __MD2 = (REAL *)&compact_dint_memory[2];\r\n\r\n");
+        }
+
+        WHEN("Contains single LINT at %ML1025") {
+            std::stringstream input_stream("__LOCATED_VAR(LINT,__ML1025,M,L,1025)");
+            generateCompactStorage(input_stream, output_stream);
+            REQUIRE(output_stream.str() == "LINT* __ML1025 = (LINT *)&compact_special_functions[1];\r\n\r\n");
+        }
+
+        WHEN("Contains a DWORD at %ID0, which has no compact area") {
+            std::stringstream input_stream("__LOCATED_VAR(DWORD,__ID0,I,D,0)");
+            generateCompactStorage(input_stream, output_stream);
+            REQUIRE(output_stream.str() == "DWORD ____ID0;\r\nDWORD* __ID0 = &____ID0;\r\n\r\n");
+        }
+    }
+}
+
+SCENARIO("Buffer size", "[size]") {
+    GIVEN("IO as streams") {
+        WHEN("Contains only low addresses") {
+            std::stringstream input_stream("__LOCATED_VAR(BOOL,__QX10_1,Q,X,10,1)\n__LOCATED_VAR(INT,__MW1023,M,W,1023)");
+            REQUIRE(findBufferSize(input_stream) == 1024);
+        }
+
+        WHEN("Contains a word above 1023") {
+            std::stringstream input_stream("__LOCATED_VAR(INT,__IW1024,I,W,1024)\n__LOCATED_VAR(INT,__IW5000,I,W,5000)");
+            REQUIRE(findBufferSize(input_stream) == 5056);
+        }
+
+        WHEN("Contains special functions") {
+            std::stringstream input_stream("__LOCATED_VAR(LINT,__ML1025,M,L,1025)");
+            REQUIRE(findBufferSize(input_stream) == 1024);
+        }
+    }
+}
@@ -1353,7 +1353,13 @@ class generate_c_config_c: public generate_c_base_and_typeid_c {
       initprotos_dt,
       initdeclare_dt,
       runprotos_dt,
-      rundeclare_dt
+      rundeclare_dt,
+      taskprotos_dt,
+      taskcount_dt,
+      taskinfo_dt,
+      taskrun_dt,
+      tasktrigger_dt,
+      taskinput_dt
     } declaretype_t;
 
     declaretype_t wanted_declaretype;
@@ -1487,11 +1493,139 @@ void *visit(configuration_declaration_c *symbol) {
 
   /* (C.3) Close Public Function body */
   s4o.indent_left();
+  s4o.print(s4o.indent_spaces + "}\n\n");
+
+  /* (D) Task functions, for runtimes that schedule each task on its own */
+  /* (D.1) Resources task functions protos... */
+  wanted_declaretype = taskprotos_dt;
+  symbol->resource_declarations->accept(*this);
+  s4o.print("\n");
+
+  /* (D.2) Total number of tasks... */
+  s4o.print(s4o.indent_spaces + "int config_task_count__(void) {\n");
+  s4o.indent_right();
+  s4o.print(s4o.indent_spaces + "return 0");
+  wanted_declaretype = taskcount_dt;
+  symbol->resource_declarations->accept(*this);
+  s4o.print(";\n");
+  s4o.indent_left();
+  s4o.print(s4o.indent_spaces + "}\n\n");
+
+  /* (D.3) Task information. Tasks are numbered across all resources... */
+  s4o.print(s4o.indent_spaces + "int config_task_info__(int task, const char **name, unsigned long long *interval, int *priority) {\n");
+  s4o.indent_right();
+  wanted_declaretype = taskinfo_dt;
+  symbol->resource_declarations->accept(*this);
+  s4o.print(s4o.indent_spaces + "return 0;\n");
+  s4o.indent_left();
+  s4o.print(s4o.indent_spaces + "}\n\n");
+
+  /* (D.4) Task run function. A negative task runs the programs without a task of every resource... */
+  s4o.print(s4o.indent_spaces + "void config_run_task__(int task, unsigned long tick) {\n");
+  s4o.indent_right();
+  wanted_declaretype = taskrun_dt;
+  symbol->resource_declarations->accept(*this);
+  s4o.indent_left();
+  s4o.print(s4o.indent_spaces + "}\n\n");
+
+  /* (D.5) Task trigger function. Returns 1 when the SINGLE input of a task has a rising edge... */
+  s4o.print(s4o.indent_spaces + "int config_task_trigger__(int task) {\n");
+  s4o.indent_right();
+  wanted_declaretype = tasktrigger_dt;
+  symbol->resource_declarations->accept(*this);
+  s4o.print(s4o.indent_spaces + "return 0;\n");
+  s4o.indent_left();
+  s4o.print(s4o.indent_spaces + "}\n\n");
+
+  /* (D.6) SINGLE input of a task, NULL for periodic tasks... */
+  s4o.print(s4o.indent_spaces + "BOOL *config_task_input__(int task) {\n");
+  s4o.indent_right();
+  wanted_declaretype = taskinput_dt;
+  symbol->resource_declarations->accept(*this);
+  s4o.print(s4o.indent_spaces + "return NULL;\n");
+  s4o.indent_left();
   s4o.print(s4o.indent_spaces + "}\n");
 
   return NULL;
 }
 
+/* Prints the task related code of one resource. Used for both
+ * resource_declaration_c and single_resource_declaration_c
+ */
+void print_resource_tasks(symbol_c *resource_name) {
+  #define PRINT_RESOURCE_NAME {if (resource_name != NULL) resource_name->accept(*this); else s4o.print("RESOURCE");}
+  switch (wanted_declaretype) {
+    case taskprotos_dt:
+      s4o.print(s4o.indent_spaces + "extern int ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__;\n");
+      s4o.print(s4o.indent_spaces + "int ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_info__(int task, const char **name, unsigned long long *interval, int *priority);\n");
+      s4o.print(s4o.indent_spaces + "void ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_run_task__(int task, unsigned long tick);\n");
+      s4o.print(s4o.indent_spaces + "int ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_trigger__(int task);\n");
+      s4o.print(s4o.indent_spaces + "BOOL *");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_input__(int task);\n");
+      break;
+    case taskcount_dt:
+      s4o.print(" + ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__");
+      break;
+    case taskinfo_dt:
+      s4o.print(s4o.indent_spaces + "if (task < ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__) return ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_info__(task, name, interval, priority);\n");
+      s4o.print(s4o.indent_spaces + "task -= ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__;\n");
+      break;
+    case taskrun_dt:
+      s4o.print(s4o.indent_spaces + "if (task < 0) ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_run_task__(task, tick);\n");
+      s4o.print(s4o.indent_spaces + "else if (task < ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__) {");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_run_task__(task, tick); return;}\n");
+      s4o.print(s4o.indent_spaces + "else task -= ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__;\n");
+      break;
+    case tasktrigger_dt:
+      s4o.print(s4o.indent_spaces + "if (task < ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__) return ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_trigger__(task);\n");
+      s4o.print(s4o.indent_spaces + "task -= ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__;\n");
+      break;
+    case taskinput_dt:
+      s4o.print(s4o.indent_spaces + "if (task < ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__) return ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_input__(task);\n");
+      s4o.print(s4o.indent_spaces + "task -= ");
+      PRINT_RESOURCE_NAME;
+      s4o.print("_task_count__;\n");
+      break;
+    default:
+      break;
+  }
+  #undef PRINT_RESOURCE_NAME
+}
+
 void *visit(resource_declaration_c *symbol) {
   if (wanted_declaretype == initprotos_dt || wanted_declaretype == runprotos_dt) {
     s4o.print(s4o.indent_spaces + "void ");
@@ -1517,6 +1651,7 @@ void *visit(resource_declaration_c *symbol) {
       s4o.print("(tick);\n");
     }
   }
+  print_resource_tasks(symbol->resource_name);
   return NULL;
 }
 
@@ -1543,6 +1678,7 @@ void *visit(single_resource_declaration_c *symbol) {
       s4o.print("(tick);\n");
     }
   }
+  print_resource_tasks(NULL);
   return NULL;
 }
 
@@ -1583,6 +1719,10 @@ class generate_c_resources_c: public generate_c_base_and_typeid_c {
       current_task_name = NULL;
       current_global_vars = NULL;
       configuration_name = false;
+      filter_task = false;
+      omit_task_guard = false;
+      wanted_task_name = NULL;
+      current_task_index = 0;
       generate_c_resources_c::s4o_ptr = s4o_ptr;
     };
 
@@ -1594,7 +1734,8 @@ class generate_c_resources_c: public generate_c_base_and_typeid_c {
     typedef enum {
       declare_dt,
       init_dt,
-      run_dt
+      run_dt,
+      task_info_dt
     } declaretype_t;
 
     declaretype_t wanted_declaretype;
@@ -1603,6 +1744,14 @@ class generate_c_resources_c: public generate_c_base_and_typeid_c {
     
     const char *current_program_name;
 
+    /* used when generating the per task run function, where only the programs
+     * of one task are printed, and without the 'if (task_name)' guard...
+     */
+    bool filter_task;
+    bool omit_task_guard;
+    symbol_c *wanted_task_name;
+    int current_task_index;
+
     typedef enum {
       assign_at,
       send_at
@@ -1817,6 +1966,133 @@ END_RESOURCE
       s4o.indent_left();
       s4o.print("}\n\n");
       
+      /* (D) Task table, for runtimes that schedule each task on its own... */
+      list_c *task_list = dynamic_cast<list_c *>(symbol->task_configuration_list);
+      if (NULL == task_list) ERROR;
+      
+      /* (D.1) Number of tasks... */
+      s4o.print("int ");
+      current_resource_name->accept(*this);
+      s4o.print("_task_count__ = ");
+      s4o.print(task_list->n);
+      s4o.print(";\n\n");
+      
+      /* (D.2) Name, interval (ns, 0 for SINGLE tasks) and priority of each task... */
+      s4o.print("int ");
+      current_resource_name->accept(*this);
+      s4o.print("_task_info__(int task, const char **name, unsigned long long *interval, int *priority) {\n");
+      s4o.indent_right();
+      s4o.print(s4o.indent_spaces + "switch (task) {\n");
+      s4o.indent_right();
+      wanted_declaretype = task_info_dt;
+      current_task_index = 0;
+      symbol->task_configuration_list->accept(*this);
+      s4o.indent_left();
+      s4o.print(s4o.indent_spaces + "}\n");
+      s4o.print(s4o.indent_spaces + "return 0;\n");
+      s4o.indent_left();
+      s4o.print("}\n\n");
+      
+      /* (E) Task run function. Each task runs only its own programs, without
+       *     checking the task condition. Task -1 runs the programs without a task.
+       *     SINGLE tasks are started by the runtime when their trigger fires (F).
+       */
+      s4o.print("void ");
+      current_resource_name->accept(*this);
+      s4o.print("_run_task__(int task, unsigned long tick) {\n");
+      s4o.indent_right();
+      
+      wanted_declaretype = run_dt;
+      filter_task = true;
+      
+      /* (E.1) Tasks... */
+      omit_task_guard = true;
+      for (int i = 0; i < task_list->n; i++) {
+        task_configuration_c *task = dynamic_cast<task_configuration_c *>(task_list->elements[i]);
+        if (NULL == task) ERROR;
+        s4o.print(s4o.indent_spaces + "if (task == ");
+        s4o.print(i);
+        s4o.print(") {\n");
+        s4o.indent_right();
+        wanted_task_name = task->task_name;
+        symbol->program_configuration_list->accept(*this);
+        s4o.indent_left();
+        s4o.print(s4o.indent_spaces + "}\n");
+      }
+      
+      /* (E.2) Programs without a task... */
+      s4o.print(s4o.indent_spaces + "if (task < 0) {\n");
+      s4o.indent_right();
+      wanted_task_name = NULL;
+      symbol->program_configuration_list->accept(*this);
+      s4o.indent_left();
+      s4o.print(s4o.indent_spaces + "}\n");
+      
+      omit_task_guard = false;
+      filter_task = false;
+      s4o.indent_left();
+      s4o.print("}\n\n");
+      
+      /* (F) Task trigger function. Evaluates the SINGLE input of a task and
+       *     returns 1 on its rising edge. The runtime calls it when the input
+       *     returned by (G) has changed, instead of polling every tick.
+       */
+      s4o.print("int ");
+      current_resource_name->accept(*this);
+      s4o.print("_task_trigger__(int task) {\n");
+      s4o.indent_right();
+      s4o.print(s4o.indent_spaces + "switch (task) {\n");
+      s4o.indent_right();
+      for (int i = 0; i < task_list->n; i++) {
+        task_configuration_c *task = dynamic_cast<task_configuration_c *>(task_list->elements[i]);
+        task_initialization_c *task_init = dynamic_cast<task_initialization_c *>(task->task_initialization);
+        if (NULL == task_init) ERROR;
+        if (task_init->single_data_source == NULL)
+          continue;
+        s4o.print(s4o.indent_spaces + "case ");
+        s4o.print(i);
+        s4o.print(": {\n");
+        s4o.indent_right();
+        task->accept(*this);
+        s4o.print(s4o.indent_spaces + "return ");
+        task->task_name->accept(*this);
+        s4o.print(";\n");
+        s4o.indent_left();
+        s4o.print(s4o.indent_spaces + "}\n");
+      }
+      s4o.indent_left();
+      s4o.print(s4o.indent_spaces + "}\n");
+      s4o.print(s4o.indent_spaces + "return 0;\n");
+      s4o.indent_left();
+      s4o.print("}\n\n");
+      
+      /* (G) SINGLE input of each task. The runtime watches the variable and
+       *     only calls the trigger function (F) when it has changed.
+       */
+      s4o.print("BOOL *");
+      current_resource_name->accept(*this);
+      s4o.print("_task_input__(int task) {\n");
+      s4o.indent_right();
+      s4o.print(s4o.indent_spaces + "switch (task) {\n");
+      s4o.indent_right();
+      for (int i = 0; i < task_list->n; i++) {
+        task_configuration_c *task = dynamic_cast<task_configuration_c *>(task_list->elements[i]);
+        task_initialization_c *task_init = dynamic_cast<task_initialization_c *>(task->task_initialization);
+        if (NULL == task_init) ERROR;
+        if (task_init->single_data_source == NULL)
+          continue;
+        s4o.print(s4o.indent_spaces + "case ");
+        s4o.print(i);
+        s4o.print(": return __GET_GLOBAL_");
+        task_init->single_data_source->accept(*this);
+        s4o.print("();\n");
+      }
+      s4o.indent_left();
+      s4o.print(s4o.indent_spaces + "}\n");
+      s4o.print(s4o.indent_spaces + "return NULL;\n");
+      s4o.indent_left();
+      s4o.print("}\n\n");
+      
       if (single_resource) {
         delete current_resource_name;
         current_resource_name = NULL;
@@ -1855,11 +2131,18 @@ END_RESOURCE
           s4o.print(");\n");
           break;
         case run_dt: 
+          if (filter_task) {
+            if (wanted_task_name == NULL) {
+              if (symbol->task_name != NULL) break;
+            }
+            else if (symbol->task_name == NULL || compare_identifiers(symbol->task_name, wanted_task_name) != 0)
+              break;
+          }
           { identifier_c *tmp_id = dynamic_cast<identifier_c*>(symbol->program_name);
             if (NULL == tmp_id) ERROR;
             current_program_name = tmp_id->value;
 	  }
-          if (symbol->task_name != NULL) {
+          if (symbol->task_name != NULL && !omit_task_guard) {
             s4o.print(s4o.indent_spaces);
             s4o.print("if (");
             symbol->task_name->accept(*this);
@@ -1882,7 +2165,7 @@ END_RESOURCE
           if (symbol->prog_conf_elements != NULL)
             symbol->prog_conf_elements->accept(*this);
           
-          if (symbol->task_name != NULL) {
+          if (symbol->task_name != NULL && !omit_task_guard) {
             s4o.indent_left();
             s4o.print(s4o.indent_spaces + "}\n");
           }
@@ -1913,6 +2196,18 @@ END_RESOURCE
         case run_dt:
           symbol->task_initialization->accept(*this);
           break;
+        case task_info_dt:
+          s4o.print(s4o.indent_spaces + "case ");
+          s4o.print(current_task_index++);
+          s4o.print(": *name = \"");
+          { identifier_c *tmp_id = dynamic_cast<identifier_c*>(current_task_name);
+            if (NULL == tmp_id) ERROR;
+            s4o.printupper(tmp_id->value);
+          }
+          s4o.print("\"; ");
+          symbol->task_initialization->accept(*this);
+          s4o.print(" return 1;\n");
+          break;
         default:
           break;
       }
@@ -1999,6 +2294,22 @@ END_RESOURCE
           }
           s4o.print(";\n");
           break;
+        case task_info_dt:
+          /* SINGLE tasks have no interval. Tasks without an interval run every tick */
+          s4o.print("*interval = ");
+          if (symbol->single_data_source != NULL)
+            s4o.print_long_long_integer(0);
+          else if (symbol->interval_data_source != NULL && calculate_time(symbol->interval_data_source) != 0)
+            s4o.print_long_long_integer(calculate_time(symbol->interval_data_source));
+          else
+            s4o.print_long_long_integer(common_ticktime);
+          s4o.print("; *priority = ");
+          if (symbol->priority_data_source != NULL)
+            symbol->priority_data_source->accept(*this);
+          else
+            s4o.print("0");
+          s4o.print(";");
+          break;
         default:
           break;
       }
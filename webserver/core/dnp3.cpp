@@ -104,11 +104,11 @@ public:
 
             IEC_BOOL crob_val = (code == ControlCode::LATCH_ON);
                            
-            pthread_mutex_lock(&bufferLock);
-            if(bool_output[index/8][index%8] != NULL) {
-                *bool_output[index/8][index%8] = crob_val;
+            beginImageWrite();
+            queueImageWrite(IMAGE_BOOL_OUTPUT, index/8, crob_val << (index%8), 1 << (index%8));
+            if(!endImageWrite()) {
+                return_val = CommandStatus::TOO_MANY_OPS;
             }
-            pthread_mutex_unlock(&bufferLock);
         }
         else {
             return_val = CommandStatus::NOT_SUPPORTED;
@@ -124,18 +124,19 @@ public:
     virtual CommandStatus Operate(const AnalogOutputInt16& command, uint16_t index, OperateType opType) {
         index = index + offset_ao;
         auto ao_val = command.value;
-        pthread_mutex_lock(&bufferLock);
-        if(index < MIN_16B_RANGE && int_output[index] != NULL) {
-            *int_output[index] = ao_val;
+        if(index > MAX_16B_RANGE) {
+            return CommandStatus::OUT_OF_RANGE;
         }
-        else if(index < MAX_16B_RANGE && 
-                int_memory[index - MIN_16B_RANGE] != NULL) {
-            *int_memory[index - MIN_16B_RANGE] = ao_val;
+        beginImageWrite();
+        if(index < MIN_16B_RANGE) {
+            queueImageWrite(IMAGE_INT_OUTPUT, index, (uint16_t)ao_val, 0xffff);
         }
-        else if(index > MAX_16B_RANGE) {
-            return CommandStatus::OUT_OF_RANGE;
+        else if(index < MAX_16B_RANGE) {
+            queueImageWrite(IMAGE_INT_MEMORY, index - MIN_16B_RANGE, (uint16_t)ao_val, 0xffff);
+        }
+        if(!endImageWrite()) {
+            return CommandStatus::TOO_MANY_OPS;
         }
-        pthread_mutex_unlock(&bufferLock);
         return CommandStatus::SUCCESS;
     }
 
@@ -149,11 +150,11 @@ public:
         if(index < MIN_32B_RANGE || index >= MAX_32B_RANGE)
             return CommandStatus::OUT_OF_RANGE;
         
-        pthread_mutex_lock(&bufferLock);
-        if(dint_memory[index - MIN_32B_RANGE] != NULL) {
-            *dint_memory[index - MIN_32B_RANGE] = ao_val;
+        beginImageWrite();
+        queueImageWrite(IMAGE_DINT_MEMORY, index - MIN_32B_RANGE, (uint32_t)(IEC_DINT)ao_val, 0xffffffff);
+        if(!endImageWrite()) {
+            return CommandStatus::TOO_MANY_OPS;
         }
-        pthread_mutex_unlock(&bufferLock);
 
         return CommandStatus::SUCCESS;
     }
@@ -169,11 +170,11 @@ public:
         if(index < MIN_32B_RANGE || index >= MAX_32B_RANGE)
             return CommandStatus::OUT_OF_RANGE;
         
-        pthread_mutex_lock(&bufferLock);
-        if(dint_memory[index - MIN_32B_RANGE] != NULL) {
-            *dint_memory[index - MIN_32B_RANGE] = ao_val;
+        beginImageWrite();
+        queueImageWrite(IMAGE_DINT_MEMORY, index - MIN_32B_RANGE, (uint32_t)(IEC_DINT)ao_val, 0xffffffff);
+        if(!endImageWrite()) {
+            return CommandStatus::TOO_MANY_OPS;
         }
-        pthread_mutex_unlock(&bufferLock);
 
         return CommandStatus::SUCCESS;
     }
@@ -188,11 +189,11 @@ public:
         if(index < MIN_64B_RANGE || index >= MAX_64B_RANGE)
             return CommandStatus::OUT_OF_RANGE;
         
-        pthread_mutex_lock(&bufferLock);
-        if(lint_memory[index - MIN_64B_RANGE] != NULL) {
-            *lint_memory[index - MIN_64B_RANGE] = ao_val;
+        beginImageWrite();
+        queueImageWrite(IMAGE_LINT_MEMORY, index - MIN_64B_RANGE, (uint64_t)(IEC_LINT)ao_val, 0xffffffffffffffffULL);
+        if(!endImageWrite()) {
+            return CommandStatus::TOO_MANY_OPS;
         }
-        pthread_mutex_unlock(&bufferLock);
 
         return CommandStatus::SUCCESS;
     }
@@ -204,56 +205,82 @@ protected:
 //------------------------------------------------------------------
 // Function to update DNP3 values every time they may have changed
 // Updated by Yurgen1975 to support slave devices: DI/DO address 800 and AI/AO address 100
+// Only the points in blocks that changed after generation *since are
+// updated. *since is advanced to the generation of the snapshot used
 //------------------------------------------------------------------
-void update_vals(std::shared_ptr<IOutstation> outstation){
-    UpdateBuilder builder;
-    // Update Discrete input (Binary input) - changed to support offsets (yurgen1975)
-    for(int i = offset_di; i < MAX_DISCRETE_INPUT; i++) {
-        builder.Update(Binary((bool)(*bool_input[i/8][i%8])), i-offset_di);
-    }
+void update_vals(std::shared_ptr<IOutstation> outstation, uint64_t *since){
+    struct image_read read;
+
+    //build the update from the latest snapshot, again if the scan replaced it meanwhile
+    while (true) {
+        UpdateBuilder builder;
+        const struct process_image *image = beginImageRead(&read);
+        uint64_t last = *since;
+        uint64_t generation = image->generation;
+
+        // Update Discrete input (Binary input) - changed to support offsets (yurgen1975)
+        for(int i = offset_di; i < MAX_DISCRETE_INPUT; i++) {
+            if (!imageChanged(image, IMAGE_BOOL_INPUT, i, last)) continue;
+            builder.Update(Binary((bool)((image->bool_input[i/8] >> (i%8)) & 1)), i-offset_di);
+        }
 
-    // Update Coils (Binary Output) - changed to support offsets (yurgen1975)
-    for(int i = offset_do; i < MAX_COILS; i++) {
-        builder.Update(BinaryOutputStatus((bool)(*bool_output[i/8][i%8])), i-offset_do);
-    }    
+        // Update Coils (Binary Output) - changed to support offsets (yurgen1975)
+        for(int i = offset_do; i < MAX_COILS; i++) {
+            if (!imageChanged(image, IMAGE_BOOL_OUTPUT, i, last)) continue;
+            builder.Update(BinaryOutputStatus((bool)((image->bool_output[i/8] >> (i%8)) & 1)), i-offset_do);
+        }    
 
-    // Update Input Registers (Analog Input) - changed to support offsets (yurgen1975)
-    for (int i = offset_ai; i < MAX_INP_REGS; i++) {
-        builder.Update(Analog((int)(*int_input[i])), i-offset_ai);
-    }
-    
-    // Update Holding Registers (Analog Output) - changed to support offsets (yurgen1975)
-    for (int i = offset_ao; i < MIN_16B_RANGE; i++) {
-        builder.Update(AnalogOutputStatus((int)(*int_output[i])), i-offset_ao);
+        // Update Input Registers (Analog Input) - changed to support offsets (yurgen1975)
+        for (int i = offset_ai; i < MAX_INP_REGS; i++) {
+            if (!imageChanged(image, IMAGE_INT_INPUT, i, last)) continue;
+            builder.Update(Analog((int)(image->int_input[i])), i-offset_ai);
+        }
+        
+        // Update Holding Registers (Analog Output) - changed to support offsets (yurgen1975)
+        for (int i = offset_ao; i < MIN_16B_RANGE; i++) {
+            if (!imageChanged(image, IMAGE_INT_OUTPUT, i, last)) continue;
+            builder.Update(AnalogOutputStatus((int)(image->int_output[i])), i-offset_ao);
+        }
+        // Update Holding registers for memory
+        for (int i = MIN_16B_RANGE; i < MAX_16B_RANGE; i++) {
+            if (!imageChanged(image, IMAGE_INT_MEMORY, i - MIN_16B_RANGE, last)) continue;
+            if(int_memory[i - MIN_16B_RANGE] != NULL)
+                builder.Update(
+                        AnalogOutputStatus((int)(image->int_memory[i - MIN_16B_RANGE])),
+                        i
+                );
+        } 
+        // Update Holding registers for 32 b memory
+        for (int i = MIN_32B_RANGE; 
+             (i < MAX_32B_RANGE && 
+                i - MIN_32B_RANGE < BUFFER_SIZE); 
+             i++) {
+            if (!imageChanged(image, IMAGE_DINT_MEMORY, i - MIN_32B_RANGE, last)) continue;
+            if(dint_memory[i - MIN_32B_RANGE] != NULL)
+                builder.Update(
+                        AnalogOutputStatus((int)(image->dint_memory[i - MIN_32B_RANGE])),
+                        i
+                );
+        } 
+        // Update Holding registers for 64 b memory
+        for (int i = MIN_64B_RANGE; 
+             (i < MAX_64B_RANGE && 
+                i - MIN_64B_RANGE < BUFFER_SIZE); 
+             i++) {
+            if (!imageChanged(image, IMAGE_LINT_MEMORY, i - MIN_64B_RANGE, last)) continue;
+            if(lint_memory[i - MIN_64B_RANGE] != NULL)
+                builder.Update(
+                        AnalogOutputStatus((int)(image->lint_memory[i - MIN_64B_RANGE])),
+                        i
+                );
+        } 
+
+        if (endImageRead(&read)) {
+            outstation->Apply(builder.Build());
+            *since = generation;
+            break;
+        }
     }
-    // Update Holding registers for memory
-    for (int i = MIN_16B_RANGE; i < MAX_16B_RANGE; i++) {
-        if(int_memory[i - MIN_16B_RANGE] != NULL)
-            builder.Update(
-                    AnalogOutputStatus((int)(*int_memory[i - MIN_16B_RANGE])),
-                    i
-            );
-    } 
-    // Update Holding registers for 32 b memory
-    for (int i = MIN_32B_RANGE; i < MAX_32B_RANGE; i++) {
-        if(dint_memory[i - MIN_32B_RANGE] != NULL)
-            builder.Update(
-                    AnalogOutputStatus((int)(*dint_memory[i - MIN_32B_RANGE])),
-                    i
-            );
-    } 
-    // Update Holding registers for 64 b memory
-    for (int i = MIN_64B_RANGE; 
-         (i < MAX_64B_RANGE && 
-            i - MIN_64B_RANGE < sizeof(lint_memory) / sizeof(lint_memory[0])); 
-         i++) {
-        if(lint_memory[i - MIN_64B_RANGE] != NULL)
-            builder.Update(
-                    AnalogOutputStatus((int)(*lint_memory[i - MIN_64B_RANGE])),
-                    i
-            );
-    } 
-    outstation->Apply(builder.Build());
 }
 
 //----------------------------------------------------------------------
@@ -447,15 +474,14 @@ void dnp3StartServer(int port) {
 
     mapUnusedIO();
 
-    // Continuously update
+    // Continuously update. The first update sends every point
+    uint64_t image_generation = 0;
     struct timespec timer_start;
     clock_gettime(CLOCK_MONOTONIC, &timer_start);
     
     while(run_dnp3) 
     {
-        pthread_mutex_lock(&bufferLock);
-        update_vals(outstation);
-        pthread_mutex_unlock(&bufferLock);
+        update_vals(outstation, &image_generation);
         sleep_until(&timer_start, OPLC_CYCLE);
     }
     
@@ -48,7 +48,7 @@ void initializeHardware()
 //-----------------------------------------------------------------------------
 void updateBuffersIn()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	/*********READING AND WRITING TO I/O**************
 
@@ -60,7 +60,7 @@ void updateBuffersIn()
 
 	**************************************************/
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -70,7 +70,7 @@ void updateBuffersIn()
 //-----------------------------------------------------------------------------
 void updateBuffersOut()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	/*********READING AND WRITING TO I/O**************
 
@@ -82,6 +82,6 @@ void updateBuffersOut()
 
 	**************************************************/
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
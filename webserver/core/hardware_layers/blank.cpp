@@ -56,7 +56,7 @@ void finalizeHardware()
 //-----------------------------------------------------------------------------
 void updateBuffersIn()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	/*********READING AND WRITING TO I/O**************
 
@@ -68,7 +68,7 @@ void updateBuffersIn()
 
 	**************************************************/
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -78,7 +78,7 @@ void updateBuffersIn()
 //-----------------------------------------------------------------------------
 void updateBuffersOut()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	/*********READING AND WRITING TO I/O**************
 
@@ -90,6 +90,6 @@ void updateBuffersOut()
 
 	**************************************************/
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
@@ -161,7 +161,7 @@ void updateBuffersIn()
 	sendBytes[1] = 0; //make sure output is off
 	sendBytes[2] = 0; //make sure output is off
 
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	for (i=0; i<8; i++)
 	{
 	    if (pinNotPresent(ignored_bool_outputs, ARRAY_SIZE(ignored_bool_outputs), i))
@@ -172,11 +172,11 @@ void updateBuffersIn()
 	    if (pinNotPresent(ignored_bool_outputs, ARRAY_SIZE(ignored_bool_outputs), i))
 		    if (bool_output[1][i%8] != NULL) sendBytes[2] = sendBytes[2] | (*bool_output[1][i%8] << (i-8)); //write each bit
 	}
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 
 	sendOutput(sendBytes, recvBytes);
 
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	//if (int_input[0] != NULL) *int_input[0] = (int)(recvBytes[2] << 8) | (int)recvBytes[3]; //EX
 	//if (int_input[1] != NULL) *int_input[1] = (int)(recvBytes[4] << 8) | (int)recvBytes[5]; //EY
 
@@ -193,7 +193,7 @@ void updateBuffersIn()
 		//printf("%d\t", DiscreteInputBuffer0[i]);
 	}
 	//printf("\n");
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
 
 //-----------------------------------------------------------------------------
@@ -208,7 +208,7 @@ void updateBuffersOut()
 	sendBytes[1] = 0; //make sure output is off
 	sendBytes[2] = 0; //make sure output is off
 
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	for (i=0; i<8; i++)
 	{
 	    if (pinNotPresent(ignored_bool_outputs, ARRAY_SIZE(ignored_bool_outputs), i))
@@ -219,11 +219,11 @@ void updateBuffersOut()
 	    if (pinNotPresent(ignored_bool_outputs, ARRAY_SIZE(ignored_bool_outputs), i))
 		    if (bool_output[1][i%8] != NULL) sendBytes[2] = sendBytes[2] | (*bool_output[1][i%8] << (i-8)); //write each bit
 	}
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 
 	sendOutput(sendBytes, recvBytes);
 
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	//if (int_input[0] != NULL) *int_input[0] = (int)(recvBytes[2] << 8) | (int)recvBytes[3]; //EX
 	//if (int_input[1] != NULL) *int_input[1] = (int)(recvBytes[4] << 8) | (int)recvBytes[5]; //EY
 
@@ -240,6 +240,6 @@ void updateBuffersOut()
 		//printf("%d\t", DiscreteInputBuffer0[i]);
 	}
 	//printf("\n");
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
 
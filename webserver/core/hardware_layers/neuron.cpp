@@ -284,7 +284,7 @@ void finalizeHardware()
 //-----------------------------------------------------------------------------
 void updateBuffersIn()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
     
     /* read digital inputs */
     int i = 0;
@@ -311,7 +311,7 @@ void updateBuffersIn()
         i++;
     }
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -321,7 +321,7 @@ void updateBuffersIn()
 //-----------------------------------------------------------------------------
 void updateBuffersOut()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
     
     /* write digital outputs */
     int i = 0;
@@ -358,6 +358,6 @@ void updateBuffersOut()
         i++;
     }
     
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
     
 }
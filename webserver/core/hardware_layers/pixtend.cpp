@@ -838,7 +838,7 @@ void finalizeHardware()
 void updateBuffersIn()
 {
 	//lock mutexes
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	pthread_mutex_lock(&localBufferLock);
 
 	//DIGITAL INPUT
@@ -859,7 +859,7 @@ void updateBuffersIn()
 
 	//unlock mutexes
 	pthread_mutex_unlock(&localBufferLock);
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
 
 //-----------------------------------------------------------------------------
@@ -870,7 +870,7 @@ void updateBuffersIn()
 void updateBuffersOut()
 {
 	//lock mutexes
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	pthread_mutex_lock(&localBufferLock);
 
 	//DIGITAL OUTPUT
@@ -909,5 +909,5 @@ void updateBuffersOut()
 
 	//unlock mutexes
 	pthread_mutex_unlock(&localBufferLock);
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
@@ -621,7 +621,7 @@ void finalizeHardware()
 void updateBuffersIn()
 {
 	//lock mutexes
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	pthread_mutex_lock(&localBufferLock);
     
     //DIGITAL INPUT
@@ -715,7 +715,7 @@ void updateBuffersIn()
    
 	//unlock mutexes
 	pthread_mutex_unlock(&localBufferLock);
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
 
 //-----------------------------------------------------------------------------
@@ -728,7 +728,7 @@ void updateBuffersOut()
     int inum = 0;
 
 	//lock mutexes
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	pthread_mutex_lock(&localBufferLock);   
     
     //DIGITAL OUTPUT
@@ -822,5 +822,5 @@ void updateBuffersOut()
     
 	//unlock mutexes
 	pthread_mutex_unlock(&localBufferLock);
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
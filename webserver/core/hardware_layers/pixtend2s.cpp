@@ -558,7 +558,7 @@ void finalizeHardware()
 void updateBuffersIn()
 {
 	//lock mutexes
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	pthread_mutex_lock(&localBufferLock);
     
     //DIGITAL INPUT
@@ -643,7 +643,7 @@ void updateBuffersIn()
    
 	//unlock mutexes
 	pthread_mutex_unlock(&localBufferLock);
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
 
 //-----------------------------------------------------------------------------
@@ -654,7 +654,7 @@ void updateBuffersIn()
 void updateBuffersOut()
 {
 	//lock mutexes
-	pthread_mutex_lock(&bufferLock);
+	PLC_LOCK(&bufferLock);
 	pthread_mutex_lock(&localBufferLock);   
     
     //DIGITAL OUTPUT
@@ -728,5 +728,5 @@ void updateBuffersOut()
     
 	//unlock mutexes
 	pthread_mutex_unlock(&localBufferLock);
-	pthread_mutex_unlock(&bufferLock);
+	PLC_UNLOCK(&bufferLock);
 }
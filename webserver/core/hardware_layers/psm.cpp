@@ -158,14 +158,14 @@ void read_ana_inp(int psm)
     if (buffer[8] < 50)
         return;
 
-    pthread_mutex_lock(&bufferLock); //lock mutex
+    PLC_LOCK(&bufferLock); //lock mutex
     int k = 9; //start at the beginning of data
     for (int i=0; i<25; i++)
     {
         if (int_input[i] != NULL) *int_input[i] = buffer[k+1] | (uint16_t)buffer[k] << 8;
         k=k+2;
     }
-    pthread_mutex_unlock(&bufferLock); //unlock mutex
+    PLC_UNLOCK(&bufferLock); //unlock mutex
 
     request[9]=25; //request the next 25 items
     buffer[8]=0; //zeroed previous response size
@@ -181,14 +181,14 @@ void read_ana_inp(int psm)
         check_error_count();
     }
 
-    pthread_mutex_lock(&bufferLock); //lock mutex
+    PLC_LOCK(&bufferLock); //lock mutex
     k = 9; //start at the beginning of data
     for (int i=25; i<50; i++)
     {
         if (int_input[i] != NULL) *int_input[i] = buffer[k+1] | (uint16_t)buffer[k] << 8;
         k=k+2;
     }
-    pthread_mutex_unlock(&bufferLock); //unlock mutex
+    PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -201,7 +201,7 @@ void write_ana_out(int psm)
     unsigned char request[] = {00, 01, 00, 00, 00, 57, 00, 16, 00, 00, 00, 25, 50, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00, 00};
     unsigned char buffer[1024];
     
-    pthread_mutex_lock(&bufferLock); //lock mutex
+    PLC_LOCK(&bufferLock); //lock mutex
     int k = 13;
     for (int i = 0; i < 25; i ++)
     {
@@ -213,7 +213,7 @@ void write_ana_out(int psm)
             k++;
         }
     }
-    pthread_mutex_unlock(&bufferLock); //unlock mutex
+    PLC_UNLOCK(&bufferLock); //unlock mutex
     
     send(psm, request, 63, 0);
     read(psm, buffer, 1024);
@@ -227,7 +227,7 @@ void write_ana_out(int psm)
         check_error_count();
     }
     
-    pthread_mutex_lock(&bufferLock); //lock mutex
+    PLC_LOCK(&bufferLock); //lock mutex
     //write next 25 items
     request[9] = 25;
     k = 13;
@@ -241,7 +241,7 @@ void write_ana_out(int psm)
             k++;
         }
     }
-    pthread_mutex_unlock(&bufferLock); //unlock mutex
+    PLC_UNLOCK(&bufferLock); //unlock mutex
     
     send(psm, request, 63, 0);
     read(psm, buffer, 1024);
@@ -284,7 +284,7 @@ void read_dig_inp(int psm)
     //byte 3 => coils 23 to 16
     
     //read inputs into buffer
-    pthread_mutex_lock(&bufferLock); //lock mutex
+    PLC_LOCK(&bufferLock); //lock mutex
     int a = 0;
     for (int i = 9; i < 59; i++)
     {
@@ -294,7 +294,7 @@ void read_dig_inp(int psm)
             a++;
         }
     }
-    pthread_mutex_unlock(&bufferLock); //unlock mutex
+    PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -308,7 +308,7 @@ void write_dig_out(int psm)
     unsigned char buffer[1024];
     
     //write all coils from buffer to request
-    pthread_mutex_lock(&bufferLock); //lock mutex
+    PLC_LOCK(&bufferLock); //lock mutex
     for (int i = 0; i < 50; i++)
     {
         for (int j = 0; j < 8; j++)
@@ -319,7 +319,7 @@ void write_dig_out(int psm)
             }
         }
     }
-    pthread_mutex_unlock(&bufferLock); //unlock mutex
+    PLC_UNLOCK(&bufferLock); //unlock mutex
     
     send(psm, request, 63, 0);
     read(psm, buffer, 1024);
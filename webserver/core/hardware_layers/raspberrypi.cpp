@@ -114,7 +114,7 @@ void finalizeHardware()
 //-----------------------------------------------------------------------------
 void updateBuffersIn()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	//INPUT
 	for (int i = 0; i < MAX_INPUT; i++)
@@ -123,7 +123,7 @@ void updateBuffersIn()
     		if (bool_input[i/8][i%8] != NULL) *bool_input[i/8][i%8] = digitalRead(inBufferPinMask[i]);
 	}
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -133,7 +133,7 @@ void updateBuffersIn()
 //-----------------------------------------------------------------------------
 void updateBuffersOut()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	//OUTPUT
 	for (int i = 0; i < MAX_OUTPUT; i++)
@@ -149,5 +149,5 @@ void updateBuffersOut()
     		if (int_output[i] != NULL) pwmWrite(analogOutBufferPinMask[i], (*int_output[i] / 64));
 	}
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
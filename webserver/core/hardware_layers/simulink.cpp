@@ -129,7 +129,7 @@ void *exchangeData(void *arg)
 		}
 		else
 		{
-			pthread_mutex_lock(&bufferLock); //lock mutex
+			PLC_LOCK(&bufferLock); //lock mutex
 			for (int i = 0; i < ANALOG_BUF_SIZE; i++)
 			{
                 if (pinNotPresent(ignored_int_inputs, ARRAY_SIZE(ignored_int_inputs), i))
@@ -146,7 +146,7 @@ void *exchangeData(void *arg)
 				if (pinNotPresent(ignored_bool_outputs, ARRAY_SIZE(ignored_bool_outputs), i))
     				if (bool_output[i/8][i%8] != NULL) plc_data->digitalOut[i] = *bool_output[i/8][i%8];
 			}
-			pthread_mutex_unlock(&bufferLock); //unlock mutex
+			PLC_UNLOCK(&bufferLock); //unlock mutex
 
 			//printf("sending data...\n");
 			net_len = sendto(socket_fd, plc_data, sizeof(*plc_data), 0, (struct sockaddr *) &client, cli_len);
@@ -208,7 +208,7 @@ void finalizeHardware()
 void updateBuffersIn()
 {
 	//printf("Digital Inputs:\n");
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 	for (int i = 0; i < MAX_INPUT; i++)
 	{
 	    if (pinNotPresent(ignored_bool_inputs, ARRAY_SIZE(ignored_bool_inputs), i))
@@ -223,7 +223,7 @@ void updateBuffersIn()
 	}
 	//printf("\n");
 
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
 
 //-----------------------------------------------------------------------------
@@ -233,7 +233,7 @@ void updateBuffersIn()
 //-----------------------------------------------------------------------------
 void updateBuffersOut()
 {
-	pthread_mutex_lock(&bufferLock); //lock mutex
+	PLC_LOCK(&bufferLock); //lock mutex
 
 	//printf("\nDigital Outputs:\n");
 	for (int i = 0; i < MAX_OUTPUT; i++)
@@ -245,5 +245,5 @@ void updateBuffersOut()
 	if (pinNotPresent(ignored_int_outputs, ARRAY_SIZE(ignored_int_outputs), 0))
 	    if(int_output[0] != NULL) pwmWrite(ANALOG_OUT_PIN, (*int_output[0] / 64));
 	
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
@@ -40,6 +40,8 @@
 //Global Variables
 bool run_modbus = 0;
 uint16_t modbus_port = 502;
+bool run_modbus_rtu = 0;
+bool run_modbus_udp = 0;
 bool run_dnp3 = 0;
 uint16_t dnp3_port = 20000;
 bool run_enip = 0;
@@ -56,6 +58,8 @@ time_t end_time;
 pthread_t modbus_thread;
 pthread_t dnp3_thread;
 pthread_t enip_thread;
+pthread_t modbus_rtu_thread;
+pthread_t modbus_udp_thread;
 pthread_t pstorage_thread;
 
 //-----------------------------------------------------------------------------
@@ -63,6 +67,7 @@ pthread_t pstorage_thread;
 //-----------------------------------------------------------------------------
 void *modbusThread(void *arg)
 {
+    configureThread("modbus", -1, 0);
     startServer(modbus_port, MODBUS_PROTOCOL);
 }
 
@@ -71,6 +76,7 @@ void *modbusThread(void *arg)
 //-----------------------------------------------------------------------------
 void *dnp3Thread(void *arg)
 {
+    configureThread("dnp3", -1, 0);
     dnp3StartServer(dnp3_port);
 }
 
@@ -79,14 +85,34 @@ void *dnp3Thread(void *arg)
 //-----------------------------------------------------------------------------
 void *enipThread(void *arg)
 {
+    configureThread("enip", -1, 0);
     startServer(enip_port, ENIP_PROTOCOL);
 }
 
+//-----------------------------------------------------------------------------
+// Start the Modbus RTU Thread
+//-----------------------------------------------------------------------------
+void *modbusRtuThread(void *arg)
+{
+    configureThread("modbus", -1, 0);
+    startRtuServer();
+}
+
+//-----------------------------------------------------------------------------
+// Start the Modbus/UDP Thread
+//-----------------------------------------------------------------------------
+void *modbusUdpThread(void *arg)
+{
+    configureThread("modbus", -1, 0);
+    startUdpServer();
+}
+
 //-----------------------------------------------------------------------------
 // Start the Persistent Storage Thread
 //-----------------------------------------------------------------------------
 void *pstorageThread(void *arg)
 {
+    configureThread("pstorage", -1, 0);
     startPstorage();
 }
 
@@ -225,6 +251,20 @@ void processCommand(unsigned char *buffer, int client_fd)
             sprintf(log_msg, "Modbus server was stopped\n");
             log(log_msg);
         }
+        if (run_modbus_rtu)
+        {
+            run_modbus_rtu = 0;
+            pthread_join(modbus_rtu_thread, NULL);
+            sprintf(log_msg, "Modbus RTU slave was stopped\n");
+            log(log_msg);
+        }
+        if (run_modbus_udp)
+        {
+            run_modbus_udp = 0;
+            pthread_join(modbus_udp_thread, NULL);
+            sprintf(log_msg, "Modbus/UDP server was stopped\n");
+            log(log_msg);
+        }
         if (run_dnp3)
         {
             run_dnp3 = 0;
@@ -340,6 +380,77 @@ void processCommand(unsigned char *buffer, int client_fd)
         }
         processing_command = false;
     }
+    else if (strncmp(buffer, "start_modbus_rtu()", 18) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued start_modbus_rtu() command\n");
+        log(log_msg);
+        if (run_modbus_rtu)
+        {
+            sprintf(log_msg, "Modbus RTU slave already active. Restarting\n");
+            log(log_msg);
+            run_modbus_rtu = 0;
+            pthread_join(modbus_rtu_thread, NULL);
+        }
+        //the serial port settings are read from runtime.cfg on start
+        char device[256] = "";
+        if (getConfigString("modbus_rtu_device", device, sizeof(device)) && device[0] != '\0')
+        {
+            run_modbus_rtu = 1;
+            pthread_create(&modbus_rtu_thread, NULL, modbusRtuThread, NULL);
+        }
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "stop_modbus_rtu()", 17) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued stop_modbus_rtu() command\n");
+        log(log_msg);
+        if (run_modbus_rtu)
+        {
+            run_modbus_rtu = 0;
+            pthread_join(modbus_rtu_thread, NULL);
+            sprintf(log_msg, "Modbus RTU slave was stopped\n");
+            log(log_msg);
+        }
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "start_modbus_udp()", 18) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued start_modbus_udp() command\n");
+        log(log_msg);
+        if (run_modbus_udp)
+        {
+            sprintf(log_msg, "Modbus/UDP server already active. Restarting\n");
+            log(log_msg);
+            run_modbus_udp = 0;
+            pthread_join(modbus_udp_thread, NULL);
+        }
+        //the port and the publish settings are read from runtime.cfg on start
+        char targets[256] = "";
+        getConfigString("modbus_publish_targets", targets, sizeof(targets));
+        if (getConfigInt("modbus_udp_port", 0) > 0 || targets[0] != '\0')
+        {
+            run_modbus_udp = 1;
+            pthread_create(&modbus_udp_thread, NULL, modbusUdpThread, NULL);
+        }
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "stop_modbus_udp()", 17) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued stop_modbus_udp() command\n");
+        log(log_msg);
+        if (run_modbus_udp)
+        {
+            run_modbus_udp = 0;
+            pthread_join(modbus_udp_thread, NULL);
+            sprintf(log_msg, "Modbus/UDP server was stopped\n");
+            log(log_msg);
+        }
+        processing_command = false;
+    }
     else if (strncmp(buffer, "start_pstorage(", 15) == 0)
     {
         processing_command = true;
@@ -386,6 +497,91 @@ void processCommand(unsigned char *buffer, int client_fd)
         processing_command = false;
         return;
     }
+    else if (strncmp(buffer, "scan_stats()", 12) == 0)
+    {
+        processing_command = true;
+        char stats_buffer[4096];
+        count_char = printScanStats(stats_buffer, sizeof(stats_buffer));
+        write(client_fd, stats_buffer, count_char);
+        processing_command = false;
+        return;
+    }
+    else if (strncmp(buffer, "task_stats()", 12) == 0)
+    {
+        processing_command = true;
+        char stats_buffer[4096];
+        count_char = printTaskStats(stats_buffer, sizeof(stats_buffer));
+        write(client_fd, stats_buffer, count_char);
+        processing_command = false;
+        return;
+    }
+    else if (strncmp(buffer, "lock_stats()", 12) == 0)
+    {
+        processing_command = true;
+        char stats_buffer[16384];
+        count_char = printLockStats(stats_buffer, sizeof(stats_buffer));
+        write(client_fd, stats_buffer, count_char);
+        processing_command = false;
+        return;
+    }
+    else if (strncmp(buffer, "server_stats()", 14) == 0)
+    {
+        processing_command = true;
+        char stats_buffer[1000];
+        count_char = printServerStats(stats_buffer, sizeof(stats_buffer));
+        write(client_fd, stats_buffer, count_char);
+        processing_command = false;
+        return;
+    }
+    else if (strncmp(buffer, "trigger_task(", 13) == 0)
+    {
+        processing_command = true;
+        char task_name[100];
+        int i = 0;
+        for (unsigned char *c = buffer + 13; *c != ')' && *c != '\0' && i < 99; c++)
+            task_name[i++] = *c;
+        task_name[i] = '\0';
+        if (!triggerTask(task_name))
+        {
+            count_char = sprintf(buffer, "Error: no event task named %s\n", task_name);
+            write(client_fd, buffer, count_char);
+            processing_command = false;
+            return;
+        }
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "reset_watchdog()", 16) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued reset_watchdog() command\n");
+        log(log_msg);
+        watchdog_tripped = false;
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "reset_scan_stats()", 18) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued reset_scan_stats() command\n");
+        log(log_msg);
+        resetScanStats();
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "reload_config()", 15) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued reload_config() command\n");
+        log(log_msg);
+        parseRuntimeConfig();
+        processing_command = false;
+    }
+    else if (strncmp(buffer, "reset_lock_stats()", 18) == 0)
+    {
+        processing_command = true;
+        sprintf(log_msg, "Issued reset_lock_stats() command\n");
+        log(log_msg);
+        resetLockStats();
+        processing_command = false;
+    }
     else
     {
         processing_command = true;
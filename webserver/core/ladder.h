@@ -25,14 +25,32 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <atomic>
 
 #define MODBUS_PROTOCOL     0
 #define DNP3_PROTOCOL       1
 #define ENIP_PROTOCOL       2
 
+//Scan cycle statistics
+#define STAT_WAKE_LATENCY   0
+#define STAT_INPUT          1
+#define STAT_PROGRAM        2
+#define STAT_OUTPUT         3
+#define STAT_SCAN           4
+#define NUM_SCAN_STATS      5
+
 //Internal buffers for I/O and memory. These buffers are defined in the
-//auto-generated glueVars.cpp file
+//auto-generated glueVars.cpp file. glue_generator sizes them from the
+//located variables of the program and writes the size to glueVars.h.
+//Every area gets the same size, from the highest address of any of them
+#if defined(__has_include)
+#if __has_include("glueVars.h")
+#include "glueVars.h"
+#endif
+#endif
+#ifndef BUFFER_SIZE
 #define BUFFER_SIZE		1024
+#endif
 /*********************/
 /*  IEC Types defs   */
 /*********************/
@@ -77,12 +95,77 @@ extern IEC_LINT *lint_memory[BUFFER_SIZE];
 //Special Functions
 extern IEC_LINT *special_functions[BUFFER_SIZE];
 
+//Compact process image. These arrays are only defined when glueVars.cpp is
+//generated with --compact, otherwise their addresses are NULL
+extern IEC_BOOL compact_bool_input[BUFFER_SIZE][8] __attribute__((weak));
+extern IEC_BOOL compact_bool_output[BUFFER_SIZE][8] __attribute__((weak));
+extern IEC_BYTE compact_byte_input[BUFFER_SIZE] __attribute__((weak));
+extern IEC_BYTE compact_byte_output[BUFFER_SIZE] __attribute__((weak));
+extern IEC_UINT compact_int_input[BUFFER_SIZE] __attribute__((weak));
+extern IEC_UINT compact_int_output[BUFFER_SIZE] __attribute__((weak));
+extern IEC_UINT compact_int_memory[BUFFER_SIZE] __attribute__((weak));
+extern IEC_DINT compact_dint_memory[BUFFER_SIZE] __attribute__((weak));
+extern IEC_LINT compact_lint_memory[BUFFER_SIZE] __attribute__((weak));
+
 //lock for the buffer
 extern pthread_mutex_t bufferLock;
+extern pthread_mutex_t ioLock;
 
 //Common task timer
 extern unsigned long long common_ticktime__;
 
+//Areas of the image. The first ones can also be written by the protocols
+#define IMAGE_BOOL_OUTPUT   0
+#define IMAGE_INT_OUTPUT    1
+#define IMAGE_INT_MEMORY    2
+#define IMAGE_DINT_MEMORY   3
+#define IMAGE_LINT_MEMORY   4
+#define IMAGE_BOOL_INPUT    5
+#define IMAGE_INT_INPUT     6
+#define IMAGE_AREAS         7
+
+//Change tracking granularity. Each area is split in blocks of 64 slots
+//(bits for the boolean areas, registers for the others)
+#define IMAGE_BLOCK_SLOTS   64
+#define IMAGE_MAX_BLOCKS    (BUFFER_SIZE * 8 / IMAGE_BLOCK_SLOTS)
+
+//Snapshot of the buffer values published at the end of every scan cycle.
+//NULL buffer positions read as zero. Booleans are bit-packed: bit j of
+//bool_input[i] is %IXi.j. block_generation holds the generation in which
+//each block last changed. Every area is dense, so the size of a snapshot
+//follows BUFFER_SIZE, the highest address the program uses
+struct process_image
+{
+    uint64_t generation;
+    uint64_t block_generation[IMAGE_AREAS][IMAGE_MAX_BLOCKS];
+    uint8_t bool_input[BUFFER_SIZE] __attribute__((aligned(64)));
+    uint8_t bool_output[BUFFER_SIZE] __attribute__((aligned(64)));
+    IEC_UINT int_input[BUFFER_SIZE] __attribute__((aligned(64)));
+    IEC_UINT int_output[BUFFER_SIZE] __attribute__((aligned(64)));
+    IEC_UINT int_memory[BUFFER_SIZE] __attribute__((aligned(64)));
+    IEC_DINT dint_memory[BUFFER_SIZE] __attribute__((aligned(64)));
+    IEC_LINT lint_memory[BUFFER_SIZE] __attribute__((aligned(64)));
+};
+
+struct image_read
+{
+    int index;
+    unsigned int seq;
+};
+
+//Modbus/TCP request forwarded by the gateway to a serial slave. The response
+//is written over the request in adu and complete() is called from the
+//master thread once it is there
+struct gateway_request
+{
+    unsigned char *adu;
+    int size;
+    void (*complete)(struct gateway_request *request);
+    void *context;
+    unsigned int tag;
+    struct gateway_request *next;
+};
+
 //----------------------------------------------------------------------
 //FUNCTION PROTOTYPES
 //----------------------------------------------------------------------
@@ -118,17 +201,79 @@ bool pinNotPresent(int *ignored_vector, int vector_size, int pinNumber);
 extern uint8_t run_openplc;
 extern unsigned char log_buffer[1000000];
 extern int log_index;
+extern std::atomic<bool> watchdog_tripped;
 void handleSpecialFunctions();
+bool waitNextCycle(struct timespec *ts, unsigned long long period);
+
+//scan_stats.cpp
+unsigned long long getTimeNs();
+void initScanStats();
+void recordScanStat(int stat_index, unsigned long long value_ns);
+unsigned long long getScanStatLast(int stat_index);
+unsigned long long getScanStatMax(int stat_index);
+void resetScanStats();
+int printScanStats(char *buffer, int buffer_size);
+unsigned long long recordOverrun(bool overrun);
+unsigned long long getOverrunCount();
+
+//runtime_config.cpp
+void parseRuntimeConfig();
+bool getConfigString(const char *key, char *value, int value_size);
+int getConfigInt(const char *key, int default_value);
+
+//process_image.cpp
+bool compactProcessImage();
+void mapProcessImage();
+void publishProcessImage();
+int imagePublishedEvent();
+uint8_t readImageBits(const uint8_t *bits, int position);
+int readImageBitRange(uint8_t *dest, const uint8_t *bits, int position, int count);
+bool imageChanged(const struct process_image *image, int area, int slot, uint64_t since);
+const struct process_image *beginImageRead(struct image_read *read);
+bool endImageRead(struct image_read *read);
+void beginImageWrite();
+void queueImageWrite(int area, int index, uint64_t value, uint64_t mask);
+void queueImageBits(const uint8_t *values, int position, int count);
+bool endImageWrite();
+int applyImageWrites();
+
+//lock_stats.cpp
+#define PLC_LOCK(lock) do { static int lock_site = -1; plcMutexLock(lock, &lock_site, __FILE__, __LINE__, __func__); } while (0)
+#define PLC_UNLOCK(lock) plcMutexUnlock(lock)
+bool initPlcMutex(pthread_mutex_t *lock, const char *name);
+void plcMutexLock(pthread_mutex_t *lock, int *site, const char *file, int line, const char *function);
+void plcMutexUnlock(pthread_mutex_t *lock);
+void resetLockStats();
+int printLockStats(char *buffer, int buffer_size);
+
+//thread_config.cpp
+void configureThread(const char *thread_class, int default_policy, int default_priority);
+void reportCpuIsolation();
+
+//task_scheduler.cpp
+bool startTaskScheduler();
+void stopTaskScheduler();
+void runBackgroundTasks(unsigned long tick);
+void checkTaskEvents();
+bool isTaskInput(int index, uint64_t mask);
+void applyTaskInputWrites();
+bool taskImagesActive();
+bool triggerTask(const char *task_name);
+int printTaskStats(char *buffer, int buffer_size);
 
 //server.cpp
 void startServer(uint16_t port, int protocol_type);
 int getSO_ERROR(int fd);
 void closeSocket(int fd);
 bool SetSocketBlockingEnabled(int fd, bool blocking);
+int printServerStats(char *buffer, int buffer_size);
+void startUdpServer();
 
 //interactive_server.cpp
 void startInteractiveServer(int port);
 extern bool run_modbus;
+extern bool run_modbus_rtu;
+extern bool run_modbus_udp;
 extern bool run_dnp3;
 extern bool run_enip;
 extern bool run_pstorage;
@@ -138,8 +283,12 @@ extern time_t end_time;
 
 //modbus.cpp
 int processModbusMessage(unsigned char *buffer, int bufferSize);
+int buildRegisterPublish(unsigned char *buffer, int start, int count, uint16_t sequence);
 void mapUnusedIO();
 
+//modbus_rtu.cpp
+void startRtuServer();
+
 //enip.cpp
 int processEnipMessage(unsigned char *buffer, int buffer_size);
 
@@ -151,6 +300,9 @@ void initializeMB();
 void *querySlaveDevices(void *arg);
 void updateBuffersIn_MB();
 void updateBuffersOut_MB();
+bool isGatewayUnit(uint8_t unit_id);
+bool forwardModbusRequest(struct gateway_request *request);
+void cancelModbusRequests(void (*complete)(struct gateway_request *request));
 
 //dnp3.cpp
 void dnp3StartServer(int port);
@@ -0,0 +1,329 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file implements the instrumented mutexes used for the global locks.
+// The mutexes are created with priority inheritance, and every call site
+// that goes through PLC_LOCK() records how long it waited for the lock, how
+// long it held it and who was holding it when it had to wait.
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "ladder.h"
+
+#define MAX_PLC_LOCKS           8
+#define MAX_LOCK_SITES          64
+#define NO_SITE                 -1
+
+struct plc_lock
+{
+    pthread_mutex_t *mutex;
+    const char *name;
+    bool priority_inheritance;
+    std::atomic<int> holder_site;
+    std::atomic<int> holder_tid;
+    unsigned long long acquired_at;
+};
+
+//Counters are only updated while holding the lock they belong to, so they
+//never have more than one writer at a time
+struct lock_site
+{
+    int lock_index;
+    const char *file;
+    int line;
+    const char *function;
+    std::atomic<uint64_t> acquisitions;
+    std::atomic<uint64_t> contended;
+    std::atomic<uint64_t> wait_total;
+    std::atomic<uint64_t> wait_max;
+    std::atomic<uint64_t> hold_total;
+    std::atomic<uint64_t> hold_max;
+    std::atomic<int> last_blocker_site;
+    std::atomic<int> last_blocker_tid;
+};
+
+static struct plc_lock plc_locks[MAX_PLC_LOCKS];
+static std::atomic<int> num_plc_locks(0);
+static struct lock_site lock_sites[MAX_LOCK_SITES];
+static std::atomic<int> num_lock_sites(0);
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+// Returns the kernel id of the calling thread
+//-----------------------------------------------------------------------------
+static int threadId()
+{
+#ifdef __linux__
+    return (int)syscall(SYS_gettid);
+#else
+    return 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Initializes lock as a priority inheritance mutex and registers it for
+// the lock statistics. Returns false if the mutex could not be initialized
+//-----------------------------------------------------------------------------
+bool initPlcMutex(pthread_mutex_t *lock, const char *name)
+{
+    pthread_mutexattr_t attr;
+    bool priority_inheritance = false;
+
+    pthread_mutexattr_init(&attr);
+#ifdef _POSIX_THREAD_PRIO_INHERIT
+    if (pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT) == 0)
+        priority_inheritance = true;
+#endif
+    int ret = pthread_mutex_init(lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (ret != 0)
+        return false;
+
+    pthread_mutex_lock(&registryLock);
+    int index = num_plc_locks.load();
+    if (index < MAX_PLC_LOCKS)
+    {
+        plc_locks[index].mutex = lock;
+        plc_locks[index].name = name;
+        plc_locks[index].priority_inheritance = priority_inheritance;
+        plc_locks[index].holder_site.store(NO_SITE);
+        plc_locks[index].holder_tid.store(0);
+        num_plc_locks.store(index + 1, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&registryLock);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Finds the registered lock for a mutex. Returns NULL if it was not created
+// with initPlcMutex()
+//-----------------------------------------------------------------------------
+static struct plc_lock *findLock(pthread_mutex_t *lock)
+{
+    int count = num_plc_locks.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        if (plc_locks[i].mutex == lock) return &plc_locks[i];
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Registers a call site the first time it is used. site is the static
+// variable created by the PLC_LOCK() macro
+//-----------------------------------------------------------------------------
+static void registerSite(pthread_mutex_t *lock, int *site, const char *file, int line, const char *function)
+{
+    pthread_mutex_lock(&registryLock);
+    if (*site == NO_SITE && num_lock_sites.load() < MAX_LOCK_SITES)
+    {
+        int index = num_lock_sites.load();
+        struct plc_lock *plc_lock = findLock(lock);
+        lock_sites[index].lock_index = (plc_lock != NULL) ? (int)(plc_lock - plc_locks) : NO_SITE;
+        lock_sites[index].file = file;
+        lock_sites[index].line = line;
+        lock_sites[index].function = function;
+        lock_sites[index].last_blocker_site.store(NO_SITE);
+        num_lock_sites.store(index + 1, std::memory_order_release);
+        *site = index;
+    }
+    pthread_mutex_unlock(&registryLock);
+}
+
+//-----------------------------------------------------------------------------
+// Locks the mutex and updates the statistics of the call site. Use it
+// through the PLC_LOCK() macro
+//-----------------------------------------------------------------------------
+void plcMutexLock(pthread_mutex_t *lock, int *site, const char *file, int line, const char *function)
+{
+    if (*site == NO_SITE)
+        registerSite(lock, site, file, line, function);
+
+    //site table full or lock not registered. Just lock it
+    if (*site == NO_SITE || lock_sites[*site].lock_index == NO_SITE)
+    {
+        pthread_mutex_lock(lock);
+        return;
+    }
+
+    struct lock_site *lock_site = &lock_sites[*site];
+    struct plc_lock *plc_lock = &plc_locks[lock_site->lock_index];
+    unsigned long long wait_start = getTimeNs();
+    bool contended = false;
+    int blocker_site = NO_SITE;
+    int blocker_tid = 0;
+
+    if (pthread_mutex_trylock(lock) != 0)
+    {
+        //remember who had it. NO_SITE means a holder that doesn't use PLC_LOCK()
+        contended = true;
+        blocker_site = plc_lock->holder_site.load(std::memory_order_relaxed);
+        blocker_tid = plc_lock->holder_tid.load(std::memory_order_relaxed);
+        pthread_mutex_lock(lock);
+    }
+
+    unsigned long long acquired = getTimeNs();
+    unsigned long long wait_time = acquired - wait_start;
+
+    plc_lock->acquired_at = acquired;
+    plc_lock->holder_site.store(*site, std::memory_order_relaxed);
+    plc_lock->holder_tid.store(threadId(), std::memory_order_relaxed);
+
+    lock_site->acquisitions.store(lock_site->acquisitions.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    lock_site->wait_total.store(lock_site->wait_total.load(std::memory_order_relaxed) + wait_time, std::memory_order_relaxed);
+    if (wait_time > lock_site->wait_max.load(std::memory_order_relaxed))
+        lock_site->wait_max.store(wait_time, std::memory_order_relaxed);
+    if (contended)
+    {
+        lock_site->contended.store(lock_site->contended.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        lock_site->last_blocker_site.store(blocker_site, std::memory_order_relaxed);
+        lock_site->last_blocker_tid.store(blocker_tid, std::memory_order_relaxed);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Updates the hold time of the call site that locked the mutex and unlocks
+// it. Use it through the PLC_UNLOCK() macro
+//-----------------------------------------------------------------------------
+void plcMutexUnlock(pthread_mutex_t *lock)
+{
+    struct plc_lock *plc_lock = findLock(lock);
+
+    if (plc_lock != NULL)
+    {
+        int site = plc_lock->holder_site.load(std::memory_order_relaxed);
+        if (site != NO_SITE)
+        {
+            struct lock_site *lock_site = &lock_sites[site];
+            unsigned long long hold_time = getTimeNs() - plc_lock->acquired_at;
+            lock_site->hold_total.store(lock_site->hold_total.load(std::memory_order_relaxed) + hold_time, std::memory_order_relaxed);
+            if (hold_time > lock_site->hold_max.load(std::memory_order_relaxed))
+                lock_site->hold_max.store(hold_time, std::memory_order_relaxed);
+        }
+        plc_lock->holder_site.store(NO_SITE, std::memory_order_relaxed);
+        plc_lock->holder_tid.store(0, std::memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(lock);
+}
+
+//-----------------------------------------------------------------------------
+// Clears the counters of every call site
+//-----------------------------------------------------------------------------
+void resetLockStats()
+{
+    int count = num_lock_sites.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        lock_sites[i].acquisitions.store(0);
+        lock_sites[i].contended.store(0);
+        lock_sites[i].wait_total.store(0);
+        lock_sites[i].wait_max.store(0);
+        lock_sites[i].hold_total.store(0);
+        lock_sites[i].hold_max.store(0);
+        lock_sites[i].last_blocker_site.store(NO_SITE);
+        lock_sites[i].last_blocker_tid.store(0);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reads the name of a thread of this process. Leaves name empty if the
+// thread doesn't exist anymore
+//-----------------------------------------------------------------------------
+static void threadName(int tid, char *name, int name_size)
+{
+    char path[64];
+    name[0] = '\0';
+
+    sprintf(path, "/proc/self/task/%d/comm", tid);
+    FILE *comm = fopen(path, "r");
+    if (comm == NULL)
+        return;
+
+    if (fgets(name, name_size, comm) != NULL)
+        name[strcspn(name, "\n")] = '\0';
+    fclose(comm);
+}
+
+//-----------------------------------------------------------------------------
+// Writes a text report of the lock statistics into buffer, grouped by lock.
+// Times are in nanoseconds. Returns the number of characters written
+//-----------------------------------------------------------------------------
+int printLockStats(char *buffer, int buffer_size)
+{
+    int count_char = 0;
+    int lock_count = num_plc_locks.load(std::memory_order_acquire);
+    int site_count = num_lock_sites.load(std::memory_order_acquire);
+
+    buffer[0] = '\0';
+    for (int i = 0; i < lock_count && count_char < buffer_size; i++)
+    {
+        count_char += snprintf(buffer + count_char, buffer_size - count_char, "%s: priority_inheritance=%s\n",
+                               plc_locks[i].name, plc_locks[i].priority_inheritance ? "yes" : "no");
+
+        for (int j = 0; j < site_count && count_char < buffer_size; j++)
+        {
+            struct lock_site *site = &lock_sites[j];
+            if (site->lock_index != i)
+                continue;
+
+            uint64_t acquisitions = site->acquisitions.load(std::memory_order_relaxed);
+            count_char += snprintf(buffer + count_char, buffer_size - count_char,
+                                   "  %s:%d %s: count=%llu contended=%llu wait_mean=%llu wait_max=%llu hold_mean=%llu hold_max=%llu",
+                                   site->file, site->line, site->function, (unsigned long long)acquisitions,
+                                   (unsigned long long)site->contended.load(std::memory_order_relaxed),
+                                   (unsigned long long)(acquisitions ? site->wait_total.load(std::memory_order_relaxed) / acquisitions : 0),
+                                   (unsigned long long)site->wait_max.load(std::memory_order_relaxed),
+                                   (unsigned long long)(acquisitions ? site->hold_total.load(std::memory_order_relaxed) / acquisitions : 0),
+                                   (unsigned long long)site->hold_max.load(std::memory_order_relaxed));
+
+            if (count_char < buffer_size && site->contended.load(std::memory_order_relaxed) > 0)
+            {
+                int blocker = site->last_blocker_site.load(std::memory_order_relaxed);
+                int tid = site->last_blocker_tid.load(std::memory_order_relaxed);
+                char name[32];
+                threadName(tid, name, sizeof(name));
+
+                if (blocker == NO_SITE)
+                    count_char += snprintf(buffer + count_char, buffer_size - count_char, " blocked_by=untracked");
+                else
+                    count_char += snprintf(buffer + count_char, buffer_size - count_char, " blocked_by=%s:%d (tid %d %s)",
+                                           lock_sites[blocker].file, lock_sites[blocker].line, tid, name);
+            }
+
+            if (count_char < buffer_size)
+                count_char += snprintf(buffer + count_char, buffer_size - count_char, "\n");
+        }
+    }
+
+    if (count_char >= buffer_size) count_char = buffer_size - 1;
+    return count_char;
+}
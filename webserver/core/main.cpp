@@ -35,6 +35,11 @@
 
 #define OPLC_CYCLE          50000000
 
+//Overrun policies for the scan loop
+#define OVERRUN_CATCH_UP    0   //run missed cycles back to back
+#define OVERRUN_SKIP        1   //skip missed cycles, realign to the period grid
+#define OVERRUN_DRIFT       2   //restart the period from the end of the overrun cycle
+
 extern int opterr;
 //extern int common_ticktime__;
 IEC_BOOL __DEBUG;
@@ -48,6 +53,9 @@ uint8_t run_openplc = 1; //Variable to control OpenPLC Runtime execution
 unsigned char log_buffer[1000000]; //A very large buffer to store all logs
 int log_index = 0;
 int log_counter = 0;
+int overrun_policy = OVERRUN_SKIP;
+unsigned int overrun_watchdog = 0; //consecutive overruns before outputs are disabled (0 = off)
+std::atomic<bool> watchdog_tripped(false); //set by the scan thread, reset by the interactive server
 
 //-----------------------------------------------------------------------------
 // Helper function - Makes the running thread sleep for the ammount of time
@@ -64,6 +72,64 @@ void sleep_until(struct timespec *ts, int delay)
     clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts,  NULL);
 }
 
+//-----------------------------------------------------------------------------
+// Schedules the start of the next scan cycle according to the overrun policy
+// and sleeps until then. ts holds the scheduled start of the cycle that just
+// finished. Returns true if that cycle overran its period
+//-----------------------------------------------------------------------------
+bool waitNextCycle(struct timespec *ts, unsigned long long period)
+{
+    unsigned long long now = getTimeNs();
+    unsigned long long next = (unsigned long long)ts->tv_sec * 1000000000ULL + ts->tv_nsec + period;
+    bool overrun = (now > next);
+
+    if (overrun)
+    {
+        if (overrun_policy == OVERRUN_SKIP)
+        {
+            //jump to the first period boundary that is still in the future
+            next += ((now - next) / period + 1) * period;
+        }
+        else if (overrun_policy == OVERRUN_DRIFT)
+        {
+            next = now + period;
+        }
+    }
+
+    ts->tv_sec = next / 1000000000ULL;
+    ts->tv_nsec = next % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL);
+
+    return overrun;
+}
+
+//-----------------------------------------------------------------------------
+// Reads the scan loop settings from runtime.cfg
+//-----------------------------------------------------------------------------
+void configureScanLoop()
+{
+    unsigned char log_msg[1000];
+    char policy[100];
+
+    if (getConfigString("overrun_policy", policy, sizeof(policy)))
+    {
+        if (!strcmp(policy, "catch_up"))
+            overrun_policy = OVERRUN_CATCH_UP;
+        else if (!strcmp(policy, "skip"))
+            overrun_policy = OVERRUN_SKIP;
+        else if (!strcmp(policy, "drift"))
+            overrun_policy = OVERRUN_DRIFT;
+        else
+        {
+            sprintf(log_msg, "Unknown overrun_policy '%s'. Using skip\n", policy);
+            log(log_msg);
+            overrun_policy = OVERRUN_SKIP;
+        }
+    }
+    int watchdog = getConfigInt("overrun_watchdog", 0);
+    overrun_watchdog = (watchdog > 0) ? watchdog : 0;
+}
+
 //-----------------------------------------------------------------------------
 // Helper function - Makes the running thread sleep for the ammount of time
 // in milliseconds
@@ -106,6 +172,7 @@ void log(unsigned char *logmsg)
 //-----------------------------------------------------------------------------
 void *interactiveServerThread(void *arg)
 {
+    configureThread("interactive", -1, 0);
     startInteractiveServer(43628);
 }
 
@@ -128,6 +195,15 @@ bool pinNotPresent(int *ignored_vector, int vector_size, int pinNumber)
 //-----------------------------------------------------------------------------
 void disableOutputs()
 {
+    //With the compact process image every output lives in the image
+    if (compactProcessImage())
+    {
+        memset(compact_bool_output, 0, sizeof(compact_bool_output));
+        memset(compact_byte_output, 0, sizeof(compact_byte_output));
+        memset(compact_int_output, 0, sizeof(compact_int_output));
+        return;
+    }
+
     //Disable digital outputs
     for (int i = 0; i < BUFFER_SIZE; i++)
     {
@@ -177,6 +253,17 @@ void handleSpecialFunctions()
     //comm error counter [%ML1026]
     /* Implemented in modbus_master.cpp */
 
+    //last and max scan time in microseconds [%ML1028, %ML1029]
+    if (special_functions[4] != NULL) *special_functions[4] = getScanStatLast(STAT_SCAN) / 1000;
+    if (special_functions[5] != NULL) *special_functions[5] = getScanStatMax(STAT_SCAN) / 1000;
+
+    //last and max wake-up latency in microseconds [%ML1030, %ML1031]
+    if (special_functions[6] != NULL) *special_functions[6] = getScanStatLast(STAT_WAKE_LATENCY) / 1000;
+    if (special_functions[7] != NULL) *special_functions[7] = getScanStatMax(STAT_WAKE_LATENCY) / 1000;
+
+    //scan cycle overrun counter [%ML1032]
+    if (special_functions[8] != NULL) *special_functions[8] = getOverrunCount();
+
     //insert other special functions below
 }
 
@@ -191,15 +278,22 @@ int main(int argc,char **argv)
     //======================================================
     tzset();
     time(&start_time);
+    parseRuntimeConfig();
+    configureScanLoop();
     pthread_t interactive_thread;
     pthread_create(&interactive_thread, NULL, interactiveServerThread, NULL);
     config_init__();
     glueVars();
+    if (compactProcessImage())
+    {
+        sprintf(log_msg, "Using compact process image\n");
+        log(log_msg);
+    }
 
     //======================================================
     //               MUTEX INITIALIZATION
     //======================================================
-    if (pthread_mutex_init(&bufferLock, NULL) != 0)
+    if (!initPlcMutex(&bufferLock, "bufferLock") || !initPlcMutex(&ioLock, "ioLock"))
     {
         printf("Mutex init failed\n");
         exit(1);
@@ -229,14 +323,10 @@ int main(int argc,char **argv)
     //======================================================
     //              REAL-TIME INITIALIZATION
     //======================================================
-    // Set our thread to real time priority
-    struct sched_param sp;
-    sp.sched_priority = 30;
+    // Set our thread to real time priority, unless runtime.cfg says otherwise
     printf("Setting main thread priority to RT\n");
-    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp))
-    {
-        printf("WARNING: Failed to set main thread to real-time priority\n");
-    }
+    configureThread("scan", SCHED_FIFO, 30);
+    reportCpuIsolation();
 
     // Lock memory to ensure no swapping is done.
     printf("Locking main thread memory\n");
@@ -250,38 +340,68 @@ int main(int argc,char **argv)
 	printf("Getting current time\n");
 	struct timespec timer_start;
 	clock_gettime(CLOCK_MONOTONIC, &timer_start);
+	initScanStats();
+	mapProcessImage();
+	publishProcessImage();
+	bool multitask = startTaskScheduler();
 
 	//======================================================
 	//                    MAIN LOOP
 	//======================================================
 	while(run_openplc)
 	{
+		//measure how late we woke up compared to the scheduled start
+		unsigned long long cycle_start = getTimeNs();
+		unsigned long long scheduled_start = (unsigned long long)timer_start.tv_sec * 1000000000ULL + timer_start.tv_nsec;
+		recordScanStat(STAT_WAKE_LATENCY, cycle_start > scheduled_start ? cycle_start - scheduled_start : 0);
+
 		//make sure the buffer pointers are correct and
-		//attached to the user variables
-		glueVars();
+		//attached to the user variables. With the multitask
+		//scheduler they point to the task images instead
+		if (!multitask) glueVars();
         
 		updateBuffersIn(); //read input image
 
-		pthread_mutex_lock(&bufferLock); //lock mutex
+		PLC_LOCK(&bufferLock); //lock mutex
+		applyImageWrites(); //apply the protocol writes received during the last cycle
 		updateCustomIn();
         updateBuffersIn_MB(); //update input image table with data from slave devices
         handleSpecialFunctions();
-		config_run__(__tick++); // execute plc program logic
+		unsigned long long program_start = getTimeNs();
+		recordScanStat(STAT_INPUT, program_start - cycle_start);
+		if (multitask)
+			runBackgroundTasks(__tick++); // periodic tasks run on their own threads. Releases the lock while the programs run
+		else
+			config_run__(__tick++); // execute plc program logic
+		unsigned long long program_end = getTimeNs();
+		recordScanStat(STAT_PROGRAM, program_end - program_start);
+		if (watchdog_tripped) disableOutputs(); //keep outputs off until the watchdog is reset
 		updateCustomOut();
         updateBuffersOut_MB(); //update slave devices with data from the output image table
-		pthread_mutex_unlock(&bufferLock); //unlock mutex
+		publishProcessImage(); //make this cycle's values visible to the protocols
+		PLC_UNLOCK(&bufferLock); //unlock mutex
 
 		updateBuffersOut(); //write output image
+		unsigned long long cycle_end = getTimeNs();
+		recordScanStat(STAT_OUTPUT, cycle_end - program_end);
+		recordScanStat(STAT_SCAN, cycle_end - cycle_start);
         
 		updateTime();
 
-		sleep_until(&timer_start, common_ticktime__);
+		unsigned long long consecutive_overruns = recordOverrun(waitNextCycle(&timer_start, common_ticktime__));
+		if (overrun_watchdog > 0 && consecutive_overruns >= overrun_watchdog && !watchdog_tripped)
+		{
+			sprintf(log_msg, "Scan cycle overran %llu times in a row. Watchdog is disabling all outputs\n", consecutive_overruns);
+			log(log_msg);
+			watchdog_tripped = true;
+		}
 	}
     
     //======================================================
 	//             SHUTTING DOWN OPENPLC RUNTIME
 	//======================================================
     pthread_join(interactive_thread, NULL);
+    stopTaskScheduler();
     printf("Disabling outputs\n");
     disableOutputs();
     updateCustomOut();
@@ -26,14 +26,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <pthread.h>
 
 #include "ladder.h"
 
-#define MAX_DISCRETE_INPUT              8192
-#define MAX_COILS                       8192
+//Coils, discrete inputs and input registers follow the size of the OpenPLC
+//buffers, up to the 16-bit Modbus address space. The holding register map
+//below is fixed
+#define MAX_MB_ADDRESSES                65536
+#define MAX_DISCRETE_INPUT              (BUFFER_SIZE * 8 < MAX_MB_ADDRESSES ? BUFFER_SIZE * 8 : MAX_MB_ADDRESSES)
+#define MAX_COILS                       (BUFFER_SIZE * 8 < MAX_MB_ADDRESSES ? BUFFER_SIZE * 8 : MAX_MB_ADDRESSES)
 #define MAX_HOLD_REGS                   8192
-#define MAX_INP_REGS                    1024
+#define MAX_INP_REGS                    (BUFFER_SIZE < MAX_MB_ADDRESSES ? BUFFER_SIZE : MAX_MB_ADDRESSES)
+
+//Unused positions are only backed by Modbus buffers in the classic address
+//range, so large programs don't pay for addresses they don't use
+#define MAX_UNUSED_BITS                 8192
+#define MAX_UNUSED_REGS                 1024
 
 #define MIN_16B_RANGE                   1024
 #define MAX_16B_RANGE                   2047
@@ -41,6 +51,8 @@
 #define MAX_32B_RANGE                   4095
 #define MIN_64B_RANGE                   4096
 #define MAX_64B_RANGE                   8191
+#define MAX_WRITE_REGISTERS             123
+#define MAX_READ_REGISTERS              125
 
 #define MB_FC_NONE                      0
 #define MB_FC_READ_COILS                1
@@ -51,6 +63,9 @@
 #define MB_FC_WRITE_REGISTER            6
 #define MB_FC_WRITE_MULTIPLE_COILS      15
 #define MB_FC_WRITE_MULTIPLE_REGISTERS  16
+#define MB_FC_MASK_WRITE_REGISTER       22
+#define MB_FC_READ_WRITE_REGISTERS      23
+#define MB_FC_ENCAPSULATED_INTERFACE    43
 #define MB_FC_ERROR                     255
 
 #define ERR_NONE                        0
@@ -60,6 +75,12 @@
 #define ERR_SLAVE_DEVICE_FAILURE        4
 #define ERR_SLAVE_DEVICE_BUSY           6
 
+#define MB_MEI_READ_DEVICE_ID           14
+#define MB_DEVICE_ID_BASIC              1
+#define MB_DEVICE_ID_REGULAR            2
+#define MB_DEVICE_ID_EXTENDED           3
+#define MB_DEVICE_ID_SPECIFIC           4
+
 
 #define bitRead(value, bit) (((value) >> (bit)) & 0x01)
 #define bitSet(value, bit) ((value) |= (1UL << (bit)))
@@ -69,12 +90,38 @@
 #define lowByte(w) ((unsigned char) ((w) & 0xff))
 #define highByte(w) ((unsigned char) ((w) >> 8))
 
-IEC_BOOL mb_discrete_input[MAX_DISCRETE_INPUT];
-IEC_BOOL mb_coils[MAX_COILS];
-IEC_UINT mb_input_regs[MAX_INP_REGS];
+IEC_BOOL mb_discrete_input[MAX_UNUSED_BITS];
+IEC_BOOL mb_coils[MAX_UNUSED_BITS];
+IEC_UINT mb_input_regs[MAX_UNUSED_REGS];
 IEC_UINT mb_holding_regs[MAX_HOLD_REGS];
 
-int MessageLength;
+__thread int MessageLength; //per thread, as the TCP server and the RTU slave run at once
+
+//Objects returned by Read Device Identification. 0 to 2 are the basic ones,
+//3 to 5 the regular ones
+const char *mb_device_id[] = {"OpenPLC Project", "OpenPLC Runtime", "v3",
+	"http://www.openplcproject.com", "OpenPLC Runtime", "OpenPLC v3"};
+#define MB_DEVICE_ID_OBJECTS            6
+#define MB_DEVICE_ID_LAST_BASIC         2
+
+//Encoded data of the last register reads. Pollers asking for the same block
+//as another poller within the same scan cycle get a copy of its response.
+//Entries are stamped with the generation of the snapshot they were read from
+//and go stale as soon as the next one is published
+#define READ_CACHE_SIZE                 16
+
+struct read_cache_entry
+{
+	bool valid;
+	uint8_t function;
+	uint16_t start;
+	uint16_t length;
+	uint64_t generation;
+	unsigned char data[MAX_READ_REGISTERS * 2];
+};
+
+struct read_cache_entry read_cache[READ_CACHE_SIZE];
+pthread_mutex_t readCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
 
 
@@ -91,25 +138,28 @@ int word(unsigned char byte1, unsigned char byte2)
 
 //-----------------------------------------------------------------------------
 // This function sets the internal NULL OpenPLC buffers to point to valid
-// positions on the Modbus buffer
+// positions on the Modbus buffer. With the compact process image they point
+// to their own slot in the image instead
 //-----------------------------------------------------------------------------
 void mapUnusedIO()
 {
-	pthread_mutex_lock(&bufferLock);
+	bool compact = compactProcessImage();
 
-	for(int i = 0; i < MAX_DISCRETE_INPUT; i++)
+	PLC_LOCK(&bufferLock);
+
+	for(int i = 0; i < MAX_UNUSED_BITS; i++)
 	{
-		if (bool_input[i/8][i%8] == NULL) bool_input[i/8][i%8] = &mb_discrete_input[i];
+		if (bool_input[i/8][i%8] == NULL) bool_input[i/8][i%8] = compact ? &compact_bool_input[i/8][i%8] : &mb_discrete_input[i];
 	}
 
-	for(int i = 0; i < MAX_COILS; i++)
+	for(int i = 0; i < MAX_UNUSED_BITS; i++)
 	{
-		if (bool_output[i/8][i%8] == NULL) bool_output[i/8][i%8] = &mb_coils[i];
+		if (bool_output[i/8][i%8] == NULL) bool_output[i/8][i%8] = compact ? &compact_bool_output[i/8][i%8] : &mb_coils[i];
 	}
 
-	for (int i = 0; i < MAX_INP_REGS; i++)
+	for (int i = 0; i < MAX_UNUSED_REGS; i++)
 	{
-		if (int_input[i] == NULL) int_input[i] = &mb_input_regs[i];
+		if (int_input[i] == NULL) int_input[i] = compact ? &compact_int_input[i] : &mb_input_regs[i];
 	}
 
 	for (int i = 0; i <= MAX_16B_RANGE; i++)
@@ -118,7 +168,7 @@ void mapUnusedIO()
         {
             if (int_output[i] == NULL)
             {
-                int_output[i] = &mb_holding_regs[i];
+                int_output[i] = compact ? &compact_int_output[i] : &mb_holding_regs[i];
             }
         }
 
@@ -126,12 +176,70 @@ void mapUnusedIO()
         {
 			if (int_memory[i - MIN_16B_RANGE] == NULL)
             {
-                int_memory[i - MIN_16B_RANGE] = &mb_holding_regs[i];
+                int_memory[i - MIN_16B_RANGE] = compact ? &compact_int_memory[i - MIN_16B_RANGE] : &mb_holding_regs[i];
             }
         }
 	}
 
-	pthread_mutex_unlock(&bufferLock);
+	mapProcessImage();
+	PLC_UNLOCK(&bufferLock);
+}
+
+//-----------------------------------------------------------------------------
+// Copies the data of a register read of snapshot generation from the cache.
+// Returns false if it isn't there, or if another thread is using the cache
+//-----------------------------------------------------------------------------
+bool getCachedRead(uint8_t function, int start, int length, uint64_t generation, unsigned char *data)
+{
+	struct read_cache_entry *entry = &read_cache[(start * 31 + length * 7 + function) % READ_CACHE_SIZE];
+	bool hit = false;
+
+	if (length > MAX_READ_REGISTERS || pthread_mutex_trylock(&readCacheLock) != 0)
+		return false;
+
+	if (entry->valid && entry->generation == generation && entry->function == function &&
+		entry->start == start && entry->length == length)
+	{
+		memcpy(data, entry->data, length * 2);
+		hit = true;
+	}
+
+	pthread_mutex_unlock(&readCacheLock);
+	return hit;
+}
+
+//-----------------------------------------------------------------------------
+// Stores the data of a register read of snapshot generation in the cache
+//-----------------------------------------------------------------------------
+void cacheRead(uint8_t function, int start, int length, uint64_t generation, const unsigned char *data)
+{
+	struct read_cache_entry *entry = &read_cache[(start * 31 + length * 7 + function) % READ_CACHE_SIZE];
+
+	if (length > MAX_READ_REGISTERS || pthread_mutex_trylock(&readCacheLock) != 0)
+		return;
+
+	entry->valid = true;
+	entry->function = function;
+	entry->start = start;
+	entry->length = length;
+	entry->generation = generation;
+	memcpy(entry->data, data, length * 2);
+
+	pthread_mutex_unlock(&readCacheLock);
+}
+
+//-----------------------------------------------------------------------------
+// Drops every cached read. Needed when registers that are not part of the
+// snapshot are written
+//-----------------------------------------------------------------------------
+void invalidateReadCache()
+{
+	pthread_mutex_lock(&readCacheLock);
+	for (int i = 0; i < READ_CACHE_SIZE; i++)
+	{
+		read_cache[i].valid = false;
+	}
+	pthread_mutex_unlock(&readCacheLock);
 }
 
 //-----------------------------------------------------------------------------
@@ -173,35 +281,23 @@ void ReadCoils(unsigned char *buffer, int bufferSize)
 		return;
 	}
 
+	//asked for coils past the end of the buffer
+	if (Start + CoilDataLength > MAX_COILS)
+	{
+		mb_error = ERR_ILLEGAL_DATA_ADDRESS;
+	}
+
 	//preparing response
 	buffer[4] = highByte(ByteDataLength + 3);
 	buffer[5] = lowByte(ByteDataLength + 3); //Number of bytes after this one
 	buffer[8] = ByteDataLength;     //Number of bytes of data
 
-	pthread_mutex_lock(&bufferLock);
-	for(int i = 0; i < ByteDataLength ; i++)
+	struct image_read read;
+	do
 	{
-		for(int j = 0; j < 8; j++)
-		{
-			int position = Start + i * 8 + j;
-			if (position < MAX_COILS)
-			{
-				if (bool_output[position/8][position%8] != NULL)
-				{
-					bitWrite(buffer[9 + i], j, *bool_output[position/8][position%8]);
-				}
-				else
-				{
-					bitWrite(buffer[9 + i], j, 0);
-				}
-			}
-			else //invalid address
-			{
-				mb_error = ERR_ILLEGAL_DATA_ADDRESS;
-			}
-		}
-	}
-	pthread_mutex_unlock(&bufferLock);
+		const struct process_image *image = beginImageRead(&read);
+		readImageBitRange(&buffer[9], image->bool_output, Start, CoilDataLength);
+	} while (!endImageRead(&read));
 
 	if (mb_error != ERR_NONE)
 	{
@@ -240,35 +336,23 @@ void ReadDiscreteInputs(unsigned char *buffer, int bufferSize)
 		return;
 	}
 
+	//asked for inputs past the end of the buffer
+	if (Start + InputDataLength > MAX_DISCRETE_INPUT)
+	{
+		mb_error = ERR_ILLEGAL_DATA_ADDRESS;
+	}
+
 	//Preparing response
 	buffer[4] = highByte(ByteDataLength + 3);
 	buffer[5] = lowByte(ByteDataLength + 3); //Number of bytes after this one
 	buffer[8] = ByteDataLength;     //Number of bytes of data
 
-	pthread_mutex_lock(&bufferLock);
-	for(int i = 0; i < ByteDataLength ; i++)
+	struct image_read read;
+	do
 	{
-		for(int j = 0; j < 8; j++)
-		{
-			int position = Start + i * 8 + j;
-			if (position < MAX_DISCRETE_INPUT)
-			{
-				if (bool_input[position/8][position%8] != NULL)
-				{
-					bitWrite(buffer[9 + i], j, *bool_input[position/8][position%8]);
-				}
-				else
-				{
-					bitWrite(buffer[9 + i], j, 0);
-				}
-			}
-			else //invalid address
-			{
-				mb_error = ERR_ILLEGAL_DATA_ADDRESS;
-			}
-		}
-	}
-	pthread_mutex_unlock(&bufferLock);
+		const struct process_image *image = beginImageRead(&read);
+		readImageBitRange(&buffer[9], image->bool_input, Start, InputDataLength);
+	} while (!endImageRead(&read));
 
 	if (mb_error != ERR_NONE)
 	{
@@ -280,6 +364,64 @@ void ReadDiscreteInputs(unsigned char *buffer, int bufferSize)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Reads one holding register from the process image. Words of 32 and 64-bit
+// memory are read most significant first. Returns false for an invalid
+// address
+//-----------------------------------------------------------------------------
+bool readHoldingRegister(const struct process_image *image, int position, uint16_t *value)
+{
+	*value = 0;
+
+	if (position < MIN_16B_RANGE)
+	{
+		*value = image->int_output[position];
+	}
+	//accessing memory
+	//16-bit registers
+	else if (position >= MIN_16B_RANGE && position <= MAX_16B_RANGE)
+	{
+		*value = image->int_memory[position - MIN_16B_RANGE];
+	}
+	//32-bit registers
+	else if (position >= MIN_32B_RANGE && position <= MAX_32B_RANGE)
+	{
+		if (dint_memory[(position - MIN_32B_RANGE)/2] != NULL)
+		{
+			uint32_t dintValue = image->dint_memory[(position - MIN_32B_RANGE)/2];
+			if ((position - MIN_32B_RANGE) % 2 == 0) //first word
+				*value = (uint16_t)(dintValue >> 16);
+			else //second word
+				*value = (uint16_t)(dintValue & 0xffff);
+		}
+		else
+		{
+			*value = mb_holding_regs[position];
+		}
+	}
+	//64-bit registers
+	else if (position >= MIN_64B_RANGE && position <= MAX_64B_RANGE)
+	{
+		if (lint_memory[(position - MIN_64B_RANGE)/4] != NULL)
+		{
+			uint64_t lintValue = image->lint_memory[(position - MIN_64B_RANGE)/4];
+			int shift = (3 - (position - MIN_64B_RANGE) % 4) * 16; //first word is the most significant
+			*value = (uint16_t)((lintValue >> shift) & 0xffff);
+		}
+		else
+		{
+			*value = mb_holding_regs[position];
+		}
+	}
+	//invalid address
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of Modbus/TCP Read Holding Registers
 //-----------------------------------------------------------------------------
@@ -299,10 +441,10 @@ void ReadHoldingRegisters(unsigned char *buffer, int bufferSize)
 	WordDataLength = word(buffer[10],buffer[11]);
 	ByteDataLength = WordDataLength * 2;
 
-	//asked for too many registers
-	if (ByteDataLength > 255)
+	//a read is 1 to 125 registers
+	if (WordDataLength < 1 || WordDataLength > MAX_READ_REGISTERS)
 	{
-		ModbusError(buffer, ERR_ILLEGAL_DATA_ADDRESS);
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
 		return;
 	}
 
@@ -311,105 +453,27 @@ void ReadHoldingRegisters(unsigned char *buffer, int bufferSize)
 	buffer[5] = lowByte(ByteDataLength + 3); //Number of bytes after this one
 	buffer[8] = ByteDataLength;     //Number of bytes of data
 
-	pthread_mutex_lock(&bufferLock);
-	for(int i = 0; i < WordDataLength; i++)
+	struct image_read read;
+	uint64_t generation;
+	do
 	{
-		int position = Start + i;
-		if (position <= MIN_16B_RANGE)
-		{
-			if (int_output[position] != NULL)
-			{
-				buffer[ 9 + i * 2] = highByte(*int_output[position]);
-				buffer[10 + i * 2] = lowByte(*int_output[position]);
-			}
-			else
-			{
-				buffer[ 9 + i * 2] = 0;
-				buffer[10 + i * 2] = 0;
-			}
-		}
-		//accessing memory
-		//16-bit registers
-		else if (position >= MIN_16B_RANGE && position <= MAX_16B_RANGE)
-		{
-			if (int_memory[position - MIN_16B_RANGE] != NULL)
-			{
-				buffer[ 9 + i * 2] = highByte(*int_memory[position - MIN_16B_RANGE]);
-				buffer[10 + i * 2] = lowByte(*int_memory[position - MIN_16B_RANGE]);
-			}
-			else
-			{
-				buffer[ 9 + i * 2] = 0;
-				buffer[10 + i * 2] = 0;
-			}
-		}
-		//32-bit registers
-		else if (position >= MIN_32B_RANGE && position <= MAX_32B_RANGE)
-		{
-			if (dint_memory[(position - MIN_32B_RANGE)/2] != NULL)
-			{
-				if ((position - MIN_32B_RANGE) % 2 == 0) //first word
-				{
-					uint16_t tempValue = (uint16_t)(*dint_memory[(position - MIN_32B_RANGE)/2] >> 16);
-					buffer[ 9 + i * 2] = highByte(tempValue);
-					buffer[10 + i * 2] = lowByte(tempValue);
-				}
-				else //second word
-				{
-					uint16_t tempValue = (uint16_t)(*dint_memory[(position - MIN_32B_RANGE)/2] & 0xffff);
-					buffer[ 9 + i * 2] = highByte(tempValue);
-					buffer[10 + i * 2] = lowByte(tempValue);
-				}
-			}
-			else
-			{
-				buffer[ 9 + i * 2] = mb_holding_regs[position];
-				buffer[10 + i * 2] = mb_holding_regs[position];
-			}
-		}
-		//64-bit registers
-		else if (position >= MIN_64B_RANGE && position <= MAX_64B_RANGE)
+		const struct process_image *image = beginImageRead(&read);
+		generation = image->generation;
+		if (getCachedRead(MB_FC_READ_HOLDING_REGISTERS, Start, WordDataLength, generation, &buffer[9]))
+			continue;
+
+		for(int i = 0; i < WordDataLength; i++)
 		{
-			if (lint_memory[(position - MIN_64B_RANGE)/4] != NULL)
-			{
-				if ((position - MIN_64B_RANGE) % 4 == 0) //first word
-				{
-					uint16_t tempValue = (uint16_t)(*lint_memory[(position - MIN_64B_RANGE)/4] >> 48);
-					buffer[ 9 + i * 2] = highByte(tempValue);
-					buffer[10 + i * 2] = lowByte(tempValue);
-				}
-				else if ((position - MIN_64B_RANGE) % 4 == 1)//second word
-				{
-					uint16_t tempValue = (uint16_t)((*lint_memory[(position - MIN_64B_RANGE)/4] >> 32) & 0xffff);
-					buffer[ 9 + i * 2] = highByte(tempValue);
-					buffer[10 + i * 2] = lowByte(tempValue);
-				}
-				else if ((position - MIN_64B_RANGE) % 4 == 2)//third word
-				{
-					uint16_t tempValue = (uint16_t)((*lint_memory[(position - MIN_64B_RANGE)/4] >> 16) & 0xffff);
-					buffer[ 9 + i * 2] = highByte(tempValue);
-					buffer[10 + i * 2] = lowByte(tempValue);
-				}
-				else if ((position - MIN_64B_RANGE) % 4 == 3)//fourth word
-				{
-					uint16_t tempValue = (uint16_t)(*lint_memory[(position - MIN_64B_RANGE)/4] & 0xffff);
-					buffer[ 9 + i * 2] = highByte(tempValue);
-					buffer[10 + i * 2] = lowByte(tempValue);
-				}
-			}
-			else
+			uint16_t tempValue;
+			if (!readHoldingRegister(image, Start + i, &tempValue))
 			{
-				buffer[ 9 + i * 2] = mb_holding_regs[position];
-				buffer[10 + i * 2] = mb_holding_regs[position];
+				mb_error = ERR_ILLEGAL_DATA_ADDRESS;
 			}
+
+			buffer[ 9 + i * 2] = highByte(tempValue);
+			buffer[10 + i * 2] = lowByte(tempValue);
 		}
-		//invalid address
-		else
-		{
-			mb_error = ERR_ILLEGAL_DATA_ADDRESS;
-		}
-	}
-	pthread_mutex_unlock(&bufferLock);
+	} while (!endImageRead(&read));
 
 	if (mb_error != ERR_NONE)
 	{
@@ -417,6 +481,7 @@ void ReadHoldingRegisters(unsigned char *buffer, int bufferSize)
 	}
 	else
 	{
+		cacheRead(MB_FC_READ_HOLDING_REGISTERS, Start, WordDataLength, generation, &buffer[9]);
 		MessageLength = ByteDataLength + 9;
 	}
 }
@@ -440,10 +505,10 @@ void ReadInputRegisters(unsigned char *buffer, int bufferSize)
 	WordDataLength = word(buffer[10],buffer[11]);
 	ByteDataLength = WordDataLength * 2;
 
-	//asked for too many registers
-	if (ByteDataLength > 255)
+	//a read is 1 to 125 registers
+	if (WordDataLength < 1 || WordDataLength > MAX_READ_REGISTERS)
 	{
-		ModbusError(buffer, ERR_ILLEGAL_DATA_ADDRESS);
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
 		return;
 	}
 
@@ -452,29 +517,29 @@ void ReadInputRegisters(unsigned char *buffer, int bufferSize)
 	buffer[5] = lowByte(ByteDataLength + 3); //Number of bytes after this one
 	buffer[8] = ByteDataLength;     //Number of bytes of data
 
-	pthread_mutex_lock(&bufferLock);
-	for(int i = 0; i < WordDataLength; i++)
+	struct image_read read;
+	uint64_t generation;
+	do
 	{
-		int position = Start + i;
-		if (position < MAX_INP_REGS)
+		const struct process_image *image = beginImageRead(&read);
+		generation = image->generation;
+		if (getCachedRead(MB_FC_READ_INPUT_REGISTERS, Start, WordDataLength, generation, &buffer[9]))
+			continue;
+
+		for(int i = 0; i < WordDataLength; i++)
 		{
-			if (int_input[position] != NULL)
+			int position = Start + i;
+			if (position < MAX_INP_REGS)
 			{
-				buffer[ 9 + i * 2] = highByte(*int_input[position]);
-				buffer[10 + i * 2] = lowByte(*int_input[position]);
+				buffer[ 9 + i * 2] = highByte(image->int_input[position]);
+				buffer[10 + i * 2] = lowByte(image->int_input[position]);
 			}
-			else
+			else //invalid address
 			{
-				buffer[ 9 + i * 2] = 0;
-				buffer[10 + i * 2] = 0;
+				mb_error = ERR_ILLEGAL_DATA_ADDRESS;
 			}
 		}
-		else //invalid address
-		{
-			mb_error = ERR_ILLEGAL_DATA_ADDRESS;
-		}
-	}
-	pthread_mutex_unlock(&bufferLock);
+	} while (!endImageRead(&read));
 
 	if (mb_error != ERR_NONE)
 	{
@@ -482,10 +547,105 @@ void ReadInputRegisters(unsigned char *buffer, int bufferSize)
 	}
 	else
 	{
+		cacheRead(MB_FC_READ_INPUT_REGISTERS, Start, WordDataLength, generation, &buffer[9]);
 		MessageLength = ByteDataLength + 9;
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Writes to the 32 and 64-bit registers that have no variable located at
+// them go straight to mb_holding_regs, outside the process image. They are
+// held here until the batch they belong to is accepted by endImageWrite()
+//-----------------------------------------------------------------------------
+struct held_writes
+{
+	int count;
+	uint16_t position[MAX_WRITE_REGISTERS];
+	uint16_t value[MAX_WRITE_REGISTERS];
+	uint16_t mask[MAX_WRITE_REGISTERS];
+};
+
+static void holdRegister(struct held_writes *held, int position, uint16_t value, uint16_t mask)
+{
+	if (held->count >= MAX_WRITE_REGISTERS)
+		return;
+
+	held->position[held->count] = position;
+	held->value[held->count] = value;
+	held->mask[held->count] = mask;
+	held->count++;
+}
+
+//-----------------------------------------------------------------------------
+// Applies the held writes of a batch that was accepted
+//-----------------------------------------------------------------------------
+static void applyHeldRegisters(struct held_writes *held)
+{
+	if (held->count == 0)
+		return;
+
+	for (int i = 0; i < held->count; i++)
+	{
+		int position = held->position[i];
+		mb_holding_regs[position] = (mb_holding_regs[position] & ~held->mask[i]) | (held->value[i] & held->mask[i]);
+	}
+	invalidateReadCache();
+}
+
+//-----------------------------------------------------------------------------
+// Queues the write of one holding register. Only the bits set in mask are
+// changed. Writes to 32 and 64-bit memory only change the word addressed by
+// position. Returns false for an invalid address. Must be called between
+// beginImageWrite() and endImageWrite(), and held must be applied with
+// applyHeldRegisters() only if endImageWrite() succeeds
+//-----------------------------------------------------------------------------
+bool queueHoldingRegister(struct held_writes *held, int position, uint16_t value, uint16_t mask = 0xffff)
+{
+	//analog outputs
+	if (position < MIN_16B_RANGE)
+	{
+		queueImageWrite(IMAGE_INT_OUTPUT, position, value, mask);
+	}
+	//accessing memory
+	//16-bit registers
+	else if (position >= MIN_16B_RANGE && position <= MAX_16B_RANGE)
+	{
+		queueImageWrite(IMAGE_INT_MEMORY, position - MIN_16B_RANGE, value, mask);
+	}
+	//32-bit registers
+	else if (position >= MIN_32B_RANGE && position <= MAX_32B_RANGE)
+	{
+		if (dint_memory[(position - MIN_32B_RANGE)/2] != NULL)
+		{
+			int shift = (1 - (position - MIN_32B_RANGE) % 2) * 16; //first word is the most significant
+			queueImageWrite(IMAGE_DINT_MEMORY, (position - MIN_32B_RANGE)/2, (uint64_t)(value & mask) << shift, (uint64_t)mask << shift);
+		}
+		else
+		{
+			holdRegister(held, position, value, mask);
+		}
+	}
+	//64-bit registers
+	else if (position >= MIN_64B_RANGE && position <= MAX_64B_RANGE)
+	{
+		if (lint_memory[(position - MIN_64B_RANGE)/4] != NULL)
+		{
+			int shift = (3 - (position - MIN_64B_RANGE) % 4) * 16; //first word is the most significant
+			queueImageWrite(IMAGE_LINT_MEMORY, (position - MIN_64B_RANGE)/4, (uint64_t)(value & mask) << shift, (uint64_t)mask << shift);
+		}
+		else
+		{
+			holdRegister(held, position, value, mask);
+		}
+	}
+	else //invalid address
+	{
+		return false;
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of Modbus/TCP Write Coil
 //-----------------------------------------------------------------------------
@@ -515,12 +675,9 @@ void WriteCoil(unsigned char *buffer, int bufferSize)
 			value = 0;
 		}
 
-		pthread_mutex_lock(&bufferLock);
-		if (bool_output[Start/8][Start%8] != NULL)
-		{
-			*bool_output[Start/8][Start%8] = value;
-		}
-		pthread_mutex_unlock(&bufferLock);
+		beginImageWrite();
+		queueImageWrite(IMAGE_BOOL_OUTPUT, Start/8, value << (Start%8), 1 << (Start%8));
+		if (!endImageWrite()) mb_error = ERR_SLAVE_DEVICE_BUSY;
 	}
 
 	else //invalid address
@@ -557,85 +714,21 @@ void WriteRegister(unsigned char *buffer, int bufferSize)
 
 	Start = word(buffer[8],buffer[9]);
 
-	pthread_mutex_lock(&bufferLock);
-	//analog outputs
-	if (Start <= MIN_16B_RANGE)
-	{
-		if (int_output[Start] != NULL)
-		{
-			*int_output[Start] = word(buffer[10],buffer[11]);
-		}
-	}
-	//accessing memory
-	//16-bit registers
-	else if (Start >= MIN_16B_RANGE && Start <= MAX_16B_RANGE)
-	{
-		if (int_memory[Start - MIN_16B_RANGE] != NULL)
-		{
-			*int_memory[Start - MIN_16B_RANGE] = word(buffer[10],buffer[11]);
-		}
-	}
-	//32-bit registers
-	else if (Start >= MIN_32B_RANGE && Start <= MAX_32B_RANGE)
+	struct held_writes held;
+	held.count = 0;
+	beginImageWrite();
+	if (!queueHoldingRegister(&held, Start, word(buffer[10],buffer[11])))
 	{
-		if (dint_memory[(Start - MIN_32B_RANGE)/2] != NULL)
-		{
-			uint32_t tempValue = (uint32_t)word(buffer[10],buffer[11]);
-
-			if ((Start - MIN_32B_RANGE) % 2 == 0) //first word
-			{
-				*dint_memory[(Start - MIN_32B_RANGE) / 2] = *dint_memory[(Start - MIN_32B_RANGE) / 2] & 0x0000ffff;
-				*dint_memory[(Start - MIN_32B_RANGE) / 2] = *dint_memory[(Start - MIN_32B_RANGE) / 2] | (tempValue << 16);
-			}
-			else //second word
-			{
-				*dint_memory[(Start - MIN_32B_RANGE) / 2] = *dint_memory[(Start - MIN_32B_RANGE) / 2] & 0xffff0000;
-				*dint_memory[(Start - MIN_32B_RANGE) / 2] = *dint_memory[(Start - MIN_32B_RANGE) / 2] | tempValue;
-			}
-		}
-		else
-		{
-			mb_holding_regs[Start] = word(buffer[10],buffer[11]);
-		}
+		mb_error = ERR_ILLEGAL_DATA_ADDRESS;
 	}
-	//64-bit registers
-	else if (Start >= MIN_64B_RANGE && Start <= MAX_64B_RANGE)
+	if (endImageWrite())
 	{
-		if (lint_memory[(Start - MIN_64B_RANGE)/4] != NULL)
-		{
-			uint64_t tempValue = (uint64_t)word(buffer[10],buffer[11]);
-
-			if ((Start - MIN_64B_RANGE) % 4 == 0) //first word
-			{
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] & 0x0000ffffffffffff;
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] | (tempValue << 48);
-			}
-			else if ((Start - MIN_64B_RANGE) % 4 == 1) //second word
-			{
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] & 0xffff0000ffffffff;
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] | (tempValue << 32);
-			}
-			else if ((Start - MIN_64B_RANGE) % 4 == 2) //third word
-			{
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] & 0xffffffff0000ffff;
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] | (tempValue << 16);
-			}
-			else if ((Start - MIN_64B_RANGE) % 4 == 3) //fourth word
-			{
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] & 0xffffffffffff0000;
-				*lint_memory[(Start - MIN_64B_RANGE) / 4] = *lint_memory[(Start - MIN_64B_RANGE) / 4] | tempValue;
-			}
-		}
-		else
-		{
-			mb_holding_regs[Start] = word(buffer[10],buffer[11]);
-		}
+		applyHeldRegisters(&held);
 	}
-	else //invalid address
+	else if (mb_error == ERR_NONE)
 	{
-		mb_error = ERR_ILLEGAL_DATA_ADDRESS;
+		mb_error = ERR_SLAVE_DEVICE_BUSY;
 	}
-	pthread_mutex_unlock(&bufferLock);
 
 	if (mb_error != ERR_NONE)
 	{
@@ -676,27 +769,23 @@ void WriteMultipleCoils(unsigned char *buffer, int bufferSize)
 		return;
 	}
 
+	//writing coils past the end of the buffer
+	if (Start + CoilDataLength > MAX_COILS)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_ADDRESS);
+		return;
+	}
+
 	//preparing response
 	buffer[4] = 0;
 	buffer[5] = 6; //Number of bytes after this one.
 
-	pthread_mutex_lock(&bufferLock);
-	for(int i = 0; i < ByteDataLength ; i++)
+	beginImageWrite();
+	queueImageBits(&buffer[13], Start, CoilDataLength);
+	if (!endImageWrite())
 	{
-		for(int j = 0; j < 8; j++)
-		{
-			int position = Start + i * 8 + j;
-			if (position < MAX_COILS)
-			{
-				if (bool_output[position/8][position%8] != NULL) *bool_output[position/8][position%8] = bitRead(buffer[13 + i], j);
-			}
-			else //invalid address
-			{
-				mb_error = ERR_ILLEGAL_DATA_ADDRESS;
-			}
-		}
+		mb_error = ERR_SLAVE_DEVICE_BUSY;
 	}
-	pthread_mutex_unlock(&bufferLock);
 
 	if (mb_error != ERR_NONE)
 	{
@@ -727,8 +816,10 @@ void WriteMultipleRegisters(unsigned char *buffer, int bufferSize)
 	WordDataLength = word(buffer[10],buffer[11]);
 	ByteDataLength = WordDataLength * 2;
 
-	//this request must have all the bytes it wants to write. If it doesn't, it's a corrupted message
-	if ( (bufferSize < (13 + ByteDataLength)) || (buffer[12] != ByteDataLength) )
+	//a write is 1 to 123 registers, and the request must have all the bytes
+	//it wants to write. If it doesn't, it's a corrupted message
+	if ( WordDataLength < 1 || WordDataLength > MAX_WRITE_REGISTERS ||
+		(bufferSize < (13 + ByteDataLength)) || (buffer[12] != ByteDataLength) )
 	{
 		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
 		return;
@@ -738,83 +829,24 @@ void WriteMultipleRegisters(unsigned char *buffer, int bufferSize)
 	buffer[4] = 0;
 	buffer[5] = 6; //Number of bytes after this one.
 
-	pthread_mutex_lock(&bufferLock);
+	struct held_writes held;
+	held.count = 0;
+	beginImageWrite();
 	for(int i = 0; i < WordDataLength; i++)
 	{
-		int position = Start + i;
-		//analog outputs
-		if (position <= MIN_16B_RANGE)
-		{
-			if (int_output[position] != NULL) *int_output[position] =  word(buffer[13 + i * 2], buffer[14 + i * 2]);
-		}
-		//accessing memory
-		//16-bit registers
-		else if (position >= MIN_16B_RANGE && position <= MAX_16B_RANGE)
-		{
-			if (int_memory[position - MIN_16B_RANGE] != NULL) *int_memory[position - MIN_16B_RANGE] = word(buffer[13 + i * 2], buffer[14 + i * 2]);
-		}
-		//32-bit registers
-		else if (position >= MIN_32B_RANGE && position <= MAX_32B_RANGE)
-		{
-			if (dint_memory[(Start - MIN_32B_RANGE)/2] != NULL)
-			{
-				uint32_t tempValue = (uint32_t)word(buffer[13 + i * 2], buffer[14 + i * 2]);
-
-				if ((position - MIN_32B_RANGE) % 2 == 0) //first word
-				{
-					*dint_memory[(position - MIN_32B_RANGE) / 2] = *dint_memory[(position - MIN_32B_RANGE) / 2] & 0x0000ffff;
-					*dint_memory[(position - MIN_32B_RANGE) / 2] = *dint_memory[(position - MIN_32B_RANGE) / 2] | (tempValue << 16);
-				}
-				else //second word
-				{
-					*dint_memory[(position - MIN_32B_RANGE) / 2] = *dint_memory[(position - MIN_32B_RANGE) / 2] & 0xffff0000;
-					*dint_memory[(position - MIN_32B_RANGE) / 2] = *dint_memory[(position - MIN_32B_RANGE) / 2] | tempValue;
-				}
-			}
-			else
-			{
-				mb_holding_regs[position] = word(buffer[13 + i * 2], buffer[14 + i * 2]);
-			}
-		}
-		//64-bit registers
-		else if (position >= MIN_64B_RANGE && position <= MAX_64B_RANGE)
-		{
-			if (lint_memory[(position - MIN_64B_RANGE)/4] != NULL)
-			{
-				uint64_t tempValue = (uint64_t)word(buffer[13 + i * 2], buffer[14 + i * 2]);
-
-				if ((position - MIN_64B_RANGE) % 4 == 0) //first word
-				{
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] & 0x0000ffffffffffff;
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] | (tempValue << 48);
-				}
-				else if ((Start - MIN_64B_RANGE) % 4 == 1) //second word
-				{
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] & 0xffff0000ffffffff;
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] | (tempValue << 32);
-				}
-				else if ((Start - MIN_64B_RANGE) % 4 == 2) //third word
-				{
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] & 0xffffffff0000ffff;
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] | (tempValue << 16);
-				}
-				else if ((Start - MIN_64B_RANGE) % 4 == 3) //fourth word
-				{
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] & 0xffffffffffff0000;
-					*lint_memory[(position - MIN_64B_RANGE) / 4] = *lint_memory[(position - MIN_64B_RANGE) / 4] | tempValue;
-				}
-			}
-			else
-			{
-				mb_holding_regs[Start] = word(buffer[10],buffer[11]);
-			}
-		}
-		else //invalid address
+		if (!queueHoldingRegister(&held, Start + i, word(buffer[13 + i * 2], buffer[14 + i * 2])))
 		{
 			mb_error = ERR_ILLEGAL_DATA_ADDRESS;
 		}
 	}
-	pthread_mutex_unlock(&bufferLock);
+	if (endImageWrite())
+	{
+		applyHeldRegisters(&held);
+	}
+	else if (mb_error == ERR_NONE)
+	{
+		mb_error = ERR_SLAVE_DEVICE_BUSY;
+	}
 
 	if (mb_error != ERR_NONE)
 	{
@@ -826,6 +858,256 @@ void WriteMultipleRegisters(unsigned char *buffer, int bufferSize)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Implementation of Modbus/TCP Mask Write Register. The register becomes
+// (current AND and_mask) OR (or_mask AND NOT and_mask). The bits are changed
+// by the scan thread against the current value, so concurrent writers to
+// other bits of the same register don't overwrite each other
+//-----------------------------------------------------------------------------
+void MaskWriteRegister(unsigned char *buffer, int bufferSize)
+{
+	int mb_error = ERR_NONE;
+
+	//this request must have 14 bytes. If it doesn't, it's a corrupted message
+	if (bufferSize < 14)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
+		return;
+	}
+
+	int Start = word(buffer[8], buffer[9]);
+	uint16_t andMask = word(buffer[10], buffer[11]);
+	uint16_t orMask = word(buffer[12], buffer[13]);
+
+	struct held_writes held;
+	held.count = 0;
+	beginImageWrite();
+	if (!queueHoldingRegister(&held, Start, orMask, ~andMask))
+	{
+		mb_error = ERR_ILLEGAL_DATA_ADDRESS;
+	}
+	if (endImageWrite())
+	{
+		applyHeldRegisters(&held);
+	}
+	else if (mb_error == ERR_NONE)
+	{
+		mb_error = ERR_SLAVE_DEVICE_BUSY;
+	}
+
+	if (mb_error != ERR_NONE)
+	{
+		ModbusError(buffer, mb_error);
+	}
+	else
+	{
+		//the response echoes the request
+		buffer[4] = 0;
+		buffer[5] = 8; //Number of bytes after this one.
+		MessageLength = 14;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of Modbus/TCP Read/Write Multiple Registers. The write is
+// queued as one batch and the read is taken from a single snapshot, with the
+// registers just written read back as written
+//-----------------------------------------------------------------------------
+void ReadWriteRegisters(unsigned char *buffer, int bufferSize)
+{
+	int mb_error = ERR_NONE;
+
+	//this request must have at least 17 bytes. If it doesn't, it's a corrupted message
+	if (bufferSize < 17)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
+		return;
+	}
+
+	int ReadStart = word(buffer[8], buffer[9]);
+	int ReadLength = word(buffer[10], buffer[11]);
+	int WriteStart = word(buffer[12], buffer[13]);
+	int WriteLength = word(buffer[14], buffer[15]);
+	int ByteDataLength = ReadLength * 2;
+
+	//asked for too many registers, or the request doesn't have all the bytes
+	//it wants to write
+	if (ReadLength < 1 || ReadLength > MAX_READ_REGISTERS || WriteLength < 1 || WriteLength > 121 ||
+		buffer[16] != WriteLength * 2 || bufferSize < 17 + WriteLength * 2)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
+		return;
+	}
+
+	//nothing is written if any of the addresses is invalid
+	if (ReadStart + ReadLength > MAX_HOLD_REGS || WriteStart + WriteLength > MAX_HOLD_REGS)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_ADDRESS);
+		return;
+	}
+
+	//the write is done first
+	uint16_t values[121];
+	struct held_writes held;
+	held.count = 0;
+	beginImageWrite();
+	for (int i = 0; i < WriteLength; i++)
+	{
+		values[i] = word(buffer[17 + i * 2], buffer[18 + i * 2]);
+		queueHoldingRegister(&held, WriteStart + i, values[i]);
+	}
+	if (!endImageWrite())
+	{
+		ModbusError(buffer, ERR_SLAVE_DEVICE_BUSY);
+		return;
+	}
+	applyHeldRegisters(&held);
+
+	//preparing response
+	buffer[4] = highByte(ByteDataLength + 3);
+	buffer[5] = lowByte(ByteDataLength + 3); //Number of bytes after this one
+	buffer[8] = ByteDataLength;     //Number of bytes of data
+
+	struct image_read read;
+	do
+	{
+		const struct process_image *image = beginImageRead(&read);
+		for (int i = 0; i < ReadLength; i++)
+		{
+			int position = ReadStart + i;
+			uint16_t tempValue;
+
+			if (position >= WriteStart && position < WriteStart + WriteLength)
+				tempValue = values[position - WriteStart];
+			else if (!readHoldingRegister(image, position, &tempValue))
+				mb_error = ERR_ILLEGAL_DATA_ADDRESS;
+
+			buffer[ 9 + i * 2] = highByte(tempValue);
+			buffer[10 + i * 2] = lowByte(tempValue);
+		}
+	} while (!endImageRead(&read));
+
+	if (mb_error != ERR_NONE)
+	{
+		ModbusError(buffer, mb_error);
+	}
+	else
+	{
+		MessageLength = ByteDataLength + 9;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Implementation of Modbus/TCP Read Device Identification (function 43, MEI
+// type 14). All the objects fit in a single response, so stream access never
+// has more to follow
+//-----------------------------------------------------------------------------
+void ReadDeviceIdentification(unsigned char *buffer, int bufferSize)
+{
+	//this request must have 11 bytes. If it doesn't, it's a corrupted message
+	if (bufferSize < 11)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
+		return;
+	}
+
+	if (buffer[8] != MB_MEI_READ_DEVICE_ID)
+	{
+		ModbusError(buffer, ERR_ILLEGAL_FUNCTION);
+		return;
+	}
+
+	int code = buffer[9];
+	int object = buffer[10];
+	int first, last;
+
+	if (code == MB_DEVICE_ID_SPECIFIC)
+	{
+		//individual access
+		if (object >= MB_DEVICE_ID_OBJECTS)
+		{
+			ModbusError(buffer, ERR_ILLEGAL_DATA_ADDRESS);
+			return;
+		}
+		first = object;
+		last = object;
+	}
+	else if (code >= MB_DEVICE_ID_BASIC && code <= MB_DEVICE_ID_EXTENDED)
+	{
+		//stream access restarts from the first object for unknown ids
+		last = (code == MB_DEVICE_ID_BASIC) ? MB_DEVICE_ID_LAST_BASIC : MB_DEVICE_ID_OBJECTS - 1;
+		first = (object <= last) ? object : 0;
+	}
+	else
+	{
+		ModbusError(buffer, ERR_ILLEGAL_DATA_VALUE);
+		return;
+	}
+
+	//preparing response
+	buffer[10] = 0x82;              //conformity level: regular, individual access
+	buffer[11] = 0;                 //no more objects follow
+	buffer[12] = 0;                 //next object id
+	buffer[13] = last - first + 1;  //number of objects
+
+	int length = 14;
+	for (int i = first; i <= last; i++)
+	{
+		int size = strlen(mb_device_id[i]);
+		buffer[length++] = i;
+		buffer[length++] = size;
+		memcpy(&buffer[length], mb_device_id[i], size);
+		length += size;
+	}
+
+	buffer[4] = highByte(length - 6);
+	buffer[5] = lowByte(length - 6); //Number of bytes after this one
+	MessageLength = length;
+}
+
+//-----------------------------------------------------------------------------
+// Builds the message that Modbus/UDP publishes every scan cycle: a Write
+// Multiple Registers request to unit 0 with count holding registers from
+// start, read from the latest snapshot. The transaction id is the sequence
+// number. Returns the message size, or 0 if the block is invalid
+//-----------------------------------------------------------------------------
+int buildRegisterPublish(unsigned char *buffer, int start, int count, uint16_t sequence)
+{
+	if (count < 1 || count > 123)
+		return 0;
+
+	buffer[0] = highByte(sequence);
+	buffer[1] = lowByte(sequence);
+	buffer[2] = 0;
+	buffer[3] = 0;
+	buffer[4] = highByte(count * 2 + 7);
+	buffer[5] = lowByte(count * 2 + 7);
+	buffer[6] = 0;
+	buffer[7] = MB_FC_WRITE_MULTIPLE_REGISTERS;
+	buffer[8] = highByte(start);
+	buffer[9] = lowByte(start);
+	buffer[10] = highByte(count);
+	buffer[11] = lowByte(count);
+	buffer[12] = count * 2;
+
+	struct image_read read;
+	do
+	{
+		const struct process_image *image = beginImageRead(&read);
+		for (int i = 0; i < count; i++)
+		{
+			uint16_t value;
+			if (!readHoldingRegister(image, start + i, &value))
+				return 0;
+
+			buffer[13 + i * 2] = highByte(value);
+			buffer[14 + i * 2] = lowByte(value);
+		}
+	} while (!endImageRead(&read));
+
+	return 13 + count * 2;
+}
+
 //-----------------------------------------------------------------------------
 // This function must parse and process the client request and write back the
 // response for it. The return value is the size of the response message in
@@ -889,6 +1171,24 @@ int processModbusMessage(unsigned char *buffer, int bufferSize)
 		WriteMultipleRegisters(buffer, bufferSize);
 	}
 
+	//****************** Mask Write Register ******************
+	else if(buffer[7] == MB_FC_MASK_WRITE_REGISTER)
+	{
+		MaskWriteRegister(buffer, bufferSize);
+	}
+
+	//*********** Read/Write Multiple Registers ***************
+	else if(buffer[7] == MB_FC_READ_WRITE_REGISTERS)
+	{
+		ReadWriteRegisters(buffer, bufferSize);
+	}
+
+	//************ Read Device Identification *****************
+	else if(buffer[7] == MB_FC_ENCAPSULATED_INTERFACE)
+	{
+		ReadDeviceIdentification(buffer, bufferSize);
+	}
+
 	//****************** Function Code Error ******************
 	else
 	{
@@ -32,16 +32,46 @@
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
+#include <limits.h>
 
 #include <iostream>
 #include <fstream>
 #include <string>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+//TCP devices are polled by one event loop that pipelines their requests
+#define ASYNC_TCP_MASTER
+#endif
+
 #include "ladder.h"
 
 #define MB_TCP                1
 #define MB_RTU                2
 #define MAX_MB_IO            400
+#define MAX_GATEWAY_PORTS    16
+#define MAX_GATEWAY_QUEUE    64
+#define NUM_BLOCKS           5      //register blocks of a device
+
+//cost model of the request planner, in microseconds
+#define RTU_REQUEST_OVERHEAD 20     //characters of framing and silence per request
+#define TCP_REQUEST_COST     1000.0 //round trip of a request on a LAN
+#define TCP_BYTE_COST        0.1
+
+#define TCP_MAX_ADU          264    //MBAP header and the largest PDU, rounded up
+#define WHEEL_SLOTS          256
+#define WHEEL_TICK_NS        10000000ULL
+
+#define ERR_ILLEGAL_FUNCTION            1
+#define ERR_GATEWAY_PATH_UNAVAILABLE    10
+#define ERR_GATEWAY_TARGET_FAILED       11
 
 using namespace std;
 
@@ -52,10 +82,37 @@ uint16_t int_output_buf[MAX_MB_IO];
 
 pthread_mutex_t ioLock;
 
+//A range of points of a register block, and where its first point goes in
+//the exchange buffers
+struct MB_range
+{
+    uint16_t start_address;
+    uint16_t num_regs;
+    uint16_t index;
+};
+
 struct MB_address
 {
+    uint16_t start_address;
+    uint16_t num_regs;              //points in the exchange buffers
+    uint16_t period;                //ms, 0 to use the period of the device
+    uint16_t phase;                 //ms, added to the phase of the device
+    unsigned long long next_poll;   //monotonic deadline in ns
+    struct MB_range *ranges;        //from <Block>_Ranges, or start and size
+    int num_ranges;
+};
+
+//One request of the polling plan of a device. It covers one or more ranges
+//of a block, and the points between them when reading those is cheaper
+//than another request
+struct MB_request
+{
+    int block;
+    uint8_t function;
     uint16_t start_address;
     uint16_t num_regs;
+    struct MB_range *ranges;        //sorted by address
+    int num_ranges;
 };
 
 struct MB_device
@@ -70,14 +127,30 @@ struct MB_device
     int rtu_data_bit;
     int rtu_stop_bit;
     int rtu_tx_pause;
+    unsigned long long frame_gap;   //ns of silence before each request, RTU only
     uint8_t dev_id;
     bool isConnected;
+    int worker;                     //polling worker of the device
+    uint16_t period;                //ms, 0 to use Polling_Period
+    uint16_t phase;                 //ms after the start of each period
+
+    //first position of each block in the exchange buffers
+    uint16_t bool_input_index;
+    uint16_t bool_output_index;
+    uint16_t int_input_index;
+    uint16_t int_output_index;
 
     struct MB_address discrete_inputs;
     struct MB_address coils;
     struct MB_address input_registers;
     struct MB_address holding_read_registers;
     struct MB_address holding_registers;
+
+    //polling plan
+    struct MB_request *requests;
+    int num_requests;
+    struct MB_range *plan_ranges;   //ranges split to the size of a request
+    uint8_t transfer[MODBUS_MAX_ADU_LENGTH];    //requests and responses
 };
 
 struct MB_device *mb_devices;
@@ -85,6 +158,38 @@ uint8_t num_devices;
 uint16_t polling_period = 100;
 uint16_t timeout = 1000;
 
+//Gateway: Modbus/TCP requests to the slave id of an RTU device are queued on
+//the serial port of the device and sent by the master thread between polls
+struct gateway_port
+{
+    modbus_t *mb_ctx;
+    int device;                     //first device on the port
+    struct gateway_request *queue;  //oldest request first
+    struct gateway_request *last;
+    int queued;
+    struct gateway_request *active; //request on the bus
+};
+
+struct gateway_port gateway_ports[MAX_GATEWAY_PORTS];
+int num_gateway_ports = 0;
+int8_t gateway_route[256];          //port + 1 for each unit id, 0 if local
+pthread_mutex_t gatewayLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t gatewayCond = PTHREAD_COND_INITIALIZER;
+
+//Each TCP device is polled by its own worker, and the RTU devices by one
+//worker per serial port, so a device that times out only delays the devices
+//that share its bus
+struct mb_worker
+{
+    modbus_t *mb_ctx;               //bus of the worker
+    struct gateway_port *port;      //forwarded requests for the bus, or NULL
+    unsigned long long last_frame;  //end of the last transaction on the bus
+};
+
+struct mb_worker *mb_workers;
+int num_workers = 0;
+int num_tcp_clients = 0;
+
 //-----------------------------------------------------------------------------
 // Finds the data between the separators on the line provided
 //-----------------------------------------------------------------------------
@@ -149,6 +254,47 @@ void getFunction(char *line, char *parameter)
     }
 }
 
+//-----------------------------------------------------------------------------
+// Parses a list of addresses and address ranges, such as "0-9, 20, 100-149",
+// into the ranges of a block. Its points are mapped to the exchange buffers
+// in the order of the list
+//-----------------------------------------------------------------------------
+void parseRanges(char *list, struct MB_address *block)
+{
+    free(block->ranges);
+    block->ranges = NULL;
+    block->num_ranges = 0;
+
+    char *p = list;
+    while (*p != '\0')
+    {
+        if (*p < '0' || *p > '9')
+        {
+            p++;
+            continue;
+        }
+
+        long first = strtol(p, &p, 10);
+        long last = first;
+        while (*p == ' ') p++;
+        if (*p == '-')
+            last = strtol(p + 1, &p, 10);
+
+        if (last < first || last > 65535)
+        {
+            unsigned char log_msg[1000];
+            sprintf(log_msg, "Ignoring invalid range %ld-%ld in mbconfig.cfg\n", first, last);
+            log(log_msg);
+            continue;
+        }
+
+        block->ranges = (struct MB_range *)realloc(block->ranges, (block->num_ranges + 1) * sizeof(struct MB_range));
+        block->ranges[block->num_ranges].start_address = first;
+        block->ranges[block->num_ranges].num_regs = last - first + 1;
+        block->num_ranges++;
+    }
+}
+
 void parseConfig()
 {
     string line;
@@ -249,6 +395,18 @@ void parseConfig()
                         getData(line_str, temp_buffer, '"', '"');
                         mb_devices[deviceNumber].rtu_tx_pause = atoi(temp_buffer);
                     }
+                    else if (!strncmp(functionType, "Polling_Period", 14))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].period = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Polling_Phase", 13))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].phase = atoi(temp_buffer);
+                    }
                     else if (!strncmp(functionType, "Discrete_Inputs_Start", 21))
                     {
                         char temp_buffer[10];
@@ -261,6 +419,24 @@ void parseConfig()
                         getData(line_str, temp_buffer, '"', '"');
                         mb_devices[deviceNumber].discrete_inputs.num_regs = atoi(temp_buffer);
                     }
+                    else if (!strncmp(functionType, "Discrete_Inputs_Period", 22))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].discrete_inputs.period = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Discrete_Inputs_Phase", 21))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].discrete_inputs.phase = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Discrete_Inputs_Ranges", 22))
+                    {
+                        char temp_buffer[1024];
+                        getData(line_str, temp_buffer, '"', '"');
+                        parseRanges(temp_buffer, &mb_devices[deviceNumber].discrete_inputs);
+                    }
                     else if (!strncmp(functionType, "Coils_Start", 11))
                     {
                         char temp_buffer[10];
@@ -273,6 +449,24 @@ void parseConfig()
                         getData(line_str, temp_buffer, '"', '"');
                         mb_devices[deviceNumber].coils.num_regs = atoi(temp_buffer);
                     }
+                    else if (!strncmp(functionType, "Coils_Period", 12))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].coils.period = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Coils_Phase", 11))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].coils.phase = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Coils_Ranges", 12))
+                    {
+                        char temp_buffer[1024];
+                        getData(line_str, temp_buffer, '"', '"');
+                        parseRanges(temp_buffer, &mb_devices[deviceNumber].coils);
+                    }
                     else if (!strncmp(functionType, "Input_Registers_Start", 21))
                     {
                         char temp_buffer[10];
@@ -285,6 +479,24 @@ void parseConfig()
                         getData(line_str, temp_buffer, '"', '"');
                         mb_devices[deviceNumber].input_registers.num_regs = atoi(temp_buffer);
                     }
+                    else if (!strncmp(functionType, "Input_Registers_Period", 22))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].input_registers.period = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Input_Registers_Phase", 21))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].input_registers.phase = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Input_Registers_Ranges", 22))
+                    {
+                        char temp_buffer[1024];
+                        getData(line_str, temp_buffer, '"', '"');
+                        parseRanges(temp_buffer, &mb_devices[deviceNumber].input_registers);
+                    }
                     else if (!strncmp(functionType, "Holding_Registers_Read_Start", 28))
                     {
                         char temp_buffer[10];
@@ -297,6 +509,24 @@ void parseConfig()
                         getData(line_str, temp_buffer, '"', '"');
                         mb_devices[deviceNumber].holding_read_registers.num_regs = atoi(temp_buffer);
                     }
+                    else if (!strncmp(functionType, "Holding_Registers_Read_Period", 29))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].holding_read_registers.period = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Holding_Registers_Read_Phase", 28))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].holding_read_registers.phase = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Holding_Registers_Read_Ranges", 29))
+                    {
+                        char temp_buffer[1024];
+                        getData(line_str, temp_buffer, '"', '"');
+                        parseRanges(temp_buffer, &mb_devices[deviceNumber].holding_read_registers);
+                    }
                     else if (!strncmp(functionType, "Holding_Registers_Start", 23))
                     {
                         char temp_buffer[10];
@@ -309,6 +539,24 @@ void parseConfig()
                         getData(line_str, temp_buffer, '"', '"');
                         mb_devices[deviceNumber].holding_registers.num_regs = atoi(temp_buffer);
                     }
+                    else if (!strncmp(functionType, "Holding_Registers_Period", 24))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].holding_registers.period = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Holding_Registers_Phase", 23))
+                    {
+                        char temp_buffer[10];
+                        getData(line_str, temp_buffer, '"', '"');
+                        mb_devices[deviceNumber].holding_registers.phase = atoi(temp_buffer);
+                    }
+                    else if (!strncmp(functionType, "Holding_Registers_Ranges", 24))
+                    {
+                        char temp_buffer[1024];
+                        getData(line_str, temp_buffer, '"', '"');
+                        parseRanges(temp_buffer, &mb_devices[deviceNumber].holding_registers);
+                    }
                 }
             }
         }
@@ -333,6 +581,8 @@ void parseConfig()
         printf("Parity: %c\n", mb_devices[i].rtu_parity);
         printf("Data Bits: %d\n", mb_devices[i].rtu_data_bit);
         printf("Stop Bits: %d\n", mb_devices[i].rtu_stop_bit);
+        printf("Polling Period: %d\n", mb_devices[i].period);
+        printf("Polling Phase: %d\n", mb_devices[i].phase);
         printf("DI Start: %d\n", mb_devices[i].discrete_inputs.start_address);
         printf("DI Size: %d\n", mb_devices[i].discrete_inputs.num_regs);
         printf("Coils Start: %d\n", mb_devices[i].coils.start_address);
@@ -348,326 +598,1509 @@ void parseConfig()
 
 
 //-----------------------------------------------------------------------------
-// Thread to poll each slave device
+// Returns true if requests to unit_id are forwarded by the gateway
 //-----------------------------------------------------------------------------
-void *querySlaveDevices(void *arg)
+bool isGatewayUnit(uint8_t unit_id)
 {
-    while (run_openplc)
+    return gateway_route[unit_id] != 0;
+}
+
+//-----------------------------------------------------------------------------
+// Queues a Modbus/TCP request on the serial port of its unit id. Returns
+// false if the unit isn't routed or the port already has too many requests
+// waiting. The request must stay valid until complete() is called
+//-----------------------------------------------------------------------------
+bool forwardModbusRequest(struct gateway_request *request)
+{
+    int route = gateway_route[request->adu[6]];
+    if (route == 0)
+        return false;
+
+    pthread_mutex_lock(&gatewayLock);
+    struct gateway_port *port = &gateway_ports[route - 1];
+    if (port->queued >= MAX_GATEWAY_QUEUE)
     {
-        unsigned char log_msg[1000];
-        
-        uint16_t bool_input_index = 0;
-        uint16_t bool_output_index = 0;
-        uint16_t int_input_index = 0;
-        uint16_t int_output_index = 0;
+        pthread_mutex_unlock(&gatewayLock);
+        return false;
+    }
 
-        for (int i = 0; i < num_devices; i++)
+    request->next = NULL;
+    if (port->queue == NULL)
+        port->queue = request;
+    else
+        port->last->next = request;
+    port->last = request;
+    port->queued++;
+    pthread_cond_broadcast(&gatewayCond);
+    pthread_mutex_unlock(&gatewayLock);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Drops the queued requests with this completion function and waits for the
+// ones already on the bus. Used by the server before it frees its buffers
+//-----------------------------------------------------------------------------
+void cancelModbusRequests(void (*complete)(struct gateway_request *request))
+{
+    pthread_mutex_lock(&gatewayLock);
+    for (int i = 0; i < num_gateway_ports; i++)
+    {
+        struct gateway_port *port = &gateway_ports[i];
+        struct gateway_request **link = &port->queue;
+        port->last = NULL;
+        while (*link != NULL)
         {
-            //Check if there is a connected RTU device using the same port
-            bool found_sharing = false;
-            bool rtu_port_connected = false;
-            if (mb_devices[i].protocol == MB_RTU)
+            if ((*link)->complete == complete)
             {
-                for (int a = 0; a < num_devices; a++)
-                {
-                    if (a != i && !strcmp(mb_devices[i].dev_address, mb_devices[a].dev_address))
-                    {
-                        found_sharing = true;
-                        if (mb_devices[a].isConnected)
-                        {
-                            rtu_port_connected = true;
-                        }
-                    }
-                }
-                if (found_sharing)
-                {
-                    //Must reset mb context to current device's slave id
-                    modbus_set_slave(mb_devices[i].mb_ctx, mb_devices[i].dev_id);
-                }
+                *link = (*link)->next;
+                port->queued--;
             }
-
-            //Verify if device is connected
-            if (!mb_devices[i].isConnected && !rtu_port_connected)
+            else
             {
-                sprintf(log_msg, "Device %s is disconnected. Attempting to reconnect...\n", mb_devices[i].dev_name);
-                log(log_msg);
-                if (modbus_connect(mb_devices[i].mb_ctx) == -1)
-                {
-
-                    sprintf(log_msg, "Connection failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
-                    log(log_msg);
-                    
-                    if (special_functions[2] != NULL) *special_functions[2]++;
-                    
-                    // Because this device is not connected, we skip those input registers
-                    bool_input_index += (mb_devices[i].discrete_inputs.num_regs);
-                    int_input_index += (mb_devices[i].input_registers.num_regs);
-                    int_input_index += (mb_devices[i].holding_read_registers.num_regs);
-                    bool_output_index += (mb_devices[i].coils.num_regs);
-                    int_output_index += (mb_devices[i].holding_registers.num_regs);
-                }
-                else
-                {
-                    sprintf(log_msg, "Connected to MB device %s\n", mb_devices[i].dev_name);
-                    log(log_msg);
-                    mb_devices[i].isConnected = true;
-                }
+                port->last = *link;
+                link = &(*link)->next;
             }
-            if (mb_devices[i].isConnected || rtu_port_connected)
-            {
+        }
 
-                struct timespec ts;
-                ts.tv_sec = 0;
-                ts.tv_nsec = (1000*1000*1000*28)/mb_devices[i].rtu_baud;
+        while (port->active != NULL && port->active->complete == complete)
+            pthread_cond_wait(&gatewayCond, &gatewayLock);
+    }
+    pthread_mutex_unlock(&gatewayLock);
+}
 
-                //Read discrete inputs
-                if (mb_devices[i].discrete_inputs.num_regs != 0)
-                {
-                    sleepms(mb_devices[i].rtu_tx_pause);
-                    uint8_t *tempBuff;
-                    tempBuff = (uint8_t *)malloc(mb_devices[i].discrete_inputs.num_regs);
-                    nanosleep(&ts, NULL); 
-                    int return_val = modbus_read_input_bits(mb_devices[i].mb_ctx, mb_devices[i].discrete_inputs.start_address,
-                                                            mb_devices[i].discrete_inputs.num_regs, tempBuff);
-                    if (return_val == -1)
-                    {
-                        if (mb_devices[i].protocol != MB_RTU)
-                        {
-                            modbus_close(mb_devices[i].mb_ctx);
-                            mb_devices[i].isConnected = false;
-                        }
-                        
-                        sprintf(log_msg, "Modbus Read Discrete Input Registers failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
-                        log(log_msg);
-                        bool_input_index += (mb_devices[i].discrete_inputs.num_regs);
-                        if (special_functions[2] != NULL) *special_functions[2]++;
-                    }
-                    else
-                    {
-                        pthread_mutex_lock(&ioLock);
-                        for (int j = 0; j < return_val; j++)
-                        {
-                            bool_input_buf[bool_input_index] = tempBuff[j];
-                            bool_input_index++;
-                        }
-                        pthread_mutex_unlock(&ioLock);
-                    }
-
-                    free(tempBuff);
-                }
+//-----------------------------------------------------------------------------
+// Returns the gateway port of a serial context, or NULL if it has none
+//-----------------------------------------------------------------------------
+struct gateway_port *findGatewayPort(modbus_t *mb_ctx)
+{
+    for (int i = 0; i < num_gateway_ports; i++)
+    {
+        if (gateway_ports[i].mb_ctx == mb_ctx) return &gateway_ports[i];
+    }
 
-                //Write coils
-                if (mb_devices[i].coils.num_regs != 0)
-                {
-                    sleepms(mb_devices[i].rtu_tx_pause);
-                    uint8_t *tempBuff;
-                    tempBuff = (uint8_t *)malloc(mb_devices[i].coils.num_regs);
+    return NULL;
+}
 
-                    pthread_mutex_lock(&ioLock);
-                    for (int j = 0; j < mb_devices[i].coils.num_regs; j++)
-                    {
-                        tempBuff[j] = bool_output_buf[bool_output_index];
-                        bool_output_index++;
-                    }
-                    pthread_mutex_unlock(&ioLock);
+//-----------------------------------------------------------------------------
+// Returns true if any device on the port is connected. The devices of a port
+// share the serial context, so the port is open if any of them is
+//-----------------------------------------------------------------------------
+bool portConnected(struct gateway_port *port)
+{
+    for (int i = 0; i < num_devices; i++)
+    {
+        if (mb_devices[i].mb_ctx == port->mb_ctx && mb_devices[i].isConnected) return true;
+    }
 
-                    nanosleep(&ts, NULL); 
-                    int return_val = modbus_write_bits(mb_devices[i].mb_ctx, mb_devices[i].coils.start_address, mb_devices[i].coils.num_regs, tempBuff);
-                    if (return_val == -1)
-                    {
-                        if (mb_devices[i].protocol != MB_RTU)
-                        {
-                            modbus_close(mb_devices[i].mb_ctx);
-                            mb_devices[i].isConnected = false;
-                        }
+    return false;
+}
 
-                        sprintf(log_msg, "Modbus Write Coils failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
-                        log(log_msg);
-                        if (special_functions[2] != NULL) *special_functions[2]++;
-                    }
-                    
-                    free(tempBuff);
-                }
+//-----------------------------------------------------------------------------
+// Opens the serial port if none of its devices has done it yet. A port with
+// devices that are only reached through the gateway has no blocks due, so
+// pollDevice() never connects it. Returns true if the port is open
+//-----------------------------------------------------------------------------
+bool connectPort(struct gateway_port *port)
+{
+    if (portConnected(port))
+        return true;
 
-                //Read input registers
-                if (mb_devices[i].input_registers.num_regs != 0)
-                {
-                    sleepms(mb_devices[i].rtu_tx_pause);
-                    uint16_t *tempBuff;
-                    tempBuff = (uint16_t *)malloc(2*mb_devices[i].input_registers.num_regs);
-                    nanosleep(&ts, NULL); 
-                    int return_val = modbus_read_input_registers(    mb_devices[i].mb_ctx, mb_devices[i].input_registers.start_address,
-                                                                    mb_devices[i].input_registers.num_regs, tempBuff);
-                    if (return_val == -1)
-                    {
-                        if (mb_devices[i].protocol != MB_RTU)
-                        {
-                            modbus_close(mb_devices[i].mb_ctx);
-                            mb_devices[i].isConnected = false;
-                        }
-                        
-                        sprintf(log_msg, "Modbus Read Input Registers failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
-                        log(log_msg);
-                        int_input_index += (mb_devices[i].input_registers.num_regs);
-                        if (special_functions[2] != NULL) *special_functions[2]++;
-                    }
-                    else
-                    {
-                        pthread_mutex_lock(&ioLock);
-                        for (int j = 0; j < return_val; j++)
-                        {
-                            int_input_buf[int_input_index] = tempBuff[j];
-                            int_input_index++;
-                        }
-                        pthread_mutex_unlock(&ioLock);
-                    }
-
-                    free(tempBuff);
-                }
+    unsigned char log_msg[1000];
+    struct MB_device *device = &mb_devices[port->device];
+    if (modbus_connect(port->mb_ctx) == -1)
+    {
+        sprintf(log_msg, "Connection failed on MB device %s: %s\n", device->dev_name, modbus_strerror(errno));
+        log(log_msg);
+        if (special_functions[2] != NULL) (*special_functions[2])++;
+        return false;
+    }
 
-                //Read holding registers
-                if (mb_devices[i].holding_read_registers.num_regs != 0)
-                {
-                    sleepms(mb_devices[i].rtu_tx_pause);
-                    uint16_t *tempBuff;
-                    tempBuff = (uint16_t *)malloc(2*mb_devices[i].holding_read_registers.num_regs);
-                    nanosleep(&ts, NULL); 
-                    int return_val = modbus_read_registers(mb_devices[i].mb_ctx, mb_devices[i].holding_read_registers.start_address,
-                                                           mb_devices[i].holding_read_registers.num_regs, tempBuff);
-                    if (return_val == -1)
-                    {
-                        if (mb_devices[i].protocol != MB_RTU)
-                        {
-                            modbus_close(mb_devices[i].mb_ctx);
-                            mb_devices[i].isConnected = false;
-                        }
-                        sprintf(log_msg, "Modbus Read Holding Registers failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
-                        log(log_msg);
-                        int_input_index += (mb_devices[i].holding_read_registers.num_regs);
-                        if (special_functions[2] != NULL) *special_functions[2]++;
-                    }
-                    else
-                    {
-                        pthread_mutex_lock(&ioLock);
-                        for (int j = 0; j < return_val; j++)
-                        {
-                            int_input_buf[int_input_index] = tempBuff[j];
-                            int_input_index++;
-                        }
-                        pthread_mutex_unlock(&ioLock);
-                    }
-
-                    free(tempBuff);
-                }
+    sprintf(log_msg, "Connected to MB device %s\n", device->dev_name);
+    log(log_msg);
+    device->isConnected = true;
+    return true;
+}
 
-                //Write holding registers
-                if (mb_devices[i].holding_registers.num_regs != 0)
-                {
-                    sleepms(mb_devices[i].rtu_tx_pause);
-                    uint16_t *tempBuff;
-                    tempBuff = (uint16_t *)malloc(2*mb_devices[i].holding_registers.num_regs);
-
-                    pthread_mutex_lock(&ioLock);
-                    for (int j = 0; j < mb_devices[i].holding_registers.num_regs; j++)
-                    {
-                        tempBuff[j] = int_output_buf[int_output_index];
-                        int_output_index++;
-                    }
-                    pthread_mutex_unlock(&ioLock);
-
-                    nanosleep(&ts, NULL); 
-                    int return_val = modbus_write_registers(mb_devices[i].mb_ctx, mb_devices[i].holding_registers.start_address,
-                                                            mb_devices[i].holding_registers.num_regs, tempBuff);
-                    if (return_val == -1)
-                    {
-                        if (mb_devices[i].protocol != MB_RTU)
-                        {
-                            modbus_close(mb_devices[i].mb_ctx);
-                            mb_devices[i].isConnected = false;
-                        }
-                        
-                        sprintf(log_msg, "Modbus Write Holding Registers failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
-                        log(log_msg);
-                        if (special_functions[2] != NULL) *special_functions[2]++;
-                    }
-                    
-                    free(tempBuff);
-                }
-            }
-        }
-        sleepms(polling_period);
+//-----------------------------------------------------------------------------
+// Waits until the bus of device i has been silent for the gap between frames
+// and the TX pause of the device, counted from the end of the last
+// transaction. TCP devices send right away
+//-----------------------------------------------------------------------------
+void waitFrameGap(int i)
+{
+    if (mb_devices[i].frame_gap == 0 || mb_devices[i].worker < 0)
+        return;
+
+    unsigned long long ready = mb_workers[mb_devices[i].worker].last_frame + mb_devices[i].frame_gap;
+    if (getTimeNs() < ready)
+    {
+        struct timespec deadline;
+        deadline.tv_sec = ready / 1000000000ULL;
+        deadline.tv_nsec = ready % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
     }
 }
 
 //-----------------------------------------------------------------------------
-// This function is called by the main OpenPLC routine when it is initializing.
-// Modbus master initialization procedures are here.
+// Marks the end of a transaction on the bus of device i
 //-----------------------------------------------------------------------------
-void initializeMB()
+void endFrame(int i)
 {
-    parseConfig();
+    if (mb_devices[i].frame_gap != 0 && mb_devices[i].worker >= 0)
+        mb_workers[mb_devices[i].worker].last_frame = getTimeNs();
+}
 
-    for (int i = 0; i < num_devices; i++)
+//-----------------------------------------------------------------------------
+// Sends one forwarded request to the serial slave and replaces it with the
+// slave response, or with a gateway exception if the slave didn't answer
+//-----------------------------------------------------------------------------
+void sendGatewayRequest(struct gateway_port *port, struct gateway_request *request)
+{
+    unsigned char *adu = request->adu;
+    uint8_t response[MODBUS_RTU_MAX_ADU_LENGTH];
+    int exception = 0;
+
+    //libmodbus can only find the end of the responses it knows
+    uint8_t function = adu[7];
+    if (function > MODBUS_FC_WRITE_MULTIPLE_REGISTERS && function != MODBUS_FC_REPORT_SLAVE_ID &&
+        function != MODBUS_FC_MASK_WRITE_REGISTER && function != MODBUS_FC_WRITE_AND_READ_REGISTERS)
     {
-        if (mb_devices[i].protocol == MB_TCP)
+        exception = ERR_ILLEGAL_FUNCTION;
+    }
+    else if (!connectPort(port))
+    {
+        exception = ERR_GATEWAY_PATH_UNAVAILABLE;
+    }
+    else
+    {
+        modbus_set_slave(port->mb_ctx, adu[6]);
+
+        //the RTU request is the unit id and the PDU, libmodbus adds the CRC
+        int length = -1;
+        waitFrameGap(port->device);
+        if (modbus_send_raw_request(port->mb_ctx, &adu[6], request->size - 6) != -1)
+            length = modbus_receive_confirmation(port->mb_ctx, response);
+        endFrame(port->device);
+
+        if (length < 4)
         {
-            mb_devices[i].mb_ctx = modbus_new_tcp(mb_devices[i].dev_address, mb_devices[i].ip_port);
+            unsigned char log_msg[1000];
+            sprintf(log_msg, "Gateway request to slave %d failed: %s\n", adu[6], modbus_strerror(errno));
+            log(log_msg);
+            if (special_functions[2] != NULL) (*special_functions[2])++;
+            exception = ERR_GATEWAY_TARGET_FAILED;
         }
-        else if (mb_devices[i].protocol == MB_RTU)
+        else
         {
-            //Check if there is a device using the same port
-            int share_index = -1;
-            for (int a = 0; a < num_devices && a < i; a++)
-            {
-                if (strcmp(mb_devices[i].dev_address, mb_devices[a].dev_address) == 0)
-                {
-                    share_index = a;
-                    break;
-                }
-            }
-            if (share_index != -1)
-            {
-                if (mb_devices[i].rtu_baud != mb_devices[share_index].rtu_baud || mb_devices[i].rtu_parity != mb_devices[share_index].rtu_parity || 
-                    mb_devices[i].rtu_data_bit != mb_devices[share_index].rtu_data_bit || mb_devices[i].rtu_stop_bit != mb_devices[share_index].rtu_stop_bit)
-                {
-                    unsigned char log_msg[1000];
-                    sprintf(log_msg, "Warning MB device %s port setting missmatch\n", mb_devices[i].dev_name);
-                    log(log_msg);
-                }
-                mb_devices[i].mb_ctx = mb_devices[share_index].mb_ctx;
-            }
-            else
-            {
-                mb_devices[i].mb_ctx = modbus_new_rtu(mb_devices[i].dev_address, mb_devices[i].rtu_baud,
-                                                mb_devices[i].rtu_parity, mb_devices[i].rtu_data_bit,
-                                                mb_devices[i].rtu_stop_bit);
-            }
+            //unit id and PDU, without the CRC
+            memcpy(&adu[6], response, length - 2);
+            adu[4] = 0;
+            adu[5] = length - 2;
+            request->size = 6 + length - 2;
         }
-        
-        //slave id
+    }
 
-        modbus_set_slave(mb_devices[i].mb_ctx, mb_devices[i].dev_id);
+    if (exception != 0)
+    {
+        adu[4] = 0;
+        adu[5] = 3;
+        adu[7] |= 0x80;
+        adu[8] = exception;
+        request->size = 9;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Sends the requests waiting on the port of the device, oldest first
+//-----------------------------------------------------------------------------
+void serveGateway(struct gateway_port *port)
+{
+    pthread_mutex_lock(&gatewayLock);
+    while (port->queue != NULL)
+    {
+        struct gateway_request *request = port->queue;
+        port->queue = request->next;
+        port->queued--;
+        port->active = request;
+        pthread_mutex_unlock(&gatewayLock);
 
+        sendGatewayRequest(port, request);
+        request->complete(request);
 
-        //timeout
-        uint32_t to_sec = timeout / 1000;
-        uint32_t to_usec = (timeout % 1000) * 1000;
-        modbus_set_response_timeout(mb_devices[i].mb_ctx, to_sec, to_usec);
-        
+        pthread_mutex_lock(&gatewayLock);
+        port->active = NULL;
+        pthread_cond_broadcast(&gatewayCond);
     }
-    
-    //Initialize comm error counter
-    if (special_functions[2] != NULL) *special_functions[2] = 0;
-    
-    if (num_devices > 0)
-    {
-        pthread_t thread;
-        int ret = pthread_create(&thread, NULL, querySlaveDevices, NULL);
-        if (ret==0) 
+    pthread_mutex_unlock(&gatewayLock);
+}
+
+//-----------------------------------------------------------------------------
+// Returns a register block of the device, in the order they are polled
+//-----------------------------------------------------------------------------
+struct MB_address *deviceBlock(struct MB_device *device, int block)
+{
+    switch (block)
+    {
+        case 0: return &device->discrete_inputs;
+        case 1: return &device->coils;
+        case 2: return &device->input_registers;
+        case 3: return &device->holding_read_registers;
+        default: return &device->holding_registers;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Sets the polling period of each block, inherited from the device and from
+// Polling_Period, and its first deadline after start
+//-----------------------------------------------------------------------------
+void scheduleBlocks(unsigned long long start)
+{
+    for (int i = 0; i < num_devices; i++)
+    {
+        struct MB_device *device = &mb_devices[i];
+        if (device->period == 0)
+            device->period = polling_period;
+
+        for (int b = 0; b < NUM_BLOCKS; b++)
+        {
+            struct MB_address *block = deviceBlock(device, b);
+            if (block->period == 0)
+                block->period = device->period;
+
+            unsigned long long phase = device->phase + block->phase;
+            if (block->period != 0)
+                phase %= block->period;
+            block->next_poll = start + phase * 1000000ULL;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns true if the block is due at now, and moves its deadline to its
+// next period. Periods that were missed are skipped, keeping the deadlines
+// on the grid set by the phase
+//-----------------------------------------------------------------------------
+bool blockDue(struct MB_address *block, unsigned long long now)
+{
+    if (block->num_regs == 0 || block->next_poll > now)
+        return false;
+
+    //a period of 0 polls as often as the bus allows, up to every 1ms
+    unsigned long long period = (block->period > 0) ? block->period * 1000000ULL : 1000000ULL;
+    block->next_poll += period;
+    if (block->next_poll <= now)
+        block->next_poll += ((now - block->next_poll) / period + 1) * period;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the earliest deadline of the blocks of device i
+//-----------------------------------------------------------------------------
+unsigned long long nextDeadline(int i)
+{
+    unsigned long long deadline = ULLONG_MAX;
+    for (int b = 0; b < NUM_BLOCKS; b++)
+    {
+        struct MB_address *block = deviceBlock(&mb_devices[i], b);
+        if (block->num_regs != 0 && block->next_poll < deadline)
+            deadline = block->next_poll;
+    }
+
+    return deadline;
+}
+
+//-----------------------------------------------------------------------------
+// Request planner. The ranges of each block are split into requests no
+// larger than a PDU, and requests close to each other are merged when
+// reading the points between them costs less bus time than a request of its
+// own. Writes are only merged when their ranges are contiguous, since the
+// points between them would be overwritten
+//-----------------------------------------------------------------------------
+
+const uint8_t block_functions[NUM_BLOCKS] = {MODBUS_FC_READ_DISCRETE_INPUTS, MODBUS_FC_WRITE_MULTIPLE_COILS,
+                                             MODBUS_FC_READ_INPUT_REGISTERS, MODBUS_FC_READ_HOLDING_REGISTERS,
+                                             MODBUS_FC_WRITE_MULTIPLE_REGISTERS};
+const char *block_names[NUM_BLOCKS] = {"discrete inputs", "coils", "input registers",
+                                       "holding registers (read)", "holding registers"};
+
+//-----------------------------------------------------------------------------
+// Returns the largest number of points in one request of the function
+//-----------------------------------------------------------------------------
+int maxPoints(uint8_t function)
+{
+    switch (function)
+    {
+        case MODBUS_FC_READ_DISCRETE_INPUTS: return MODBUS_MAX_READ_BITS;
+        case MODBUS_FC_WRITE_MULTIPLE_COILS: return MODBUS_MAX_WRITE_BITS;
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS: return MODBUS_MAX_WRITE_REGISTERS;
+        default: return MODBUS_MAX_READ_REGISTERS;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns the time it takes to move one byte to or from the device
+//-----------------------------------------------------------------------------
+double byteCost(struct MB_device *device)
+{
+    if (device->protocol != MB_RTU)
+        return TCP_BYTE_COST;
+
+    int baud_rate = (device->rtu_baud > 0) ? device->rtu_baud : 9600;
+    int char_bits = 1 + device->rtu_data_bit + (device->rtu_parity != 'N') + device->rtu_stop_bit;
+    return char_bits * 1000000.0 / baud_rate;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the cost of sending one more request to the device: a round trip
+// on TCP, and on a serial line the framing, the silence between frames and
+// the TX pause
+//-----------------------------------------------------------------------------
+double requestCost(struct MB_device *device)
+{
+    if (device->protocol != MB_RTU)
+        return TCP_REQUEST_COST;
+
+    return RTU_REQUEST_OVERHEAD * byteCost(device) + device->rtu_tx_pause * 1000.0;
+}
+
+//-----------------------------------------------------------------------------
+// Returns true if the range can be added to the end of the request
+//-----------------------------------------------------------------------------
+bool canMerge(struct MB_device *device, struct MB_request *request, struct MB_range *range)
+{
+    int end = request->start_address + request->num_regs;
+    int range_end = range->start_address + range->num_regs;
+    if ((range_end > end ? range_end : end) - request->start_address > maxPoints(request->function))
+        return false;
+
+    if (request->function == MODBUS_FC_WRITE_MULTIPLE_COILS || request->function == MODBUS_FC_WRITE_MULTIPLE_REGISTERS)
+        return range->start_address == end;
+    if (range->start_address <= end)
+        return true;
+
+    int gap = range->start_address - end;
+    int gap_bytes = (request->function == MODBUS_FC_READ_DISCRETE_INPUTS) ? (gap + 7) / 8 : gap * 2;
+    return gap_bytes * byteCost(device) < requestCost(device);
+}
+
+//-----------------------------------------------------------------------------
+// Orders ranges by address, and by their place in the exchange buffers
+//-----------------------------------------------------------------------------
+int compareRanges(const void *a, const void *b)
+{
+    const struct MB_range *range_a = (const struct MB_range *)a;
+    const struct MB_range *range_b = (const struct MB_range *)b;
+    if (range_a->start_address != range_b->start_address)
+        return range_a->start_address - range_b->start_address;
+    return range_a->index - range_b->index;
+}
+
+//-----------------------------------------------------------------------------
+// Counts the points of a block and gives each range its offset in the
+// exchange buffers. A block without a list of ranges has a single range
+//-----------------------------------------------------------------------------
+void countPoints(struct MB_address *block)
+{
+    if (block->ranges == NULL)
+    {
+        if (block->num_regs == 0)
+            return;
+        block->ranges = (struct MB_range *)malloc(sizeof(struct MB_range));
+        block->ranges[0].start_address = block->start_address;
+        block->ranges[0].num_regs = block->num_regs;
+        block->num_ranges = 1;
+    }
+
+    block->num_regs = 0;
+    for (int r = 0; r < block->num_ranges; r++)
+    {
+        block->ranges[r].index = block->num_regs;
+        block->num_regs += block->ranges[r].num_regs;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Builds the requests that poll device i, and reports them
+//-----------------------------------------------------------------------------
+void planRequests(int i)
+{
+    unsigned char log_msg[1000];
+    struct MB_device *device = &mb_devices[i];
+    uint16_t first_index[NUM_BLOCKS] = {device->bool_input_index, device->bool_output_index, device->int_input_index,
+                                        (uint16_t)(device->int_input_index + device->input_registers.num_regs),
+                                        device->int_output_index};
+
+    int num_pieces = 0;
+    for (int b = 0; b < NUM_BLOCKS; b++)
+    {
+        struct MB_address *block = deviceBlock(device, b);
+        for (int r = 0; r < block->num_ranges; r++)
+            num_pieces += (block->ranges[r].num_regs + maxPoints(block_functions[b]) - 1) / maxPoints(block_functions[b]);
+    }
+    device->plan_ranges = (struct MB_range *)malloc(num_pieces * sizeof(struct MB_range));
+    device->requests = (struct MB_request *)malloc(num_pieces * sizeof(struct MB_request));
+    device->num_requests = 0;
+
+    int n = 0;
+    for (int b = 0; b < NUM_BLOCKS; b++)
+    {
+        struct MB_address *block = deviceBlock(device, b);
+        int max_points = maxPoints(block_functions[b]);
+        int first = n;
+
+        //split the ranges to the size of a request
+        for (int r = 0; r < block->num_ranges; r++)
+        {
+            for (int offset = 0; offset < block->ranges[r].num_regs; offset += max_points)
+            {
+                struct MB_range *piece = &device->plan_ranges[n];
+                piece->start_address = block->ranges[r].start_address + offset;
+                piece->num_regs = block->ranges[r].num_regs - offset;
+                if (piece->num_regs > max_points)
+                    piece->num_regs = max_points;
+                piece->index = first_index[b] + block->ranges[r].index + offset;
+
+                if (piece->index + piece->num_regs > MAX_MB_IO)
+                {
+                    sprintf(log_msg, "MB device %s: %s past position %d of the exchange buffers are not polled\n", device->dev_name, block_names[b], MAX_MB_IO);
+                    log(log_msg);
+                    break;
+                }
+                n++;
+            }
+        }
+        qsort(&device->plan_ranges[first], n - first, sizeof(struct MB_range), compareRanges);
+
+        //merge the requests in order of address
+        for (int p = first; p < n; p++)
+        {
+            struct MB_request *request = &device->requests[device->num_requests - 1];
+            if (p > first && canMerge(device, request, &device->plan_ranges[p]))
+            {
+                int end = device->plan_ranges[p].start_address + device->plan_ranges[p].num_regs;
+                if (end > request->start_address + request->num_regs)
+                    request->num_regs = end - request->start_address;
+                request->num_ranges++;
+                continue;
+            }
+
+            request = &device->requests[device->num_requests++];
+            request->block = b;
+            request->function = block_functions[b];
+            request->start_address = device->plan_ranges[p].start_address;
+            request->num_regs = device->plan_ranges[p].num_regs;
+            request->ranges = &device->plan_ranges[p];
+            request->num_ranges = 1;
+        }
+    }
+
+    sprintf(log_msg, "Polling plan of MB device %s: %d requests\n", device->dev_name, device->num_requests);
+    log(log_msg);
+    for (int r = 0; r < device->num_requests; r++)
+    {
+        struct MB_request *request = &device->requests[r];
+        int used = 0;
+        for (int j = 0; j < request->num_ranges; j++)
+            used += request->ranges[j].num_regs;
+
+        sprintf(log_msg, "    function %d, %s %d to %d: %d ranges, %d of %d points used\n", request->function, block_names[request->block],
+                request->start_address, request->start_address + request->num_regs - 1, request->num_ranges, used, request->num_regs);
+        log(log_msg);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Waits for the next deadline of the blocks polled by the worker, serving
+// gateway requests to its port as they arrive
+//-----------------------------------------------------------------------------
+void waitPollingPeriod(struct mb_worker *worker)
+{
+    //look for stop requests at least once a second
+    unsigned long long next_poll = getTimeNs() + 1000000000ULL;
+    for (int i = 0; i < num_devices; i++)
+    {
+        if (mb_devices[i].worker == worker - mb_workers && nextDeadline(i) < next_poll)
+            next_poll = nextDeadline(i);
+    }
+
+    struct timespec deadline_ts;
+    struct timespec *deadline = &deadline_ts;
+    deadline->tv_sec = next_poll / 1000000000ULL;
+    deadline->tv_nsec = next_poll % 1000000000ULL;
+
+    if (worker->port == NULL)
+    {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR);
+        return;
+    }
+
+    pthread_mutex_lock(&gatewayLock);
+    while (run_openplc)
+    {
+        if (worker->port->queue != NULL)
+        {
+            pthread_mutex_unlock(&gatewayLock);
+            serveGateway(worker->port);
+            pthread_mutex_lock(&gatewayLock);
+        }
+        else if (pthread_cond_timedwait(&gatewayCond, &gatewayLock, deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gatewayLock);
+}
+
+//-----------------------------------------------------------------------------
+// Writes the PDU of a request of the plan into pdu, taking the values of a
+// write from the exchange buffers. Returns the size of the PDU
+//-----------------------------------------------------------------------------
+int encodeRequest(struct MB_request *plan, unsigned char *pdu)
+{
+    int pdu_size = 5;
+    pdu[0] = plan->function;
+    pdu[1] = plan->start_address >> 8;
+    pdu[2] = plan->start_address & 0xff;
+    pdu[3] = plan->num_regs >> 8;
+    pdu[4] = plan->num_regs & 0xff;
+
+    //the ranges of a write request are contiguous
+    if (plan->function == MODBUS_FC_WRITE_MULTIPLE_COILS)
+    {
+        int bytes = (plan->num_regs + 7) / 8;
+        pdu[5] = bytes;
+        memset(&pdu[6], 0, bytes);
+
+        PLC_LOCK(&ioLock);
+        for (int r = 0; r < plan->num_ranges; r++)
+        {
+            struct MB_range *range = &plan->ranges[r];
+            int offset = range->start_address - plan->start_address;
+            for (int j = 0; j < range->num_regs; j++)
+            {
+                if (bool_output_buf[range->index + j])
+                    pdu[6 + (offset + j) / 8] |= 1 << ((offset + j) % 8);
+            }
+        }
+        PLC_UNLOCK(&ioLock);
+        pdu_size += 1 + bytes;
+    }
+    else if (plan->function == MODBUS_FC_WRITE_MULTIPLE_REGISTERS)
+    {
+        pdu[5] = plan->num_regs * 2;
+
+        PLC_LOCK(&ioLock);
+        for (int r = 0; r < plan->num_ranges; r++)
+        {
+            struct MB_range *range = &plan->ranges[r];
+            unsigned char *data = &pdu[6 + (range->start_address - plan->start_address) * 2];
+            for (int j = 0; j < range->num_regs; j++)
+            {
+                data[j * 2] = int_output_buf[range->index + j] >> 8;
+                data[j * 2 + 1] = int_output_buf[range->index + j] & 0xff;
+            }
+        }
+        PLC_UNLOCK(&ioLock);
+        pdu_size += 1 + plan->num_regs * 2;
+    }
+
+    return pdu_size;
+}
+
+//-----------------------------------------------------------------------------
+// Decodes the points of the ranges a read covers from the response PDU
+// straight into the exchange buffers. Returns false if the response doesn't
+// answer the request: a different function, a byte count that doesn't match
+// the points asked for, or a write echoing another address or count
+//-----------------------------------------------------------------------------
+bool decodeResponse(struct MB_request *plan, unsigned char *pdu, int pdu_size)
+{
+    if (pdu_size < 1 || pdu[0] != plan->function)
+        return false;
+
+    if (plan->function == MODBUS_FC_WRITE_MULTIPLE_COILS || plan->function == MODBUS_FC_WRITE_MULTIPLE_REGISTERS)
+    {
+        return pdu_size >= 5 && ((pdu[1] << 8) | pdu[2]) == plan->start_address &&
+               ((pdu[3] << 8) | pdu[4]) == plan->num_regs;
+    }
+
+    if (plan->function == MODBUS_FC_READ_DISCRETE_INPUTS)
+    {
+        int bytes = (plan->num_regs + 7) / 8;
+        if (pdu_size < 2 + bytes || pdu[1] != bytes)
+            return false;
+
+        PLC_LOCK(&ioLock);
+        for (int r = 0; r < plan->num_ranges; r++)
+        {
+            struct MB_range *range = &plan->ranges[r];
+            int offset = range->start_address - plan->start_address;
+            for (int j = 0; j < range->num_regs; j++)
+                bool_input_buf[range->index + j] = (pdu[2 + (offset + j) / 8] >> ((offset + j) % 8)) & 1;
+        }
+        PLC_UNLOCK(&ioLock);
+    }
+    else if (plan->function == MODBUS_FC_READ_INPUT_REGISTERS || plan->function == MODBUS_FC_READ_HOLDING_REGISTERS)
+    {
+        if (pdu_size < 2 + plan->num_regs * 2 || pdu[1] != plan->num_regs * 2)
+            return false;
+
+        PLC_LOCK(&ioLock);
+        for (int r = 0; r < plan->num_ranges; r++)
+        {
+            struct MB_range *range = &plan->ranges[r];
+            unsigned char *data = &pdu[2 + (range->start_address - plan->start_address) * 2];
+            for (int j = 0; j < range->num_regs; j++)
+                int_input_buf[range->index + j] = (data[j * 2] << 8) | data[j * 2 + 1];
+        }
+        PLC_UNLOCK(&ioLock);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Sends one request of the plan to device i through libmodbus, in the
+// transfer buffer of the device. Returns false if the request failed, with
+// errno set
+//-----------------------------------------------------------------------------
+bool pollRequest(int i, struct MB_request *request)
+{
+    struct MB_device *device = &mb_devices[i];
+    uint8_t *adu = device->transfer;
+
+    //the raw request is the unit id and the PDU
+    adu[0] = device->dev_id;
+    int size = 1 + encodeRequest(request, &adu[1]);
+
+    int length = -1;
+    waitFrameGap(i);
+    if (modbus_send_raw_request(device->mb_ctx, adu, size) != -1)
+        length = modbus_receive_confirmation(device->mb_ctx, adu);
+    endFrame(i);
+    if (length == -1)
+        return false;
+
+    //the unit id is the last byte of the header. A reply from another slave
+    //on the bus is not ours to decode
+    int header_length = modbus_get_header_length(device->mb_ctx);
+    if (length <= header_length || adu[header_length - 1] != device->dev_id)
+    {
+        errno = EMBBADSLAVE;
+        return false;
+    }
+    unsigned char *pdu = &adu[header_length];
+    int pdu_size = length - header_length - (device->protocol == MB_RTU ? 2 : 0);
+    if (pdu_size >= 2 && pdu[0] == (request->function | 0x80))
+    {
+        errno = MODBUS_ENOBASE + pdu[1];
+        return false;
+    }
+    if (!decodeResponse(request, pdu, pdu_size))
+    {
+        errno = EMBBADDATA;
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Polls one slave device: reads the inputs that are due at now into the
+// exchange buffers and writes the outputs that are due from them
+//-----------------------------------------------------------------------------
+void pollDevice(int i, unsigned long long now)
+{
+    unsigned char log_msg[1000];
+
+    bool due[NUM_BLOCKS];
+    bool any_due = false;
+    for (int b = 0; b < NUM_BLOCKS; b++)
+    {
+        due[b] = blockDue(deviceBlock(&mb_devices[i], b), now);
+        any_due = any_due || due[b];
+    }
+    if (!any_due)
+        return;
+
+    //Check if there is a connected RTU device using the same port
+    bool found_sharing = false;
+    bool rtu_port_connected = false;
+    if (mb_devices[i].protocol == MB_RTU)
+    {
+        for (int a = 0; a < num_devices; a++)
+        {
+            if (a != i && !strcmp(mb_devices[i].dev_address, mb_devices[a].dev_address))
+            {
+                found_sharing = true;
+                if (mb_devices[a].isConnected)
+                {
+                    rtu_port_connected = true;
+                }
+            }
+        }
+        if (found_sharing)
+        {
+            //Must reset mb context to current device's slave id
+            modbus_set_slave(mb_devices[i].mb_ctx, mb_devices[i].dev_id);
+        }
+    }
+
+    //give the bus to forwarded requests before polling the device
+    struct gateway_port *port = findGatewayPort(mb_devices[i].mb_ctx);
+    if (port != NULL)
+    {
+        serveGateway(port);
+        modbus_set_slave(mb_devices[i].mb_ctx, mb_devices[i].dev_id);
+    }
+
+    //Verify if device is connected
+    if (!mb_devices[i].isConnected && !rtu_port_connected)
+    {
+        sprintf(log_msg, "Device %s is disconnected. Attempting to reconnect...\n", mb_devices[i].dev_name);
+        log(log_msg);
+        if (modbus_connect(mb_devices[i].mb_ctx) == -1)
+        {
+
+            sprintf(log_msg, "Connection failed on MB device %s: %s\n", mb_devices[i].dev_name, modbus_strerror(errno));
+            log(log_msg);
+            
+            if (special_functions[2] != NULL) *special_functions[2]++;
+        }
+        else
+        {
+            sprintf(log_msg, "Connected to MB device %s\n", mb_devices[i].dev_name);
+            log(log_msg);
+            mb_devices[i].isConnected = true;
+        }
+    }
+    if (mb_devices[i].isConnected || rtu_port_connected)
+    {
+        for (int r = 0; r < mb_devices[i].num_requests; r++)
+        {
+            struct MB_request *request = &mb_devices[i].requests[r];
+            if (!due[request->block])
+                continue;
+
+            if (!pollRequest(i, request))
+            {
+                if (mb_devices[i].protocol != MB_RTU)
+                {
+                    modbus_close(mb_devices[i].mb_ctx);
+                    mb_devices[i].isConnected = false;
+                }
+
+                sprintf(log_msg, "Modbus function %d on %s %d failed on MB device %s: %s\n", request->function, block_names[request->block],
+                        request->start_address, mb_devices[i].dev_name, modbus_strerror(errno));
+                log(log_msg);
+                if (special_functions[2] != NULL) (*special_functions[2])++;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Thread of a polling worker. Polls the blocks that are due on its bus, then
+// waits for the next deadline
+//-----------------------------------------------------------------------------
+void *querySlaveDevices(void *arg)
+{
+    struct mb_worker *worker = (struct mb_worker *)arg;
+    configureThread("modbus_master", -1, 0);
+
+    while (run_openplc)
+    {
+        unsigned long long now = getTimeNs();
+        for (int i = 0; i < num_devices; i++)
+        {
+            if (mb_devices[i].worker == worker - mb_workers)
+                pollDevice(i, now);
+        }
+        waitPollingPeriod(worker);
+    }
+}
+
+#ifdef ASYNC_TCP_MASTER
+//-----------------------------------------------------------------------------
+// Asynchronous TCP master. A single thread polls all the TCP devices: each
+// pass writes every request of a device back to back on its connection, and
+// the responses are matched to the requests by transaction id, so a pass
+// costs about one round trip. Request timeouts are kept in a timer wheel
+//-----------------------------------------------------------------------------
+
+//One request of the plan of a TCP device
+struct tcp_request
+{
+    struct tcp_client *client;
+    struct MB_request *plan;
+    bool due;                       //to be sent with the next requests
+    bool active;                    //sent and waiting for its response
+    uint16_t tid;
+
+    //timer wheel links
+    struct tcp_request *next_timer;
+    struct tcp_request **prev_timer;
+    unsigned int rounds;
+};
+
+struct tcp_client
+{
+    int device;
+    int fd;
+    bool connecting;
+    struct sockaddr_in address;
+    uint16_t next_tid;
+    struct tcp_request *requests;   //by transaction id
+    int num_requests;
+    uint16_t tid_mask;              //slots for the requests, minus 1
+    struct tcp_request connect_timer;
+    unsigned char *rx;
+    int rx_size;
+    unsigned char *tx;
+    int buffer_size;                //of rx and tx, room for every request
+    int tx_size;
+    int tx_sent;
+    unsigned int events;
+};
+
+struct tcp_client *tcp_clients;
+int tcp_epoll_fd = -1;
+
+struct tcp_request *timer_wheel[WHEEL_SLOTS];
+unsigned long long wheel_tick;
+int num_timers = 0;
+
+//-----------------------------------------------------------------------------
+// Arms the timer of a request to expire after timeout_ns
+//-----------------------------------------------------------------------------
+void startTimer(struct tcp_request *request, unsigned long long timeout_ns)
+{
+    unsigned long long ticks = (timeout_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+    if (ticks == 0) ticks = 1;
+
+    struct tcp_request **slot = &timer_wheel[(wheel_tick + ticks) % WHEEL_SLOTS];
+    request->rounds = (ticks - 1) / WHEEL_SLOTS;
+    request->next_timer = *slot;
+    request->prev_timer = slot;
+    if (*slot != NULL) (*slot)->prev_timer = &request->next_timer;
+    *slot = request;
+    num_timers++;
+}
+
+void stopTimer(struct tcp_request *request)
+{
+    if (request->prev_timer == NULL)
+        return;
+
+    *request->prev_timer = request->next_timer;
+    if (request->next_timer != NULL) request->next_timer->prev_timer = request->prev_timer;
+    request->prev_timer = NULL;
+    num_timers--;
+}
+
+//-----------------------------------------------------------------------------
+// Polls the connection for writing while a request or the connection itself
+// is pending, and for reading otherwise
+//-----------------------------------------------------------------------------
+void updateClientEvents(struct tcp_client *client)
+{
+    unsigned int events = EPOLLIN;
+    if (client->connecting || client->tx_sent < client->tx_size)
+        events = EPOLLOUT;
+
+    if (events == client->events)
+        return;
+    client->events = events;
+
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = client;
+    epoll_ctl(tcp_epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+//-----------------------------------------------------------------------------
+// Closes the connection of the device and drops the requests in flight
+//-----------------------------------------------------------------------------
+void closeClient(struct tcp_client *client, const char *reason)
+{
+    unsigned char log_msg[1000];
+    struct MB_device *device = &mb_devices[client->device];
+
+    sprintf(log_msg, "Modbus request failed on MB device %s: %s\n", device->dev_name, reason);
+    log(log_msg);
+    if (special_functions[2] != NULL) (*special_functions[2])++;
+
+    for (int i = 0; i < client->num_requests; i++)
+    {
+        stopTimer(&client->requests[i]);
+        client->requests[i].active = false;
+        client->requests[i].due = false;
+    }
+    stopTimer(&client->connect_timer);
+
+    if (client->fd >= 0)
+        close(client->fd);
+    client->fd = -1;
+    client->connecting = false;
+    client->rx_size = 0;
+    client->tx_size = 0;
+    client->tx_sent = 0;
+    device->isConnected = false;
+}
+
+//-----------------------------------------------------------------------------
+// Sends as much of the pending requests as the socket takes
+//-----------------------------------------------------------------------------
+void flushClient(struct tcp_client *client)
+{
+    while (client->tx_sent < client->tx_size)
+    {
+        int n = send(client->fd, client->tx + client->tx_sent, client->tx_size - client->tx_sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            closeClient(client, strerror(errno));
+            return;
+        }
+        client->tx_sent += n;
+    }
+
+    if (client->tx_sent == client->tx_size)
+    {
+        client->tx_size = 0;
+        client->tx_sent = 0;
+    }
+    updateClientEvents(client);
+}
+
+//-----------------------------------------------------------------------------
+// Writes the requests of the device that are due into the send buffer, with
+// the current values of the outputs, and sends them together
+//-----------------------------------------------------------------------------
+void sendRequests(struct tcp_client *client)
+{
+    struct MB_device *device = &mb_devices[client->device];
+    unsigned char *adu = client->tx + client->tx_size;
+
+    for (int i = 0; i < client->num_requests; i++)
+    {
+        //each request keeps its slot, the transaction id only picks it out
+        struct tcp_request *request = &client->requests[i];
+        if (!request->due)
+            continue;
+
+        request->tid = (client->next_tid++ * (client->tid_mask + 1) + i) & 0xffff;
+        request->due = false;
+        request->active = true;
+
+        int pdu_size = encodeRequest(request->plan, &adu[7]);
+        adu[0] = request->tid >> 8;
+        adu[1] = request->tid & 0xff;
+        adu[2] = 0;
+        adu[3] = 0;
+        adu[4] = (pdu_size + 1) >> 8;
+        adu[5] = (pdu_size + 1) & 0xff;
+        adu[6] = device->dev_id;
+        adu += 7 + pdu_size;
+
+        startTimer(request, (unsigned long long)timeout * 1000000ULL);
+    }
+
+    client->tx_size = adu - client->tx;
+    flushClient(client);
+}
+
+//-----------------------------------------------------------------------------
+// Starts connecting to the device. The requests are sent once connected
+//-----------------------------------------------------------------------------
+void connectClient(struct tcp_client *client)
+{
+    unsigned char log_msg[1000];
+    struct MB_device *device = &mb_devices[client->device];
+
+    sprintf(log_msg, "Device %s is disconnected. Attempting to reconnect...\n", device->dev_name);
+    log(log_msg);
+
+    client->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (client->fd < 0)
+    {
+        closeClient(client, strerror(errno));
+        return;
+    }
+    int enable = 1;
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    if (connect(client->fd, (struct sockaddr *)&client->address, sizeof(client->address)) < 0 && errno != EINPROGRESS)
+    {
+        closeClient(client, strerror(errno));
+        return;
+    }
+
+    client->connecting = true;
+    client->events = EPOLLOUT;
+    struct epoll_event event;
+    event.events = EPOLLOUT;
+    event.data.ptr = client;
+    epoll_ctl(tcp_epoll_fd, EPOLL_CTL_ADD, client->fd, &event);
+    startTimer(&client->connect_timer, (unsigned long long)timeout * 1000000ULL);
+}
+
+//-----------------------------------------------------------------------------
+// Called when a connection in progress becomes writable
+//-----------------------------------------------------------------------------
+void finishConnect(struct tcp_client *client)
+{
+    unsigned char log_msg[1000];
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0)
+    {
+        closeClient(client, strerror(error));
+        return;
+    }
+
+    stopTimer(&client->connect_timer);
+    client->connecting = false;
+    mb_devices[client->device].isConnected = true;
+    sprintf(log_msg, "Connected to MB device %s\n", mb_devices[client->device].dev_name);
+    log(log_msg);
+
+    sendRequests(client);
+}
+
+//-----------------------------------------------------------------------------
+// Decodes the response to a request into the exchange buffers. Returns false
+// if the response doesn't match the request
+//-----------------------------------------------------------------------------
+bool handleResponse(struct tcp_client *client, unsigned char *adu, int size)
+{
+    uint16_t tid = (adu[0] << 8) | adu[1];
+    struct tcp_request *request = &client->requests[tid & client->tid_mask];
+    if (!request->active || request->tid != tid || adu[6] != mb_devices[client->device].dev_id)
+        return false;
+
+    stopTimer(request);
+    request->active = false;
+
+    struct MB_request *plan = request->plan;
+    unsigned char *pdu = &adu[7];
+    int pdu_size = size - 7;
+    if (pdu[0] == (plan->function | 0x80) && pdu_size >= 2)
+    {
+        unsigned char log_msg[1000];
+        sprintf(log_msg, "Modbus function %d on %s %d failed on MB device %s: exception %d\n", plan->function, block_names[plan->block],
+                plan->start_address, mb_devices[client->device].dev_name, pdu[1]);
+        log(log_msg);
+        if (special_functions[2] != NULL) (*special_functions[2])++;
+        return true;
+    }
+
+    return decodeResponse(plan, pdu, pdu_size);
+}
+
+//-----------------------------------------------------------------------------
+// Reads what the socket has and handles every complete response
+//-----------------------------------------------------------------------------
+void receiveResponses(struct tcp_client *client)
+{
+    while (true)
+    {
+        int n = recv(client->fd, client->rx + client->rx_size, client->buffer_size - client->rx_size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            closeClient(client, (n == 0) ? "connection closed by the device" : strerror(errno));
+            return;
+        }
+        client->rx_size += n;
+
+        int offset = 0;
+        while (client->rx_size - offset >= 7)
+        {
+            unsigned char *adu = client->rx + offset;
+            int length = (adu[4] << 8) | adu[5];
+            if (length < 2 || length > 254)
+            {
+                closeClient(client, "invalid response");
+                return;
+            }
+            if (client->rx_size - offset < 6 + length)
+                break;
+
+            if (!handleResponse(client, adu, 6 + length))
+            {
+                closeClient(client, "unexpected response");
+                return;
+            }
+            offset += 6 + length;
+        }
+
+        memmove(client->rx, client->rx + offset, client->rx_size - offset);
+        client->rx_size -= offset;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Moves the timer wheel up to now and fails the devices whose requests
+// expired
+//-----------------------------------------------------------------------------
+void advanceTimerWheel(unsigned long long now)
+{
+    unsigned long long target = now / WHEEL_TICK_NS;
+    while (wheel_tick < target)
+    {
+        wheel_tick++;
+
+        //unlink the expired timers first. Closing a client stops its other
+        //timers, which may be further down this slot
+        struct tcp_request *expired = NULL;
+        struct tcp_request *request = timer_wheel[wheel_tick % WHEEL_SLOTS];
+        while (request != NULL)
+        {
+            struct tcp_request *next = request->next_timer;
+            if (request->rounds > 0)
+            {
+                request->rounds--;
+            }
+            else
+            {
+                stopTimer(request);
+                request->next_timer = expired;
+                expired = request;
+            }
+            request = next;
+        }
+
+        while (expired != NULL)
+        {
+            struct tcp_request *next = expired->next_timer;
+            struct tcp_client *client = expired->client;
+
+            //an earlier expiry may have closed the client already
+            if (client->fd >= 0)
+                closeClient(client, "timed out");
+            expired = next;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Thread that polls the TCP devices
+//-----------------------------------------------------------------------------
+void *pollTcpDevices(void *arg)
+{
+    configureThread("modbus_master", -1, 0);
+    struct epoll_event events[64];
+
+    unsigned long long now = getTimeNs();
+    wheel_tick = now / WHEEL_TICK_NS;
+
+    while (run_openplc)
+    {
+        now = getTimeNs();
+        advanceTimerWheel(now);
+
+        //send the requests that are due. A block still waiting for the
+        //response to its last request skips this period
+        unsigned long long next_wake = now + 100000000ULL;
+        for (int i = 0; i < num_tcp_clients; i++)
+        {
+            struct tcp_client *client = &tcp_clients[i];
+            bool block_due[NUM_BLOCKS];
+            for (int b = 0; b < NUM_BLOCKS; b++)
+                block_due[b] = blockDue(deviceBlock(&mb_devices[client->device], b), now);
+
+            bool due = false;
+            for (int r = 0; r < client->num_requests; r++)
+            {
+                struct tcp_request *request = &client->requests[r];
+                if (block_due[request->plan->block] && !request->active)
+                {
+                    request->due = true;
+                    due = true;
+                }
+            }
+
+            if (due && client->fd < 0)
+                connectClient(client);
+            else if (due && !client->connecting)
+                sendRequests(client);
+
+            if (nextDeadline(client->device) < next_wake)
+                next_wake = nextDeadline(client->device);
+        }
+        if (num_timers > 0 && (wheel_tick + 1) * WHEEL_TICK_NS < next_wake)
+            next_wake = (wheel_tick + 1) * WHEEL_TICK_NS;
+
+        int wait_ms = (next_wake > now) ? (int)((next_wake - now + 999999) / 1000000) : 0;
+        int num_events = epoll_wait(tcp_epoll_fd, events, 64, wait_ms);
+        for (int i = 0; i < num_events; i++)
+        {
+            struct tcp_client *client = (struct tcp_client *)events[i].data.ptr;
+            if (client->fd < 0)
+                continue;
+
+            if (client->connecting)
+            {
+                finishConnect(client);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                receiveResponses(client);
+            if (client->fd >= 0 && (events[i].events & EPOLLOUT))
+                flushClient(client);
+        }
+    }
+
+    for (int i = 0; i < num_tcp_clients; i++)
+    {
+        if (tcp_clients[i].fd >= 0) close(tcp_clients[i].fd);
+    }
+    close(tcp_epoll_fd);
+}
+
+//-----------------------------------------------------------------------------
+// Sets up a client for each TCP device. Devices whose address can't be
+// resolved are left out
+//-----------------------------------------------------------------------------
+void initializeTcpClients()
+{
+    tcp_clients = (struct tcp_client *)calloc(num_devices, sizeof(struct tcp_client));
+    for (int i = 0; i < num_devices; i++)
+    {
+        struct MB_device *device = &mb_devices[i];
+        if (device->protocol != MB_TCP)
+            continue;
+
+        struct addrinfo hints, *result;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(device->dev_address, NULL, &hints, &result) != 0)
+        {
+            unsigned char log_msg[1000];
+            sprintf(log_msg, "Invalid address %s for MB device %s\n", device->dev_address, device->dev_name);
+            log(log_msg);
+            continue;
+        }
+
+        struct tcp_client *client = &tcp_clients[num_tcp_clients++];
+        client->device = i;
+        client->fd = -1;
+        client->address = *(struct sockaddr_in *)result->ai_addr;
+        client->address.sin_port = htons(device->ip_port);
+        client->connect_timer.client = client;
+        freeaddrinfo(result);
+
+        //the low bits of a transaction id pick out the request
+        int slots = 1;
+        while (slots < device->num_requests)
+            slots *= 2;
+        client->tid_mask = slots - 1;
+        client->requests = (struct tcp_request *)calloc(slots, sizeof(struct tcp_request));
+        client->num_requests = device->num_requests;
+        for (int r = 0; r < device->num_requests; r++)
+        {
+            client->requests[r].client = client;
+            client->requests[r].plan = &device->requests[r];
+        }
+        client->buffer_size = (device->num_requests > 0 ? device->num_requests : 1) * TCP_MAX_ADU;
+        client->rx = (unsigned char *)malloc(client->buffer_size);
+        client->tx = (unsigned char *)malloc(client->buffer_size);
+    }
+
+    tcp_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// This function is called by the main OpenPLC routine when it is initializing.
+// Modbus master initialization procedures are here.
+//-----------------------------------------------------------------------------
+void initializeMB()
+{
+    parseConfig();
+
+    for (int i = 0; i < num_devices; i++)
+    {
+        if (mb_devices[i].protocol == MB_TCP)
+        {
+#ifdef ASYNC_TCP_MASTER
+            //TCP devices don't go through libmodbus
+            continue;
+#else
+            mb_devices[i].mb_ctx = modbus_new_tcp(mb_devices[i].dev_address, mb_devices[i].ip_port);
+#endif
+        }
+        else if (mb_devices[i].protocol == MB_RTU)
+        {
+            //Check if there is a device using the same port
+            int share_index = -1;
+            for (int a = 0; a < num_devices && a < i; a++)
+            {
+                if (strcmp(mb_devices[i].dev_address, mb_devices[a].dev_address) == 0)
+                {
+                    share_index = a;
+                    break;
+                }
+            }
+            if (share_index != -1)
+            {
+                if (mb_devices[i].rtu_baud != mb_devices[share_index].rtu_baud || mb_devices[i].rtu_parity != mb_devices[share_index].rtu_parity || 
+                    mb_devices[i].rtu_data_bit != mb_devices[share_index].rtu_data_bit || mb_devices[i].rtu_stop_bit != mb_devices[share_index].rtu_stop_bit)
+                {
+                    unsigned char log_msg[1000];
+                    sprintf(log_msg, "Warning MB device %s port setting missmatch\n", mb_devices[i].dev_name);
+                    log(log_msg);
+                }
+                mb_devices[i].mb_ctx = mb_devices[share_index].mb_ctx;
+            }
+            else
+            {
+                mb_devices[i].mb_ctx = modbus_new_rtu(mb_devices[i].dev_address, mb_devices[i].rtu_baud,
+                                                mb_devices[i].rtu_parity, mb_devices[i].rtu_data_bit,
+                                                mb_devices[i].rtu_stop_bit);
+            }
+        }
+        
+        //slave id
+
+        modbus_set_slave(mb_devices[i].mb_ctx, mb_devices[i].dev_id);
+
+
+        //timeout
+        uint32_t to_sec = timeout / 1000;
+        uint32_t to_usec = (timeout % 1000) * 1000;
+        modbus_set_response_timeout(mb_devices[i].mb_ctx, to_sec, to_usec);
+        
+    }
+
+    //positions of the devices in the exchange buffers, in the order of
+    //mbconfig.cfg
+    uint16_t bool_input_index = 0;
+    uint16_t bool_output_index = 0;
+    uint16_t int_input_index = 0;
+    uint16_t int_output_index = 0;
+    for (int i = 0; i < num_devices; i++)
+    {
+        for (int b = 0; b < NUM_BLOCKS; b++)
+            countPoints(deviceBlock(&mb_devices[i], b));
+
+        mb_devices[i].bool_input_index = bool_input_index;
+        mb_devices[i].bool_output_index = bool_output_index;
+        mb_devices[i].int_input_index = int_input_index;
+        mb_devices[i].int_output_index = int_output_index;
+        bool_input_index += mb_devices[i].discrete_inputs.num_regs;
+        bool_output_index += mb_devices[i].coils.num_regs;
+        int_input_index += mb_devices[i].input_registers.num_regs + mb_devices[i].holding_read_registers.num_regs;
+        int_output_index += mb_devices[i].holding_registers.num_regs;
+
+        planRequests(i);
+    }
+
+    scheduleBlocks(getTimeNs());
+
+    //silence before each request on a serial line: 3.5 characters, fixed at
+    //1.75ms above 19200 baud, and the TX pause of the device
+    for (int i = 0; i < num_devices; i++)
+    {
+        struct MB_device *device = &mb_devices[i];
+        if (device->protocol != MB_RTU || device->rtu_baud <= 0)
+            continue;
+
+        int char_bits = 1 + device->rtu_data_bit + (device->rtu_parity != 'N') + device->rtu_stop_bit;
+        device->frame_gap = (device->rtu_baud > 19200) ? 1750000ULL : (unsigned long long)(3.5 * char_bits * 1e9 / device->rtu_baud);
+        device->frame_gap += device->rtu_tx_pause * 1000000ULL;
+    }
+
+    //one worker per serial port, and per TCP device unless they are polled
+    //asynchronously
+    mb_workers = (struct mb_worker *)calloc(num_devices, sizeof(struct mb_worker));
+    for (int i = 0; i < num_devices; i++)
+    {
+        mb_devices[i].worker = -1;
+        if (mb_devices[i].mb_ctx == NULL)
+            continue;
+
+        int w = 0;
+        while (w < num_workers && mb_workers[w].mb_ctx != mb_devices[i].mb_ctx)
+            w++;
+        if (w == num_workers)
+            mb_workers[num_workers++].mb_ctx = mb_devices[i].mb_ctx;
+        mb_devices[i].worker = w;
+    }
+    
+    //Route the slave ids of the RTU devices through the gateway
+    char gateway[10];
+    if (getConfigString("modbus_gateway", gateway, sizeof(gateway)) && !strcmp(gateway, "true"))
+    {
+        for (int i = 0; i < num_devices; i++)
+        {
+            if (mb_devices[i].protocol != MB_RTU || gateway_route[mb_devices[i].dev_id] != 0)
+                continue;
+
+            struct gateway_port *port = findGatewayPort(mb_devices[i].mb_ctx);
+            if (port == NULL)
+            {
+                if (num_gateway_ports == MAX_GATEWAY_PORTS)
+                    continue;
+                port = &gateway_ports[num_gateway_ports++];
+                port->mb_ctx = mb_devices[i].mb_ctx;
+                port->device = i;
+            }
+            gateway_route[mb_devices[i].dev_id] = port - gateway_ports + 1;
+        }
+
+        unsigned char log_msg[1000];
+        sprintf(log_msg, "Modbus gateway enabled on %d serial ports\n", num_gateway_ports);
+        log(log_msg);
+    }
+    for (int w = 0; w < num_workers; w++)
+        mb_workers[w].port = findGatewayPort(mb_workers[w].mb_ctx);
+
+    //the workers wait for their deadlines on the monotonic clock
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&gatewayCond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    //Initialize comm error counter
+    if (special_functions[2] != NULL) *special_functions[2] = 0;
+    
+    for (int w = 0; w < num_workers; w++)
+    {
+        pthread_t thread;
+        int ret = pthread_create(&thread, NULL, querySlaveDevices, &mb_workers[w]);
+        if (ret==0) 
         {
             pthread_detach(thread);
         }
     }
+#ifdef ASYNC_TCP_MASTER
+    initializeTcpClients();
+    if (num_tcp_clients > 0)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pollTcpDevices, NULL) == 0)
+            pthread_detach(thread);
+    }
+#endif
+    if (num_devices > 0)
+    {
+        unsigned char log_msg[1000];
+        sprintf(log_msg, "Polling %d slave devices with %d workers and %d pipelined TCP connections\n", num_devices, num_workers, num_tcp_clients);
+        log(log_msg);
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -676,7 +2109,7 @@ void initializeMB()
 //-----------------------------------------------------------------------------
 void updateBuffersIn_MB()
 {
-    pthread_mutex_lock(&ioLock);
+    PLC_LOCK(&ioLock);
 
     for (int i = 0; i < MAX_MB_IO; i++)
     {
@@ -684,7 +2117,7 @@ void updateBuffersIn_MB()
         if (int_input[100+i] != NULL) *int_input[100+i] = int_input_buf[i];
     }
 
-    pthread_mutex_unlock(&ioLock);
+    PLC_UNLOCK(&ioLock);
 }
 
 
@@ -694,7 +2127,7 @@ void updateBuffersIn_MB()
 //-----------------------------------------------------------------------------
 void updateBuffersOut_MB()
 {
-    pthread_mutex_lock(&ioLock);
+    PLC_LOCK(&ioLock);
 
     for (int i = 0; i < MAX_MB_IO; i++)
     {
@@ -702,5 +2135,5 @@ void updateBuffersOut_MB()
         if (int_output[100+i] != NULL) int_output_buf[i] = *int_output[100+i];
     }
 
-    pthread_mutex_unlock(&ioLock);
+    PLC_UNLOCK(&ioLock);
 }
@@ -0,0 +1,365 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file is the Modbus RTU slave. It listens on the serial port set in
+// runtime.cfg and answers the requests to its slave id with the same
+// handlers as the Modbus/TCP server. Frames end after 3.5 characters of
+// silence on the line, which is timed with a timerfd.
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+#include "ladder.h"
+
+#define RTU_MAX_ADU         256 //slave id, PDU of up to 253 bytes and CRC
+#define TCP_ADU_SIZE        272 //MBAP header and PDU, with room to spare
+#define MBAP_HEADER_SIZE    7
+
+//CRC-16/MODBUS tables for slice-by-8. crc_table[k][b] is the CRC of byte b
+//followed by k zero bytes
+uint16_t crc_table[8][256];
+
+//-----------------------------------------------------------------------------
+// Fills the CRC tables
+//-----------------------------------------------------------------------------
+void initCrcTables()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint16_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        crc_table[0][i] = crc;
+    }
+
+    for (int k = 1; k < 8; k++)
+    {
+        for (int i = 0; i < 256; i++)
+            crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^ crc_table[0][crc_table[k - 1][i] & 0xff];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns the Modbus CRC of data, processing 8 bytes per step
+//-----------------------------------------------------------------------------
+uint16_t modbusCrc(const uint8_t *data, int size)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        crc ^= data[0] | (data[1] << 8);
+        crc = crc_table[7][crc & 0xff] ^ crc_table[6][crc >> 8] ^
+              crc_table[5][data[2]] ^ crc_table[4][data[3]] ^
+              crc_table[3][data[4]] ^ crc_table[2][data[5]] ^
+              crc_table[1][data[6]] ^ crc_table[0][data[7]];
+    }
+
+    for (; size > 0; data++, size--)
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *data) & 0xff];
+
+    return crc;
+}
+
+#ifdef __linux__
+//-----------------------------------------------------------------------------
+// Returns the termios constant of a baud rate, or 0 if it isn't supported
+//-----------------------------------------------------------------------------
+speed_t baudConstant(int baud_rate)
+{
+    switch (baud_rate)
+    {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: return 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Opens the serial port in raw mode. Returns the file descriptor, or -1
+//-----------------------------------------------------------------------------
+int openSerialPort(const char *device, int baud_rate, char parity, int data_bits, int stop_bits)
+{
+    unsigned char log_msg[1000];
+    speed_t speed = baudConstant(baud_rate);
+    if (speed == 0)
+    {
+        sprintf(log_msg, "Modbus RTU: unsupported baud rate %d\n", baud_rate);
+        log(log_msg);
+        return -1;
+    }
+
+    int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        sprintf(log_msg, "Modbus RTU: error opening %s => %s\n", device, strerror(errno));
+        log(log_msg);
+        return -1;
+    }
+
+    struct termios tty;
+    memset(&tty, 0, sizeof(tty));
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+    tty.c_cflag |= (data_bits == 7) ? CS7 : CS8;
+    if (parity == 'E' || parity == 'O')
+        tty.c_cflag |= PARENB;
+    if (parity == 'O')
+        tty.c_cflag |= PARODD;
+    if (stop_bits == 2)
+        tty.c_cflag |= CSTOPB;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tty) < 0)
+    {
+        sprintf(log_msg, "Modbus RTU: error configuring %s => %s\n", device, strerror(errno));
+        log(log_msg);
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    return fd;
+}
+
+//-----------------------------------------------------------------------------
+// Writes the whole frame to the serial port. Gives up if the slave is
+// stopped while the port can't take more bytes
+//-----------------------------------------------------------------------------
+bool writeFrame(int fd, const uint8_t *frame, int size)
+{
+    while (size > 0)
+    {
+        int n = write(fd, frame, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+        {
+            if (!run_modbus_rtu)
+                return false;
+
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        if (n <= 0)
+            return false;
+
+        frame += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Answers a complete frame. The request is wrapped in an MBAP header so that
+// processModbusMessage() can handle it like a Modbus/TCP request, and the
+// response is unwrapped again. Broadcasts (slave id 0) are processed but not
+// answered. Returns false if the serial port failed
+//-----------------------------------------------------------------------------
+bool processRtuFrame(int fd, const uint8_t *frame, int size, uint8_t slave_id)
+{
+    //shortest frame is slave id, function code and CRC
+    if (size < 4 || (frame[0] != slave_id && frame[0] != 0))
+        return true;
+
+    uint16_t crc = frame[size - 2] | (frame[size - 1] << 8);
+    if (modbusCrc(frame, size - 2) != crc)
+        return true;
+
+    unsigned char adu[TCP_ADU_SIZE];
+    int pdu_size = size - 3;
+    adu[0] = 0;
+    adu[1] = 0;
+    adu[2] = 0;
+    adu[3] = 0;
+    adu[4] = (pdu_size + 1) >> 8;
+    adu[5] = (pdu_size + 1) & 0xff;
+    memcpy(&adu[6], frame, size - 2);
+
+    int response_size = processModbusMessage(adu, MBAP_HEADER_SIZE + pdu_size);
+    if (frame[0] == 0 || response_size <= MBAP_HEADER_SIZE)
+        return true;
+
+    //slave id and PDU are already in place after the MBAP header
+    uint8_t *response = &adu[6];
+    int rtu_size = response_size - 6;
+    crc = modbusCrc(response, rtu_size);
+    response[rtu_size++] = crc & 0xff;
+    response[rtu_size++] = crc >> 8;
+
+    return writeFrame(fd, response, rtu_size);
+}
+
+//-----------------------------------------------------------------------------
+// Serves Modbus RTU requests on the serial port until run_modbus_rtu is
+// cleared. The port settings and the slave id come from runtime.cfg
+//-----------------------------------------------------------------------------
+void startRtuServer()
+{
+    unsigned char log_msg[1000];
+    char device[256] = "";
+    char parity[10] = "N";
+
+    if (!getConfigString("modbus_rtu_device", device, sizeof(device)) || device[0] == '\0')
+    {
+        sprintf(log_msg, "Modbus RTU: no serial port set in modbus_rtu_device\n");
+        log(log_msg);
+        return;
+    }
+    int baud_rate = getConfigInt("modbus_rtu_baud_rate", 19200);
+    getConfigString("modbus_rtu_parity", parity, sizeof(parity));
+    int data_bits = getConfigInt("modbus_rtu_data_bits", 8);
+    int stop_bits = getConfigInt("modbus_rtu_stop_bits", 1);
+    uint8_t slave_id = getConfigInt("modbus_rtu_slave_id", 1);
+
+    //3.5 characters of silence end a frame. Above 19200 baud the time is
+    //fixed at 1.75ms
+    int char_bits = 1 + data_bits + (parity[0] != 'N') + stop_bits;
+    long frame_gap_ns = (baud_rate > 19200) ? 1750000L : (long)(3.5 * char_bits * 1e9 / baud_rate);
+
+    initCrcTables();
+    int fd = openSerialPort(device, baud_rate, parity[0], data_bits, stop_bits);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0 || timer_fd < 0)
+    {
+        if (fd >= 0) close(fd);
+        if (timer_fd >= 0) close(timer_fd);
+        return;
+    }
+
+    sprintf(log_msg, "Modbus RTU: slave %d listening on %s at %d baud\n", slave_id, device, baud_rate);
+    log(log_msg);
+
+    struct itimerspec frame_gap;
+    memset(&frame_gap, 0, sizeof(frame_gap));
+    frame_gap.it_value.tv_sec = frame_gap_ns / 1000000000L;
+    frame_gap.it_value.tv_nsec = frame_gap_ns % 1000000000L;
+
+    uint8_t frame[RTU_MAX_ADU];
+    int frame_size = 0;
+    bool overrun = false;
+    bool port_error = false; //only the first of consecutive errors is logged
+
+    while (run_modbus_rtu)
+    {
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {timer_fd, POLLIN, 0}};
+
+        //wake up periodically to see if the server was stopped
+        if (poll(fds, 2, 100) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        //the silence ended the frame before any new bytes came in
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t expirations;
+            read(timer_fd, &expirations, sizeof(expirations));
+
+            //a failed write drops the response. The port may recover, as
+            //USB adapters do after a transient error, so keep serving
+            bool ok = overrun || processRtuFrame(fd, frame, frame_size, slave_id);
+            frame_size = 0;
+            overrun = false;
+            if (!ok && !port_error && run_modbus_rtu)
+            {
+                sprintf(log_msg, "Modbus RTU: error writing to %s => %s\n", device, strerror(errno));
+                log(log_msg);
+            }
+            port_error = !ok;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint8_t data[RTU_MAX_ADU];
+            int n = read(fd, data, sizeof(data));
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                if (!port_error)
+                {
+                    sprintf(log_msg, "Modbus RTU: error reading %s => %s\n", device, strerror(errno));
+                    log(log_msg);
+                }
+                port_error = true;
+                frame_size = 0;
+                sleepms(100);
+                continue;
+            }
+
+            //frames longer than the limit are dropped whole
+            if (n > 0)
+            {
+                if (frame_size + n > RTU_MAX_ADU)
+                    overrun = true;
+                else
+                    memcpy(&frame[frame_size], data, n);
+                frame_size += n;
+                timerfd_settime(timer_fd, 0, &frame_gap, NULL);
+            }
+        }
+        else if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            //the other end of a pty was closed. Wait for it to come back
+            sleepms(100);
+        }
+    }
+
+    close(timer_fd);
+    close(fd);
+    sprintf(log_msg, "Terminating Modbus RTU thread\r\n");
+    log(log_msg);
+}
+
+#else
+void startRtuServer()
+{
+    unsigned char log_msg[1000];
+    sprintf(log_msg, "Modbus RTU: the RTU slave is only supported on Linux\n");
+    log(log_msg);
+}
+#endif
@@ -309,32 +309,18 @@ void Pccc_ReadCoils(unsigned char *buffer, int buffer_size) //Working QX Read
 	Start = word_pccc(buffer[8],buffer[9]); //Start based on the Element and Subelemnt values in the Command Packet
 	Mask = log2( word_pccc(buffer[10],buffer[11]) ); //Save the byte size or byte data length to the variable from the command packet
 	ByteDataLength = buffer[5];
-	pthread_mutex_lock(&bufferLock);
 	
-	/*----Reading the values from the PLC bool_output buffer and writing to the PCCC buffer based on position----*/
-	for (int i = 0; i < ByteDataLength; i++)
+	/*----Reading the values from the PLC bool_output snapshot and writing to the PCCC buffer based on position----*/
+	struct image_read read;
+	do
 	{
-		for(int j = 0; j < 8; j++)
+		const struct process_image *image = beginImageRead(&read);
+		for (int i = 0; i < ByteDataLength; i++)
 		{
-			int position = Start + i * 8 + j;
-			if (position < MAX_COILS)
-			{
-				if(bool_output[position/8][position%8] != NULL)
-				{
-					bitWrite(buffer[4+i], j, *bool_output[position/8][position%8]);
-				}
-				else
-				{
-					bitWrite(buffer[4+i],j,0);
-				}
-			}
-			else
-			{
-				//PCCC Error Handling (Fill in?); If the position is greater than the MAX COILS, ERROR Overflow?
-			}
+			//PCCC Error Handling (Fill in?); Positions past MAX_COILS read as zero, ERROR Overflow?
+			buffer[4+i] = readImageBits(image->bool_output, Start + i * 8);
 		}
-	}
-	pthread_mutex_unlock(&bufferLock);
+	} while (!endImageRead(&read));
 	
 	/*Left in for future error handling setup*/
 	/*if (pccc_error != ERR_NONE)
@@ -358,32 +344,18 @@ void Pccc_ReadDiscreteInputs(unsigned char *buffer, int buffer_size) //Working I
 	
 	Start = word_pccc(buffer[8],buffer[9]);//Start based on the Element and Subelemnt values in the Command Packet
 	ByteDataLength = buffer[5];//Save the byte size or byte data length to the variable from the command packet
-	pthread_mutex_lock(&bufferLock);
 	
-	/*--------Reading the values from the PLC bool_input buffer and writing to the PCCC buffer based on position--------*/
-	for (int i = 0; i < ByteDataLength; i++)
+	/*--------Reading the values from the PLC bool_input snapshot and writing to the PCCC buffer based on position--------*/
+	struct image_read read;
+	do
 	{
-		for(int j = 0; j < 8; j++)
+		const struct process_image *image = beginImageRead(&read);
+		for (int i = 0; i < ByteDataLength; i++)
 		{
-			int position = Start + i * 8 + j;
-			if (position < MAX_DISCRETE_INPUT)
-			{
-				if(bool_input[position/8][position%8] != NULL)
-				{
-					bitWrite(buffer[4+i], j, *bool_input[position/8][position%8]);
-				}
-				else
-				{
-					bitWrite(buffer[4+i],j,0);
-				}
-			}
-			else
-			{
-				//PCCC Error Handling (Fill in?); If the position is greater than the MAX, ERROR Overflow?
-			}
+			//PCCC Error Handling (Fill in?); Positions past MAX_DISCRETE_INPUT read as zero, ERROR Overflow?
+			buffer[4+i] = readImageBits(image->bool_input, Start + i * 8);
 		}
-	}
-	pthread_mutex_unlock(&bufferLock);
+	} while (!endImageRead(&read));
 	
 	/*Left in for future error handling setup*/
 	/*if (mb_error != ERR_NONE)
@@ -419,61 +391,48 @@ void Pccc_ReadHoldingRegisters(unsigned char *buffer, int buffer_size) // QW Rea
 		//return;
 	}*/
 
-	pthread_mutex_lock(&bufferLock);
-	/*--------Reading the values from the PLC int_output, int_memory, and dint_memory buffer and writing to the PCCC buffer based on position--------*/
-	for(int i = 0; i < WordDataLength; i++)
+	/*--------Reading the values from the PLC int_output, int_memory, and dint_memory snapshot and writing to the PCCC buffer based on position--------*/
+	struct image_read read;
+	do
 	{
-		int position = Start + i;
-		//int an_position = an_Start + i;
-		if ((position <= MIN_16B_RANGE) && (Temp_FileN == PCCC_FN_INT && Temp_FileT == PCCC_INTEGER))
+		const struct process_image *image = beginImageRead(&read);
+		for(int i = 0; i < WordDataLength; i++)
 		{
-			if (int_output[position] != NULL)
+			int position = Start + i;
+			//int an_position = an_Start + i;
+			if ((position < MIN_16B_RANGE) && (Temp_FileN == PCCC_FN_INT && Temp_FileT == PCCC_INTEGER))
 			{
-				buffer[ 4 + position * 2] = lowByte(*int_output[position]);
-				buffer[5 + position * 2] = highByte(*int_output[position]);
+				buffer[ 4 + position * 2] = lowByte(image->int_output[position]);
+				buffer[5 + position * 2] = highByte(image->int_output[position]);
 			}
-			else
+			//accessing memory
+			//16-bit registers
+			else if ((position >= MIN_16B_RANGE && position <= MAX_16B_RANGE) && (Temp_FileN == PCCC_FN_INT && Temp_FileT == PCCC_INTEGER))
 			{
-				buffer[ 4 + position * 2] = 0;
-				buffer[5 + position * 2] = 0;
+				buffer[ 4 + position * 2] = lowByte(image->int_memory[position - MIN_16B_RANGE]);
+				buffer[5 + position * 2] = highByte(image->int_memory[position - MIN_16B_RANGE]);
 			}
-		}
-		//accessing memory
-		//16-bit registers
-		else if ((position >= MIN_16B_RANGE && position <= MAX_16B_RANGE) && (Temp_FileN == PCCC_FN_INT && Temp_FileT == PCCC_INTEGER))
-		{
-			if (int_memory[position - MIN_16B_RANGE] != NULL)
+			
+			//32-bit registers
+			else if (Temp_FileN == PCCC_FN_FLOAT && Temp_FileT == PCCC_FLOATING_POINT && (position % 2 == 0) && (position / 2 < BUFFER_SIZE))
 			{
-				buffer[ 4 + position * 2] = lowByte(*int_memory[position - MIN_16B_RANGE]);
-				buffer[5 + position * 2] = highByte(*int_memory[position - MIN_16B_RANGE]);
+				position = position/2;
+				uint32_t tempValue = image->dint_memory[position];
+				
+				buffer[4+(4*position)] = tempValue;
+				buffer[5+(4*position)] = tempValue >> 8;
+				buffer[6+(4*position)] = tempValue >> 16;
+				buffer[7+(4*position)] = tempValue >> 24;
+			
 			}
+			/*Left in for future error handling setup-Invalid Address*/
 			else
 			{
-				buffer[ 4 + position * 2] = 0;
-				buffer[5 + position * 2] = 0;
+				//PCCC Error Handling (Fill in?); If none of the above are recognized, error
 			}
-		}
-		
-		//32-bit registers
-		else if (Temp_FileN == PCCC_FN_FLOAT && Temp_FileT == PCCC_FLOATING_POINT && (position % 2 == 0))
-		{
-			position = position/2;
-			uint32_t tempValue = *dint_memory[position];
-			
-			buffer[4+(4*position)] = tempValue;
-			buffer[5+(4*position)] = tempValue >> 8;
-			buffer[6+(4*position)] = tempValue >> 16;
-			buffer[7+(4*position)] = tempValue >> 24;
-		
-		}
-		/*Left in for future error handling setup-Invalid Address*/
-		else
-		{
-			//PCCC Error Handling (Fill in?); If none of the above are recognized, error
-		}
 
-	}
-	pthread_mutex_unlock(&bufferLock);
+		}
+	} while (!endImageRead(&read));
 
 }
 
@@ -514,12 +473,12 @@ void Pccc_ReadHoldingRegisters(unsigned char *buffer, int buffer_size) // QW Rea
 		{
 			value = 0; 
 		}
-		pthread_mutex_lock(&bufferLock);
-		if(bool_output[Start][Mask] != NULL)
+		if(Mask >= 0 && Mask < 8)
 		{
-			*bool_output[Start][Mask] = value;
+			beginImageWrite();
+			queueImageWrite(IMAGE_BOOL_OUTPUT, Start, value << Mask, 1 << Mask);
+			endImageWrite();
 		}
-		pthread_mutex_unlock(&bufferLock);
 	}
 	
 }
@@ -539,31 +498,31 @@ void Pccc_WriteRegister(unsigned char *buffer, int buffer_size) // QW Write
 	unsigned int Temp_FileT = buffer[7];//Value will be changed potentially during this process, save the File Type Value from command packet
 	unsigned int Temp_FileN = buffer[6];//Value will be changed potentially during this process, save the File Number Value from command packet
 
-	pthread_mutex_lock(&bufferLock);
+	beginImageWrite();
 	
-	/*--------Determines if the values inside the PCCC data has data. Writes that value to the appropriate PLC Buffer based on the contents of the data in PCCC Buffer-------*/
+	/*--------Determines if the values inside the PCCC data has data. Queues that value for the appropriate PLC Buffer based on the contents of the data in PCCC Buffer-------*/
 	for(int i = 0; i < WordDataLength; i++)
 	{
 		int position = Start + i;
 		//analog outputs
-		if ((position <= MIN_16B_RANGE) && (Temp_FileN == PCCC_FN_INT && (Temp_FileT == PCCC_INTEGER)))
+		if ((position < MIN_16B_RANGE) && (Temp_FileN == PCCC_FN_INT && (Temp_FileT == PCCC_INTEGER)))
 		{
-			if (int_output[position] != NULL) *int_output[position] =  an_word_pccc(buffer[10 + i], buffer[11 + i]);//look at this closer
+			queueImageWrite(IMAGE_INT_OUTPUT, position, (uint16_t)an_word_pccc(buffer[10 + i], buffer[11 + i]), 0xffff);//look at this closer
 		}
 		//accessing memory
 		//16-bit registers
 		else if ((position >= MIN_16B_RANGE && position <= MAX_16B_RANGE) && (Temp_FileN == PCCC_FN_OUTPUT && (Temp_FileT == PCCC_INTEGER)))
 		{
-			if (int_memory[position - MIN_16B_RANGE] != NULL) *int_memory[position - MIN_16B_RANGE] = an_word_pccc(buffer[10 + i], buffer[11 + i]);//look at this closer
+			queueImageWrite(IMAGE_INT_MEMORY, position - MIN_16B_RANGE, (uint16_t)an_word_pccc(buffer[10 + i], buffer[11 + i]), 0xffff);//look at this closer
 		}
 		//32-bit registers
-		if (Temp_FileN == PCCC_FN_FLOAT && (Temp_FileT == PCCC_FLOATING_POINT))
+		if (Temp_FileN == PCCC_FN_FLOAT && (Temp_FileT == PCCC_FLOATING_POINT) && position < BUFFER_SIZE)
 		{
 			if (dint_memory[position] != NULL)
 			{
 				uint32_t tempValue = buffer[10 + i] | buffer[11 + i] << 8 | buffer[12 + i] << 16 | buffer[13 + i] <<24;//look at this closer
 				
-				*dint_memory[position] = tempValue;
+				queueImageWrite(IMAGE_DINT_MEMORY, position, tempValue, 0xffffffff);
 				
 				i += 4;
 			}
@@ -572,8 +531,7 @@ void Pccc_WriteRegister(unsigned char *buffer, int buffer_size) // QW Write
 				pccc_holding_regs[position] = an_word_pccc(buffer[10 + i], buffer[11 + i]);//look at this closer might need to copy from temp
 			}
 		}
-	
-	pthread_mutex_unlock(&bufferLock);
-
 	}
+	
+	endImageWrite();
 }
\ No newline at end of file
@@ -38,12 +38,17 @@ void startPstorage()
 	IEC_UINT persistentBuffer[BUFFER_SIZE];
 
     //Read initial buffers into persistent struct
-	pthread_mutex_lock(&bufferLock); //lock mutex
-	for (int i = 0; i < BUFFER_SIZE; i++)
+	struct image_read read;
+	uint64_t image_generation;
+	do
 	{
-		if (int_memory[i] != NULL) persistentBuffer[i] = *int_memory[i];
-	}
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+		const struct process_image *image = beginImageRead(&read);
+		image_generation = image->generation;
+		for (int i = 0; i < BUFFER_SIZE; i++)
+		{
+			if (int_memory[i] != NULL) persistentBuffer[i] = image->int_memory[i];
+		}
+	} while (!endImageRead(&read));
     
     //Perform the first write
     if (access("persistent.file", F_OK) == -1) 
@@ -72,21 +77,28 @@ void startPstorage()
 	while (run_pstorage)
 	{
         
-        //Verify if persistent buffer is outdated
+        //Verify if persistent buffer is outdated. Only the blocks that
+        //changed since the last check need to be compared
 		bool bufferOutdated = false;
-		pthread_mutex_lock(&bufferLock); //lock mutex
-		for (int i = 0; i < BUFFER_SIZE; i++)
+		uint64_t generation;
+		do
 		{
-			if (int_memory[i] != NULL)
+			const struct process_image *image = beginImageRead(&read);
+			generation = image->generation;
+			for (int i = 0; i < BUFFER_SIZE; i++)
 			{
-				if (persistentBuffer[i] != *int_memory[i])
+				if (!imageChanged(image, IMAGE_INT_MEMORY, i, image_generation)) continue;
+				if (int_memory[i] != NULL)
 				{
-					persistentBuffer[i] = *int_memory[i];
-					bufferOutdated = true;
+					if (persistentBuffer[i] != image->int_memory[i])
+					{
+						persistentBuffer[i] = image->int_memory[i];
+						bufferOutdated = true;
+					}
 				}
 			}
-		}
-		pthread_mutex_unlock(&bufferLock); //unlock mutex
+		} while (!endImageRead(&read));
+		image_generation = generation;
 
         //If buffer is outdated, write the changes back to the file
 		if (bufferOutdated)
@@ -131,7 +143,10 @@ int readPersistentStorage()
 
 	IEC_INT persistentBuffer[BUFFER_SIZE];
 
-	if (fread(persistentBuffer, sizeof(IEC_INT), BUFFER_SIZE, fd) < BUFFER_SIZE)
+	//the file may come from a program with a smaller BUFFER_SIZE. Restore
+	//the positions it has
+	int count = fread(persistentBuffer, sizeof(IEC_INT), BUFFER_SIZE, fd);
+	if (count < BUFFER_SIZE && ferror(fd))
 	{
         sprintf(log_msg, "Persistent Storage: Error while trying to read persistent.file!\n");
         log(log_msg);
@@ -142,10 +157,10 @@ int readPersistentStorage()
     sprintf(log_msg, "Persistent Storage: Reading persistent.file into local buffers\n");
     log(log_msg);
     
-	pthread_mutex_lock(&bufferLock); //lock mutex
-	for (int i = 0; i < BUFFER_SIZE; i++)
+	PLC_LOCK(&bufferLock); //lock mutex
+	for (int i = 0; i < count; i++)
 	{
 		if (int_memory[i] != NULL) *int_memory[i] = persistentBuffer[i];
 	}
-	pthread_mutex_unlock(&bufferLock); //unlock mutex
+	PLC_UNLOCK(&bufferLock); //unlock mutex
 }
\ No newline at end of file
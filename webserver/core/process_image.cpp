@@ -0,0 +1,594 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file keeps the process image seen by the protocol servers. At the
+// end of every scan cycle the values behind the OpenPLC buffers are copied
+// into one of two snapshots, each protected by its own sequence counter.
+// Readers never block the scan: they read the latest snapshot and retry if
+// it was overwritten meanwhile. Writes from the protocols are queued and
+// applied by the scan thread at the start of the next cycle.
+//
+// The snapshots are dense arrays of BUFFER_SIZE positions per area, like
+// the OpenPLC pointer tables, so their memory scales with the highest
+// address the program uses, not with the number of points. Only the work
+// done on every cycle is limited to the blocks that have points mapped.
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <atomic>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ladder.h"
+
+#define WRITE_QUEUE_SIZE        4096
+
+struct image_write
+{
+    uint8_t area;
+    uint32_t index;
+    uint64_t value;
+    uint64_t mask;
+};
+
+static struct process_image images[2];
+static std::atomic<unsigned int> image_seq[2];
+static std::atomic<int> current_image(0);
+
+//Mapped block list: the blocks of each area that have buffer positions mapped
+static int mapped_blocks[IMAGE_AREAS][IMAGE_MAX_BLOCKS];
+static int num_mapped_blocks[IMAGE_AREAS];
+static bool mark_all_changed = true;
+
+//Signaled every time a snapshot is published. Created on first use and
+//never closed, so the scan thread can't write to a reused descriptor
+static std::atomic<int> publish_event_fd(-1);
+static pthread_mutex_t publishEventLock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct image_write write_queue[WRITE_QUEUE_SIZE];
+static int write_queue_count = 0;
+static int write_batch_start = 0;
+static bool write_batch_failed = false;
+static pthread_mutex_t writeQueueLock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+// Returns true if glueVars.cpp stores the located variables in the compact
+// process image and the pointer tables still point into it. The multitask
+// scheduler moves them to an image of its own
+//-----------------------------------------------------------------------------
+bool compactProcessImage()
+{
+    return compact_bool_input != NULL && !taskImagesActive();
+}
+
+//-----------------------------------------------------------------------------
+// Packs eight IEC_BOOLs into one byte, the first one in bit 0. Any non-zero
+// value is a 1
+//-----------------------------------------------------------------------------
+static inline uint8_t packBools(const IEC_BOOL *bools)
+{
+    uint64_t x;
+    memcpy(&x, bools, sizeof(x));
+
+    //set the low bit of every non-zero byte, clear everything else
+    x = ((x | ((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL)) >> 7) & 0x0101010101010101ULL;
+    //gather the low bits of all bytes into the top byte
+    return (uint8_t)((x * 0x0102040810204080ULL) >> 56);
+}
+
+//-----------------------------------------------------------------------------
+// Packs bytes * 8 consecutive IEC_BOOLs into bytes bytes. With SSE2 sixteen
+// IEC_BOOLs are packed per step with pmovmskb
+//-----------------------------------------------------------------------------
+static inline void packBoolBytes(uint8_t *bits, IEC_BOOL bools[][8], int bytes)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 2 <= bytes; i += 2)
+    {
+        __m128i values = _mm_loadu_si128((const __m128i *)bools[i]);
+        int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(values, zero));
+        bits[i] = (uint8_t)mask;
+        bits[i + 1] = (uint8_t)(mask >> 8);
+    }
+#endif
+
+    for (; i < bytes; i++)
+        bits[i] = packBools(bools[i]);
+}
+
+//-----------------------------------------------------------------------------
+// Unpacks one byte into eight IEC_BOOLs, bit 0 first. Only the bools whose
+// bit is set in mask are changed
+//-----------------------------------------------------------------------------
+static inline void unpackBools(IEC_BOOL *bools, uint8_t value, uint8_t mask)
+{
+    const uint64_t select = 0x8040201008040201ULL;
+    uint64_t x, m, current;
+
+    //byte j keeps bit j of the value, then becomes 0 or 1
+    x = ((((value * 0x0101010101010101ULL) & select) + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+    m = ((((mask * 0x0101010101010101ULL) & select) + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+    m *= 0xff;
+
+    memcpy(&current, bools, sizeof(current));
+    current = (current & ~m) | (x & m);
+    memcpy(bools, &current, sizeof(current));
+}
+
+//-----------------------------------------------------------------------------
+// Reads 8 consecutive bits of a bit-packed area of the image, starting at
+// bit position. Bits past the end of the area read as zero
+//-----------------------------------------------------------------------------
+uint8_t readImageBits(const uint8_t *bits, int position)
+{
+    int index = position / 8;
+    int shift = position % 8;
+
+    if (index >= BUFFER_SIZE)
+        return 0;
+
+    uint8_t value = bits[index] >> shift;
+    if (shift != 0 && index + 1 < BUFFER_SIZE)
+        value |= bits[index + 1] << (8 - shift);
+
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+// Copies count consecutive bits of a bit-packed area of the image, starting
+// at bit position, into dest. The unused bits of the last byte are cleared,
+// as Modbus requires. Returns the number of bytes written
+//-----------------------------------------------------------------------------
+int readImageBitRange(uint8_t *dest, const uint8_t *bits, int position, int count)
+{
+    int bytes = (count + 7) / 8;
+    int index = position / 8;
+    int shift = position % 8;
+    int i = 0;
+
+    if (bytes == 0)
+        return 0;
+
+    if (shift == 0 && index + bytes <= BUFFER_SIZE)
+    {
+        memcpy(dest, bits + index, bytes);
+    }
+    else
+    {
+        //unaligned: eight bytes per step while the source has a spare byte
+        for (; i + 8 <= bytes && index + i + 9 <= BUFFER_SIZE; i += 8)
+        {
+            uint64_t value;
+            memcpy(&value, bits + index + i, sizeof(value));
+            value = (value >> shift) | ((uint64_t)bits[index + i + 8] << (64 - shift));
+            memcpy(dest + i, &value, sizeof(value));
+        }
+        for (; i < bytes; i++)
+            dest[i] = readImageBits(bits, position + i * 8);
+    }
+
+    if (count % 8 != 0)
+        dest[bytes - 1] &= (1 << (count % 8)) - 1;
+
+    return bytes;
+}
+
+//-----------------------------------------------------------------------------
+// Sets the generation of every mapped block of an area that differs from the
+// previous snapshot to the generation of image. The other blocks keep the
+// generation they had. block_size is in bytes
+//-----------------------------------------------------------------------------
+static void trackChanges(struct process_image *image, const struct process_image *previous, int area,
+                         const void *values, const void *previous_values, int block_size)
+{
+    for (int i = 0; i < num_mapped_blocks[area]; i++)
+    {
+        int block = mapped_blocks[area][i];
+        int offset = block * block_size;
+
+        if (mark_all_changed || memcmp((const uint8_t *)values + offset, (const uint8_t *)previous_values + offset, block_size) != 0)
+            image->block_generation[area][block] = image->generation;
+        else
+            image->block_generation[area][block] = previous->block_generation[area][block];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns true if the block holding slot changed after generation since.
+// Consumers keep the generation of the last snapshot they processed and
+// only look at the slots that changed after it
+//-----------------------------------------------------------------------------
+bool imageChanged(const struct process_image *image, int area, int slot, uint64_t since)
+{
+    int block = slot / IMAGE_BLOCK_SLOTS;
+
+    if (block < 0 || block >= IMAGE_MAX_BLOCKS)
+        return false;
+
+    return image->block_generation[area][block] > since;
+}
+
+//-----------------------------------------------------------------------------
+// Lists the blocks of a word area that have at least one buffer position
+// mapped
+//-----------------------------------------------------------------------------
+static void mapWordArea(int area, void **pointers)
+{
+    num_mapped_blocks[area] = 0;
+    for (int block = 0; block < BUFFER_SIZE / IMAGE_BLOCK_SLOTS; block++)
+    {
+        for (int i = block * IMAGE_BLOCK_SLOTS; i < (block + 1) * IMAGE_BLOCK_SLOTS; i++)
+        {
+            if (pointers[i] != NULL)
+            {
+                mapped_blocks[area][num_mapped_blocks[area]++] = block;
+                break;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Lists the blocks of a boolean area that have at least one buffer position
+// mapped
+//-----------------------------------------------------------------------------
+static void mapBoolArea(int area, IEC_BOOL *pointers[][8])
+{
+    const int block_bytes = IMAGE_BLOCK_SLOTS / 8;
+
+    num_mapped_blocks[area] = 0;
+    for (int block = 0; block < BUFFER_SIZE / block_bytes; block++)
+    {
+        bool used = false;
+        for (int i = block * block_bytes; i < (block + 1) * block_bytes && !used; i++)
+        {
+            for (int j = 0; j < 8; j++)
+            {
+                if (pointers[i][j] != NULL) used = true;
+            }
+        }
+        if (used) mapped_blocks[area][num_mapped_blocks[area]++] = block;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Rebuilds the mapped block list from the OpenPLC buffers. Only the blocks
+// in the list are copied and compared on every cycle, so the scan cost
+// follows the number of points mapped instead of BUFFER_SIZE. The memory of
+// the snapshots still follows BUFFER_SIZE. Must be called
+// whenever buffer positions are mapped, with bufferLock held or before the
+// scan starts
+//-----------------------------------------------------------------------------
+void mapProcessImage()
+{
+    mapBoolArea(IMAGE_BOOL_INPUT, bool_input);
+    mapBoolArea(IMAGE_BOOL_OUTPUT, bool_output);
+    mapWordArea(IMAGE_INT_INPUT, (void **)int_input);
+    mapWordArea(IMAGE_INT_OUTPUT, (void **)int_output);
+    mapWordArea(IMAGE_INT_MEMORY, (void **)int_memory);
+    mapWordArea(IMAGE_DINT_MEMORY, (void **)dint_memory);
+    mapWordArea(IMAGE_LINT_MEMORY, (void **)lint_memory);
+
+    //blocks that were just added must reach the consumers
+    mark_all_changed = true;
+}
+
+//-----------------------------------------------------------------------------
+// Copies the mapped blocks of a boolean area into the snapshot, packed
+//-----------------------------------------------------------------------------
+static void copyBoolArea(int area, uint8_t *bits, IEC_BOOL *pointers[][8], IEC_BOOL compact[][8])
+{
+    const int block_bytes = IMAGE_BLOCK_SLOTS / 8;
+
+    for (int k = 0; k < num_mapped_blocks[area]; k++)
+    {
+        int first = mapped_blocks[area][k] * block_bytes;
+        if (compact != NULL)
+        {
+            packBoolBytes(bits + first, compact + first, block_bytes);
+            continue;
+        }
+
+        for (int i = first; i < first + block_bytes; i++)
+        {
+            uint8_t value = 0;
+            for (int j = 0; j < 8; j++)
+            {
+                if (pointers[i][j] != NULL && *pointers[i][j]) value |= (1 << j);
+            }
+            bits[i] = value;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Copies the mapped blocks of a word area into the snapshot. In compact mode
+// every block is a single copy
+//-----------------------------------------------------------------------------
+template <typename T>
+static void copyWordArea(int area, T *values, T **pointers, T *compact)
+{
+    for (int k = 0; k < num_mapped_blocks[area]; k++)
+    {
+        int first = mapped_blocks[area][k] * IMAGE_BLOCK_SLOTS;
+        if (compact != NULL)
+        {
+            memcpy(&values[first], &compact[first], IMAGE_BLOCK_SLOTS * sizeof(T));
+        }
+        else
+        {
+            for (int i = first; i < first + IMAGE_BLOCK_SLOTS; i++)
+                values[i] = (pointers[i] != NULL) ? *pointers[i] : 0;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Copies the current values of the OpenPLC buffers into the snapshot that
+// readers are not using, then makes it the current one. Must be called by
+// the scan thread with bufferLock held
+//-----------------------------------------------------------------------------
+void publishProcessImage()
+{
+    int next = 1 - current_image.load(std::memory_order_relaxed);
+    struct process_image *image = &images[next];
+
+    //odd sequence: snapshot is being written
+    image_seq[next].fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    //with the compact image every mapped position points to its own slot in
+    //the compact arrays, so whole blocks can be copied at once
+    bool compact = compactProcessImage();
+    copyBoolArea(IMAGE_BOOL_INPUT, image->bool_input, bool_input, compact ? compact_bool_input : NULL);
+    copyBoolArea(IMAGE_BOOL_OUTPUT, image->bool_output, bool_output, compact ? compact_bool_output : NULL);
+    copyWordArea<IEC_UINT>(IMAGE_INT_INPUT, image->int_input, int_input, compact ? compact_int_input : NULL);
+    copyWordArea<IEC_UINT>(IMAGE_INT_OUTPUT, image->int_output, int_output, compact ? compact_int_output : NULL);
+    copyWordArea<IEC_UINT>(IMAGE_INT_MEMORY, image->int_memory, int_memory, compact ? compact_int_memory : NULL);
+    copyWordArea<IEC_DINT>(IMAGE_DINT_MEMORY, image->dint_memory, dint_memory, compact ? compact_dint_memory : NULL);
+    copyWordArea<IEC_LINT>(IMAGE_LINT_MEMORY, image->lint_memory, lint_memory, compact ? compact_lint_memory : NULL);
+
+    //only the scan thread writes the snapshots, so the current one can be
+    //read here without the sequence counter
+    const struct process_image *previous = &images[1 - next];
+    image->generation = previous->generation + 1;
+    trackChanges(image, previous, IMAGE_BOOL_INPUT, image->bool_input, previous->bool_input, IMAGE_BLOCK_SLOTS / 8);
+    trackChanges(image, previous, IMAGE_BOOL_OUTPUT, image->bool_output, previous->bool_output, IMAGE_BLOCK_SLOTS / 8);
+    trackChanges(image, previous, IMAGE_INT_INPUT, image->int_input, previous->int_input, IMAGE_BLOCK_SLOTS * sizeof(IEC_UINT));
+    trackChanges(image, previous, IMAGE_INT_OUTPUT, image->int_output, previous->int_output, IMAGE_BLOCK_SLOTS * sizeof(IEC_UINT));
+    trackChanges(image, previous, IMAGE_INT_MEMORY, image->int_memory, previous->int_memory, IMAGE_BLOCK_SLOTS * sizeof(IEC_UINT));
+    trackChanges(image, previous, IMAGE_DINT_MEMORY, image->dint_memory, previous->dint_memory, IMAGE_BLOCK_SLOTS * sizeof(IEC_DINT));
+    trackChanges(image, previous, IMAGE_LINT_MEMORY, image->lint_memory, previous->lint_memory, IMAGE_BLOCK_SLOTS * sizeof(IEC_LINT));
+    mark_all_changed = false;
+
+    image_seq[next].fetch_add(1, std::memory_order_release);
+    current_image.store(next, std::memory_order_release);
+
+    int event_fd = publish_event_fd.load(std::memory_order_relaxed);
+    if (event_fd >= 0)
+    {
+        uint64_t one = 1;
+        write(event_fd, &one, sizeof(one));
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns an eventfd that becomes readable when a new snapshot is published,
+// for a thread that acts once per scan cycle. Returns -1 if it isn't
+// supported
+//-----------------------------------------------------------------------------
+int imagePublishedEvent()
+{
+#ifdef __linux__
+    pthread_mutex_lock(&publishEventLock);
+    if (publish_event_fd.load() < 0)
+        publish_event_fd.store(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    pthread_mutex_unlock(&publishEventLock);
+#endif
+
+    return publish_event_fd.load();
+}
+
+//-----------------------------------------------------------------------------
+// Starts reading the latest snapshot. The values read are only valid if
+// endImageRead() returns true afterwards, otherwise the read must be retried
+//-----------------------------------------------------------------------------
+const struct process_image *beginImageRead(struct image_read *read)
+{
+    while (true)
+    {
+        read->index = current_image.load(std::memory_order_acquire);
+        read->seq = image_seq[read->index].load(std::memory_order_acquire);
+        if ((read->seq & 1) == 0)
+            return &images[read->index];
+
+        //the scan published twice while we were picking a snapshot
+        sched_yield();
+    }
+}
+
+bool endImageRead(struct image_read *read)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return image_seq[read->index].load(std::memory_order_relaxed) == read->seq;
+}
+
+//-----------------------------------------------------------------------------
+// Writes are grouped in batches so that a request that writes several
+// registers is applied in a single scan cycle, or not at all
+//-----------------------------------------------------------------------------
+void beginImageWrite()
+{
+    pthread_mutex_lock(&writeQueueLock);
+    write_batch_start = write_queue_count;
+    write_batch_failed = false;
+}
+
+//-----------------------------------------------------------------------------
+// Queues a write to one element of an area. Only the bits set in mask are
+// changed. For IMAGE_BOOL_OUTPUT index is the first byte and mask selects
+// the bits of up to 8 consecutive bytes, byte index in its low 8 bits. Must
+// be called between beginImageWrite() and endImageWrite()
+//-----------------------------------------------------------------------------
+void queueImageWrite(int area, int index, uint64_t value, uint64_t mask)
+{
+    if (write_batch_failed || index < 0 || index >= BUFFER_SIZE)
+        return;
+
+    if (write_queue_count >= WRITE_QUEUE_SIZE)
+    {
+        write_batch_failed = true;
+        return;
+    }
+
+    struct image_write *write = &write_queue[write_queue_count++];
+    write->area = area;
+    write->index = index;
+    write->value = value;
+    write->mask = mask;
+}
+
+//-----------------------------------------------------------------------------
+// Queues a write of count consecutive bits of IMAGE_BOOL_OUTPUT, starting at
+// bit position, taken from the bit-packed values (first bit in bit 0 of the
+// first byte). Up to 56 bits go in each queued write. Must be called between
+// beginImageWrite() and endImageWrite()
+//-----------------------------------------------------------------------------
+void queueImageBits(const uint8_t *values, int position, int count)
+{
+    for (int done = 0; done < count; done += 56)
+    {
+        int n = count - done;
+        if (n > 56) n = 56;
+
+        uint64_t value = 0;
+        for (int i = 0; i < (n + 7) / 8; i++)
+            value |= (uint64_t)values[done / 8 + i] << (i * 8);
+
+        int shift = (position + done) % 8;
+        uint64_t mask = ((1ULL << n) - 1) << shift;
+        queueImageWrite(IMAGE_BOOL_OUTPUT, (position + done) / 8, (value << shift) & mask, mask);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Closes a batch. Returns false if the queue was full, in which case none of
+// the writes of the batch are applied
+//-----------------------------------------------------------------------------
+bool endImageWrite()
+{
+    bool ok = !write_batch_failed;
+    bool task_input = false;
+    if (!ok) write_queue_count = write_batch_start;
+
+    for (int i = write_batch_start; i < write_queue_count && !task_input; i++)
+    {
+        if (write_queue[i].area == IMAGE_BOOL_OUTPUT)
+            task_input = isTaskInput(write_queue[i].index, write_queue[i].mask);
+    }
+    pthread_mutex_unlock(&writeQueueLock);
+
+    //a write to the input of a SINGLE task starts it right away instead of
+    //in the next scan
+    if (task_input) applyTaskInputWrites();
+
+    return ok;
+}
+
+//-----------------------------------------------------------------------------
+// Applies all queued writes to the OpenPLC buffers. Must be called with
+// bufferLock held. Returns the number of writes applied
+//-----------------------------------------------------------------------------
+int applyImageWrites()
+{
+    static struct image_write pending[WRITE_QUEUE_SIZE];
+    bool compact = compactProcessImage();
+
+    pthread_mutex_lock(&writeQueueLock);
+    int count = write_queue_count;
+    memcpy(pending, write_queue, count * sizeof(struct image_write));
+    write_queue_count = 0;
+    pthread_mutex_unlock(&writeQueueLock);
+
+    for (int i = 0; i < count; i++)
+    {
+        struct image_write *write = &pending[i];
+        int index = write->index;
+
+        switch (write->area)
+        {
+            case IMAGE_BOOL_OUTPUT:
+                for (int b = 0; b < 8 && index + b < BUFFER_SIZE; b++)
+                {
+                    uint8_t mask = write->mask >> (b * 8);
+                    uint8_t value = write->value >> (b * 8);
+                    if (mask == 0)
+                        continue;
+
+                    if (compact)
+                    {
+                        unpackBools(compact_bool_output[index + b], value, mask);
+                        continue;
+                    }
+                    for (int j = 0; j < 8; j++)
+                    {
+                        if (((mask >> j) & 1) && bool_output[index + b][j] != NULL)
+                            *bool_output[index + b][j] = (value >> j) & 1;
+                    }
+                }
+                break;
+
+            case IMAGE_INT_OUTPUT:
+                if (int_output[index] != NULL)
+                    *int_output[index] = (*int_output[index] & ~write->mask) | (write->value & write->mask);
+                break;
+
+            case IMAGE_INT_MEMORY:
+                if (int_memory[index] != NULL)
+                    *int_memory[index] = (*int_memory[index] & ~write->mask) | (write->value & write->mask);
+                break;
+
+            case IMAGE_DINT_MEMORY:
+                if (dint_memory[index] != NULL)
+                    *dint_memory[index] = (uint32_t)(((uint32_t)*dint_memory[index] & ~write->mask) | (write->value & write->mask));
+                break;
+
+            case IMAGE_LINT_MEMORY:
+                if (lint_memory[index] != NULL)
+                    *lint_memory[index] = (uint64_t)(((uint64_t)*lint_memory[index] & ~write->mask) | (write->value & write->mask));
+                break;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,133 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file is responsible for parsing the runtime.cfg file. Settings are
+// stored as plain key/value pairs and each module reads the keys it cares
+// about when it initializes.
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <fstream>
+#include <string>
+
+#include "ladder.h"
+
+#define MAX_CONFIG_ENTRIES      128
+#define MAX_CONFIG_KEY          64
+#define MAX_CONFIG_VALUE        256
+
+using namespace std;
+
+char config_keys[MAX_CONFIG_ENTRIES][MAX_CONFIG_KEY];
+char config_values[MAX_CONFIG_ENTRIES][MAX_CONFIG_VALUE];
+int num_config_entries = 0;
+pthread_mutex_t configLock = PTHREAD_MUTEX_INITIALIZER;
+
+//-----------------------------------------------------------------------------
+// Copies the characters between start and end into dest, removing leading
+// and trailing whitespace and optional double quotes
+//-----------------------------------------------------------------------------
+void copyTrimmed(char *dest, const char *start, const char *end, int dest_size)
+{
+    while (start < end && (*start == ' ' || *start == '\t' || *start == '"')) start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n' || end[-1] == '"')) end--;
+
+    int len = end - start;
+    if (len >= dest_size) len = dest_size - 1;
+    memcpy(dest, start, len);
+    dest[len] = '\0';
+}
+
+//-----------------------------------------------------------------------------
+// Reads runtime.cfg into the key/value table. Lines starting with # are
+// comments. Can be called again at any time to reload the file
+//-----------------------------------------------------------------------------
+void parseRuntimeConfig()
+{
+    string line;
+    ifstream cfgfile("runtime.cfg");
+
+    pthread_mutex_lock(&configLock);
+    num_config_entries = 0;
+
+    if (cfgfile.is_open())
+    {
+        while (getline(cfgfile, line) && num_config_entries < MAX_CONFIG_ENTRIES)
+        {
+            const char *line_str = line.c_str();
+            const char *separator = strchr(line_str, '=');
+
+            if (line_str[0] == '#' || separator == NULL)
+                continue;
+
+            copyTrimmed(config_keys[num_config_entries], line_str, separator, MAX_CONFIG_KEY);
+            copyTrimmed(config_values[num_config_entries], separator + 1, line_str + line.length(), MAX_CONFIG_VALUE);
+            if (config_keys[num_config_entries][0] != '\0')
+                num_config_entries++;
+        }
+    }
+    else
+    {
+        unsigned char log_msg[1000];
+        sprintf(log_msg, "Runtime config file (runtime.cfg) not found. Using default settings\n");
+        log(log_msg);
+    }
+
+    pthread_mutex_unlock(&configLock);
+}
+
+//-----------------------------------------------------------------------------
+// Copies the value of key into value. Returns false if the key is not set,
+// leaving value untouched
+//-----------------------------------------------------------------------------
+bool getConfigString(const char *key, char *value, int value_size)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&configLock);
+    for (int i = 0; i < num_config_entries; i++)
+    {
+        if (!strcmp(config_keys[i], key))
+        {
+            strncpy(value, config_values[i], value_size);
+            value[value_size - 1] = '\0';
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&configLock);
+
+    return found;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the integer value of key, or default_value if the key is not set
+//-----------------------------------------------------------------------------
+int getConfigInt(const char *key, int default_value)
+{
+    char value[MAX_CONFIG_VALUE];
+
+    if (getConfigString(key, value, MAX_CONFIG_VALUE))
+        return atoi(value);
+
+    return default_value;
+}
@@ -0,0 +1,214 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file keeps the timing statistics of the main scan loop. The scan
+// thread is the only writer, so every counter is a relaxed atomic and the
+// interactive server can read them at any time without taking a lock.
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+#include "ladder.h"
+
+//Histogram buckets are powers of two in microseconds. Bucket 0 holds
+//values below 1us and the last bucket holds everything above 16ms
+#define STATS_BUCKETS           16
+
+struct scan_stat
+{
+    std::atomic<uint64_t> last;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> histogram[STATS_BUCKETS];
+};
+
+static const char *stat_names[NUM_SCAN_STATS] = {"wake_latency", "input", "program", "output", "scan"};
+static struct scan_stat scan_stats[NUM_SCAN_STATS];
+static std::atomic<bool> reset_requested(false);
+static std::atomic<uint64_t> overrun_total(0);
+static std::atomic<uint64_t> overrun_consecutive(0);
+static std::atomic<uint64_t> overrun_max_consecutive(0);
+
+//-----------------------------------------------------------------------------
+// Returns the monotonic clock in nanoseconds
+//-----------------------------------------------------------------------------
+unsigned long long getTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// Finds the histogram bucket for a value in nanoseconds
+//-----------------------------------------------------------------------------
+static int statBucket(uint64_t value_ns)
+{
+    uint64_t value_us = value_ns / 1000;
+    int bucket = 0;
+
+    while (value_us != 0 && bucket < STATS_BUCKETS - 1)
+    {
+        value_us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+//-----------------------------------------------------------------------------
+// Clears one set of counters. Only called from the scan thread
+//-----------------------------------------------------------------------------
+static void clearStat(struct scan_stat *stat)
+{
+    stat->last.store(0, std::memory_order_relaxed);
+    stat->min.store(UINT64_MAX, std::memory_order_relaxed);
+    stat->max.store(0, std::memory_order_relaxed);
+    stat->sum.store(0, std::memory_order_relaxed);
+    stat->count.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < STATS_BUCKETS; i++)
+    {
+        stat->histogram[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Records a new sample. Must only be called from the scan thread
+//-----------------------------------------------------------------------------
+void recordScanStat(int stat_index, unsigned long long value_ns)
+{
+    if (reset_requested.load(std::memory_order_acquire))
+    {
+        for (int i = 0; i < NUM_SCAN_STATS; i++) clearStat(&scan_stats[i]);
+        overrun_total.store(0, std::memory_order_relaxed);
+        overrun_max_consecutive.store(0, std::memory_order_relaxed);
+        reset_requested.store(false, std::memory_order_release);
+    }
+
+    struct scan_stat *stat = &scan_stats[stat_index];
+    stat->last.store(value_ns, std::memory_order_relaxed);
+    if (value_ns < stat->min.load(std::memory_order_relaxed)) stat->min.store(value_ns, std::memory_order_relaxed);
+    if (value_ns > stat->max.load(std::memory_order_relaxed)) stat->max.store(value_ns, std::memory_order_relaxed);
+    stat->sum.store(stat->sum.load(std::memory_order_relaxed) + value_ns, std::memory_order_relaxed);
+    stat->count.store(stat->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    int bucket = statBucket(value_ns);
+    stat->histogram[bucket].store(stat->histogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+// Records whether the last cycle overran its period. Returns the number of
+// consecutive overruns. Must only be called from the scan thread
+//-----------------------------------------------------------------------------
+unsigned long long recordOverrun(bool overrun)
+{
+    if (!overrun)
+    {
+        overrun_consecutive.store(0, std::memory_order_relaxed);
+        return 0;
+    }
+
+    uint64_t consecutive = overrun_consecutive.load(std::memory_order_relaxed) + 1;
+    overrun_consecutive.store(consecutive, std::memory_order_relaxed);
+    overrun_total.store(overrun_total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (consecutive > overrun_max_consecutive.load(std::memory_order_relaxed))
+        overrun_max_consecutive.store(consecutive, std::memory_order_relaxed);
+
+    return consecutive;
+}
+
+unsigned long long getOverrunCount()
+{
+    return overrun_total.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+// Readers used by the special functions
+//-----------------------------------------------------------------------------
+unsigned long long getScanStatLast(int stat_index)
+{
+    return scan_stats[stat_index].last.load(std::memory_order_relaxed);
+}
+
+unsigned long long getScanStatMax(int stat_index)
+{
+    return scan_stats[stat_index].max.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+// Asks the scan thread to clear all counters on its next sample
+//-----------------------------------------------------------------------------
+void resetScanStats()
+{
+    reset_requested.store(true, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+// Initializes the counters. Must be called before the scan loop starts
+//-----------------------------------------------------------------------------
+void initScanStats()
+{
+    for (int i = 0; i < NUM_SCAN_STATS; i++) clearStat(&scan_stats[i]);
+}
+
+//-----------------------------------------------------------------------------
+// Writes a text report of all counters into buffer. All values are in
+// nanoseconds. Returns the number of characters written
+//-----------------------------------------------------------------------------
+int printScanStats(char *buffer, int buffer_size)
+{
+    int count_char = snprintf(buffer, buffer_size, "tick: %llu\n", common_ticktime__);
+
+    for (int i = 0; i < NUM_SCAN_STATS && count_char < buffer_size; i++)
+    {
+        struct scan_stat *stat = &scan_stats[i];
+        uint64_t count = stat->count.load(std::memory_order_relaxed);
+        uint64_t sum = stat->sum.load(std::memory_order_relaxed);
+        uint64_t min = stat->min.load(std::memory_order_relaxed);
+
+        count_char += snprintf(buffer + count_char, buffer_size - count_char, "%s: last=%llu min=%llu max=%llu mean=%llu count=%llu hist=",
+                               stat_names[i], (unsigned long long)stat->last.load(std::memory_order_relaxed),
+                               (unsigned long long)(count ? min : 0), (unsigned long long)stat->max.load(std::memory_order_relaxed),
+                               (unsigned long long)(count ? sum / count : 0), (unsigned long long)count);
+
+        for (int j = 0; j < STATS_BUCKETS && count_char < buffer_size; j++)
+        {
+            count_char += snprintf(buffer + count_char, buffer_size - count_char, j ? ",%llu" : "%llu",
+                                   (unsigned long long)stat->histogram[j].load(std::memory_order_relaxed));
+        }
+
+        if (count_char < buffer_size)
+            count_char += snprintf(buffer + count_char, buffer_size - count_char, "\n");
+    }
+
+    if (count_char < buffer_size)
+    {
+        count_char += snprintf(buffer + count_char, buffer_size - count_char, "overruns: total=%llu consecutive=%llu max_consecutive=%llu\n",
+                               (unsigned long long)overrun_total.load(std::memory_order_relaxed),
+                               (unsigned long long)overrun_consecutive.load(std::memory_order_relaxed),
+                               (unsigned long long)overrun_max_consecutive.load(std::memory_order_relaxed));
+    }
+
+    if (count_char >= buffer_size) count_char = buffer_size - 1;
+    return count_char;
+}
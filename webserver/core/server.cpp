@@ -29,6 +29,16 @@
 #include <string.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#endif
 
 #include "ladder.h"
 
@@ -36,6 +46,18 @@
 #define MAX_OUTPUT 16
 #define MAX_MODBUS 100
 #define NET_BUFFER_SIZE 10000
+#define MAX_EVENTS 64
+#define MAX_BATCH 32
+#define RX_BUFFER_SIZE 16384 //power of two, larger than any frame
+#define MBAP_HEADER_SIZE 7
+#define MODBUS_MAX_ADU 260
+#define MODBUS_SLOT_SIZE 272 //largest response processModbusMessage can build
+#define ENIP_HEADER_SIZE 24
+#define DEFAULT_MAX_CONNECTIONS 64
+#define GATEWAY_SLOTS 4 //forwarded requests in flight per connection
+#define MAX_PUBLISH_TARGETS 16
+#define MAX_CLIENT_WEIGHTS 16
+#define MAX_CLIENT_WEIGHT 16
 
 
 //-----------------------------------------------------------------------------
@@ -120,14 +142,1053 @@ int createSocket(uint16_t port)
         return -1;
     }
     
-    // we accept max 5 pending connections
-    listen(socket_fd,5);
+    // let clients that connect at the same time queue up
+    listen(socket_fd,SOMAXCONN);
     sprintf(log_msg, "Server: Listening on port %d\n", port);
     log(log_msg);
 
     return socket_fd;
 }
 
+//-----------------------------------------------------------------------------
+// Blocking call. Holds here until something is received from the client.
+// Once the message is received, it is stored on the buffer and the function
+// returns the number of bytes received.
+//-----------------------------------------------------------------------------
+int listenToClient(int client_fd, unsigned char *buffer)
+{
+    int n = read(client_fd, buffer, NET_BUFFER_SIZE);
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// Process client's request. The response is written over the request on
+// buffer. Returns the size of the response, zero or less if there is none
+//-----------------------------------------------------------------------------
+int processRequest(unsigned char *buffer, int bufferSize, int protocol_type)
+{
+    if (protocol_type == MODBUS_PROTOCOL)
+        return processModbusMessage(buffer, bufferSize);
+    else if (protocol_type == ENIP_PROTOCOL)
+        return processEnipMessage(buffer, bufferSize);
+
+    return 0;
+}
+
+//Counters of each protocol server, by protocol type. Only the server thread
+//updates them
+struct server_stats
+{
+    unsigned long long accepted;
+    unsigned long long rejected;    //over the connection limit
+    unsigned long long requests;
+    unsigned long long throttled;   //delayed by the rate limits
+    unsigned long long dropped;     //answered busy by the rate limits
+};
+
+struct server_stats server_stats[ENIP_PROTOCOL + 1];
+
+//-----------------------------------------------------------------------------
+// Prints the counters of the Modbus and EtherNet/IP servers into buffer.
+// Returns the number of characters written
+//-----------------------------------------------------------------------------
+int printServerStats(char *buffer, int buffer_size)
+{
+    const int protocols[] = {MODBUS_PROTOCOL, ENIP_PROTOCOL};
+    const char *names[] = {"modbus", "enip"};
+    int count = 0;
+
+    for (int i = 0; i < 2 && count < buffer_size; i++)
+    {
+        struct server_stats *stats = &server_stats[protocols[i]];
+        count += snprintf(buffer + count, buffer_size - count,
+                          "%s: accepted %llu, rejected %llu, requests %llu, throttled %llu, dropped %llu\n",
+                          names[i], stats->accepted, stats->rejected, stats->requests, stats->throttled, stats->dropped);
+    }
+
+    return (count < buffer_size) ? count : buffer_size - 1;
+}
+
+#ifdef __linux__
+//-----------------------------------------------------------------------------
+// On Linux a single thread serves all the clients of a server. It waits on
+// epoll for new connections and requests, so there is no thread per client
+// and new clients are accepted as soon as they connect. Clients take turns
+// with deficit round robin: each turn a connection can process one batch of
+// requests times the weight of its address, so a client with a deep
+// pipeline can't hold the others back. Requests can also be limited per
+// connection and per source address with token buckets
+//-----------------------------------------------------------------------------
+
+//Tokens are requests, refilled at the rate of the limit up to its burst
+struct token_bucket
+{
+    double tokens;
+    unsigned long long last_refill;
+};
+
+//Source address shared by one or more connections
+struct client_ip
+{
+    in_addr_t addr;
+    int connections;
+    struct token_bucket bucket;
+};
+
+//Request rates in requests per second, 0 for no limit. Reloaded from the
+//runtime config every second
+struct rate_limits
+{
+    int client_rate;
+    int client_burst;
+    int ip_rate;
+    int ip_burst;
+    bool reply_busy;                //answer Modbus requests over the limit with
+                                    //exception 6 instead of delaying them
+    int num_weights;                //turn weights of the listed addresses.
+    in_addr_t weight_addr[MAX_CLIENT_WEIGHTS];//other addresses weigh 1
+    int weight[MAX_CLIENT_WEIGHTS];
+};
+
+struct server_state
+{
+    struct rate_limits limits;
+    struct server_stats *stats;
+    struct client_ip *ips;          //up to one per connection
+    int max_connections;
+    struct connection **ready;      //connections waiting for another turn
+    struct connection **turn;
+    int num_ready;
+};
+
+struct connection
+{
+    int fd;
+    unsigned long long last_activity;
+    unsigned char *rx;              //ring buffer with the bytes received
+    unsigned int rx_head;           //and not processed yet, from rx_head
+    unsigned int rx_tail;           //to rx_tail (free running counters)
+    unsigned char *tx;              //responses are built here in place
+    struct iovec pending[MAX_BATCH + GATEWAY_SLOTS];//responses not sent yet
+    int first_pending;
+    int num_pending;
+    unsigned int events;            //epoll events the connection is polled for
+    unsigned int generation;        //changes every time the slot is reused
+    struct server_state *server;
+    struct client_ip *ip;
+    struct token_bucket bucket;
+    bool ready;                     //in the ready list of the server
+    bool throttled;                 //the request at the head was delayed
+    int deficit;                    //requests it can still process this turn
+    unsigned long long wake_time;   //when a throttled connection can go on
+    struct gateway_request gateway[GATEWAY_SLOTS];
+    unsigned int gateway_busy;      //gateway slots forwarded or being sent
+    unsigned int gateway_sending;   //gateway slots being sent
+};
+
+//Forwarded requests are answered from the master thread. Their responses
+//are passed back to the server loop through this list and eventfd
+static struct gateway_request *gateway_done = NULL;
+static pthread_mutex_t gatewayDoneLock = PTHREAD_MUTEX_INITIALIZER;
+static int gateway_event_fd = -1;
+
+//-----------------------------------------------------------------------------
+// Copies size bytes of the receive ring, starting offset bytes after its
+// head, into dest
+//-----------------------------------------------------------------------------
+void ringCopy(struct connection *conn, unsigned int offset, unsigned char *dest, int size)
+{
+    unsigned int start = (conn->rx_head + offset) & (RX_BUFFER_SIZE - 1);
+    int first = RX_BUFFER_SIZE - start;
+    if (first > size) first = size;
+
+    memcpy(dest, conn->rx + start, first);
+    memcpy(dest + first, conn->rx, size - first);
+}
+
+//-----------------------------------------------------------------------------
+// Finds the size of the frame at the head of the receive ring from its
+// header: the MBAP length for Modbus/TCP and the encapsulation length for
+// ENIP. Returns 0 if the header isn't complete yet and -1 if the stream is
+// not valid
+//-----------------------------------------------------------------------------
+int frameSize(struct connection *conn, int protocol_type)
+{
+    unsigned char header[MBAP_HEADER_SIZE];
+    int available = conn->rx_tail - conn->rx_head;
+
+    if (protocol_type == MODBUS_PROTOCOL)
+    {
+        if (available < MBAP_HEADER_SIZE) return 0;
+        ringCopy(conn, 0, header, MBAP_HEADER_SIZE);
+
+        //protocol identifier must be 0, length counts unit id and PDU
+        int length = (header[4] << 8) | header[5];
+        if (header[2] != 0 || header[3] != 0 || length < 2 || length > MODBUS_MAX_ADU - 6)
+            return -1;
+        return 6 + length;
+    }
+    else if (protocol_type == ENIP_PROTOCOL)
+    {
+        if (available < 4) return 0;
+        ringCopy(conn, 0, header, 4);
+
+        int size = ENIP_HEADER_SIZE + (header[2] | (header[3] << 8));
+        if (size > NET_BUFFER_SIZE)
+            return -1;
+        return size;
+    }
+
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Closes a client connection and frees its slot
+//-----------------------------------------------------------------------------
+void closeConnection(int epoll_fd, struct connection *conn, int *num_connections)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->first_pending = 0;
+    conn->num_pending = 0;
+    conn->generation++;
+    conn->ip->connections--;
+
+    //gateway slots still forwarded are freed when their response comes back
+    conn->gateway_busy &= ~conn->gateway_sending;
+    conn->gateway_sending = 0;
+    (*num_connections)--;
+}
+
+//-----------------------------------------------------------------------------
+// Polls the connection for writing while part of a response is pending, and
+// for reading otherwise, unless its receive ring is full. Only touches epoll
+// when that changes
+//-----------------------------------------------------------------------------
+bool updateEvents(int epoll_fd, struct connection *conn)
+{
+    unsigned int events = 0;
+    if (conn->first_pending < conn->num_pending)
+        events = EPOLLOUT;
+    else if (conn->rx_tail - conn->rx_head < RX_BUFFER_SIZE)
+        events = EPOLLIN;
+
+    if (events == conn->events)
+        return true;
+    conn->events = events;
+
+    struct epoll_event event;
+    event.data.ptr = conn;
+    event.events = events;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) == 0;
+}
+
+//-----------------------------------------------------------------------------
+// Sends as much of the pending responses as the socket takes, straight from
+// the send buffer of the connection. Returns false if the connection failed.
+// While part of a batch is pending the connection is only polled for
+// writing, so requests are answered in order
+//-----------------------------------------------------------------------------
+bool flushConnection(int epoll_fd, struct connection *conn)
+{
+    //sendmsg() is writev() with MSG_NOSIGNAL, so a closed client can't
+    //raise SIGPIPE
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+
+    while (conn->first_pending < conn->num_pending)
+    {
+        msg.msg_iov = &conn->pending[conn->first_pending];
+        msg.msg_iovlen = conn->num_pending - conn->first_pending;
+
+        int n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else if (n <= 0)
+            return false;
+
+        //skip what was sent
+        while (n > 0)
+        {
+            struct iovec *iov = &conn->pending[conn->first_pending];
+            if (n < (int)iov->iov_len)
+            {
+                iov->iov_base = (unsigned char *)iov->iov_base + n;
+                iov->iov_len -= n;
+                n = 0;
+            }
+            else
+            {
+                n -= iov->iov_len;
+                conn->first_pending++;
+            }
+        }
+    }
+
+    bool pending = (conn->first_pending < conn->num_pending);
+    if (!pending)
+    {
+        conn->first_pending = 0;
+        conn->num_pending = 0;
+        conn->gateway_busy &= ~conn->gateway_sending;
+        conn->gateway_sending = 0;
+    }
+
+    return updateEvents(epoll_fd, conn);
+}
+
+//-----------------------------------------------------------------------------
+// Adds the tokens earned since the last refill, up to burst
+//-----------------------------------------------------------------------------
+void refillBucket(struct token_bucket *bucket, int rate, int burst, unsigned long long now)
+{
+    if (burst < 1) burst = (rate > 0) ? rate : 1;
+
+    bucket->tokens += (double)(now - bucket->last_refill) * rate / 1e9;
+    if (bucket->tokens > burst) bucket->tokens = burst;
+    bucket->last_refill = now;
+}
+
+//-----------------------------------------------------------------------------
+// Takes a token from the buckets of the connection and of its address for
+// one request. Returns 0 if the request can go now, or else the nanoseconds
+// until both buckets have a token
+//-----------------------------------------------------------------------------
+unsigned long long takeToken(struct connection *conn, unsigned long long now)
+{
+    struct rate_limits *limits = &conn->server->limits;
+    double wait = 0;
+
+    if (limits->client_rate > 0)
+    {
+        refillBucket(&conn->bucket, limits->client_rate, limits->client_burst, now);
+        if (conn->bucket.tokens < 1)
+            wait = (1 - conn->bucket.tokens) / limits->client_rate;
+    }
+    if (limits->ip_rate > 0)
+    {
+        refillBucket(&conn->ip->bucket, limits->ip_rate, limits->ip_burst, now);
+        if (conn->ip->bucket.tokens < 1 && (1 - conn->ip->bucket.tokens) / limits->ip_rate > wait)
+            wait = (1 - conn->ip->bucket.tokens) / limits->ip_rate;
+    }
+
+    if (wait > 0)
+        return (unsigned long long)(wait * 1e9) + 1;
+
+    if (limits->client_rate > 0) conn->bucket.tokens -= 1;
+    if (limits->ip_rate > 0) conn->ip->bucket.tokens -= 1;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Returns how many requests a connection can process per turn: one batch
+// for each unit of weight of its address
+//-----------------------------------------------------------------------------
+int turnQuantum(struct connection *conn)
+{
+    struct rate_limits *limits = &conn->server->limits;
+    for (int i = 0; i < limits->num_weights; i++)
+    {
+        if (limits->weight_addr[i] == conn->ip->addr)
+            return limits->weight[i] * MAX_BATCH;
+    }
+
+    return MAX_BATCH;
+}
+
+//-----------------------------------------------------------------------------
+// Puts the connection in the ready list, to get another turn once the
+// clients already there had theirs
+//-----------------------------------------------------------------------------
+void scheduleConnection(struct connection *conn)
+{
+    struct server_state *server = conn->server;
+    if (conn->ready)
+        return;
+
+    conn->ready = true;
+    server->ready[server->num_ready++] = conn;
+}
+
+//-----------------------------------------------------------------------------
+// Returns true if the receive ring has a complete frame at its head
+//-----------------------------------------------------------------------------
+bool frameReady(struct connection *conn, int protocol_type)
+{
+    int size = frameSize(conn, protocol_type);
+    return size != 0 && size <= (int)(conn->rx_tail - conn->rx_head);
+}
+
+//-----------------------------------------------------------------------------
+// Called from the master thread when a forwarded request has its response
+//-----------------------------------------------------------------------------
+void gatewayComplete(struct gateway_request *request)
+{
+    pthread_mutex_lock(&gatewayDoneLock);
+    request->next = gateway_done;
+    gateway_done = request;
+    pthread_mutex_unlock(&gatewayDoneLock);
+
+    uint64_t event = 1;
+    write(gateway_event_fd, &event, sizeof(event));
+}
+
+//-----------------------------------------------------------------------------
+// Forwards the request in frame to the gateway from a free gateway slot of
+// the connection. Returns false if the connection has no free slot.
+// Otherwise frame is replaced by the exception to send right away if the
+// request couldn't be queued, and *response_size is its size (0 if queued)
+//-----------------------------------------------------------------------------
+bool forwardRequest(struct connection *conn, unsigned char *frame, int size, int *response_size)
+{
+    int slot = 0;
+    while (slot < GATEWAY_SLOTS && (conn->gateway_busy & (1 << slot)))
+        slot++;
+    if (slot == GATEWAY_SLOTS)
+        return false;
+
+    struct gateway_request *request = &conn->gateway[slot];
+    request->adu = conn->tx + MAX_BATCH * MODBUS_SLOT_SIZE + slot * MODBUS_SLOT_SIZE;
+    request->size = size;
+    request->complete = gatewayComplete;
+    request->context = conn;
+    request->tag = conn->generation;
+    memcpy(request->adu, frame, size);
+
+    *response_size = 0;
+    conn->gateway_busy |= (1 << slot);
+    if (!forwardModbusRequest(request))
+    {
+        //gateway path unavailable
+        conn->gateway_busy &= ~(1 << slot);
+        frame[4] = 0;
+        frame[5] = 3;
+        frame[7] |= 0x80;
+        frame[8] = 10;
+        *response_size = 9;
+    }
+
+    return true;
+}
+
+bool serveConnection(int epoll_fd, struct connection *conn, int protocol_type);
+
+//-----------------------------------------------------------------------------
+// Queues the responses of the forwarded requests that came back to their
+// connections. Responses to connections closed meanwhile are dropped
+//-----------------------------------------------------------------------------
+void deliverGatewayResponses(int epoll_fd, int *num_connections)
+{
+    uint64_t events;
+    read(gateway_event_fd, &events, sizeof(events));
+
+    pthread_mutex_lock(&gatewayDoneLock);
+    struct gateway_request *request = gateway_done;
+    gateway_done = NULL;
+    pthread_mutex_unlock(&gatewayDoneLock);
+
+    while (request != NULL)
+    {
+        struct gateway_request *next = request->next;
+        struct connection *conn = (struct connection *)request->context;
+        unsigned int slot_bit = 1 << (request - conn->gateway);
+
+        if (conn->fd < 0 || request->tag != conn->generation)
+        {
+            conn->gateway_busy &= ~slot_bit;
+        }
+        else
+        {
+            conn->pending[conn->num_pending].iov_base = request->adu;
+            conn->pending[conn->num_pending].iov_len = request->size;
+            conn->num_pending++;
+            conn->gateway_sending |= slot_bit;
+
+            //requests held back for a free slot can go now
+            if (!flushConnection(epoll_fd, conn) || !serveConnection(epoll_fd, conn, MODBUS_PROTOCOL))
+                closeConnection(epoll_fd, conn, num_connections);
+        }
+
+        request = next;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Gives the connection its turn: adds its quantum to its deficit and
+// processes that many of the complete frames in the receive ring, one batch
+// at a time. Each request is copied into its own slot of
+// the send buffer, where it is turned into the response, and the responses
+// are sent together. Modbus requests to a gateway unit are forwarded
+// instead, and answered when the serial slave responds. Connections with
+// frames left at the end of the turn, or held back by the rate limits, go
+// to the ready list. Returns false if the connection must be closed
+//-----------------------------------------------------------------------------
+bool serveConnection(int epoll_fd, struct connection *conn, int protocol_type)
+{
+    struct server_state *server = conn->server;
+    int slot_size = (protocol_type == MODBUS_PROTOCOL) ? MODBUS_SLOT_SIZE : NET_BUFFER_SIZE;
+
+    //a connection in the ready list waits for its turn there
+    if (conn->ready)
+        return updateEvents(epoll_fd, conn);
+
+    int max_slots = NET_BUFFER_SIZE / slot_size;
+    if (max_slots > MAX_BATCH) max_slots = MAX_BATCH;
+
+    unsigned long long now = getTimeNs();
+    bool gateway_blocked = false;
+    int num_requests = 0;
+    int quantum = turnQuantum(conn);
+    conn->deficit += quantum;
+
+    while (conn->num_pending == 0 && !gateway_blocked && conn->wake_time <= now && num_requests < conn->deficit)
+    {
+        int num_responses = 0;
+        while (num_responses < max_slots && num_requests < conn->deficit)
+        {
+            int size = frameSize(conn, protocol_type);
+            if (size < 0)
+                return false;
+            if (size == 0 || size > (int)(conn->rx_tail - conn->rx_head))
+                break;
+
+            unsigned char *slot = conn->tx + num_responses * slot_size;
+            ringCopy(conn, 0, slot, size);
+
+            int response_size;
+            unsigned long long wait = takeToken(conn, now);
+            if (wait > 0 && (!server->limits.reply_busy || protocol_type != MODBUS_PROTOCOL))
+            {
+                //leave the frame in the ring until there is a token
+                if (!conn->throttled) server->stats->throttled++;
+                conn->throttled = true;
+                conn->wake_time = now + wait;
+                break;
+            }
+            else if (wait > 0)
+            {
+                //server busy
+                server->stats->dropped++;
+                slot[4] = 0;
+                slot[5] = 3;
+                slot[7] |= 0x80;
+                slot[8] = 6;
+                response_size = 9;
+            }
+            else if (protocol_type == MODBUS_PROTOCOL && isGatewayUnit(slot[6]))
+            {
+                //leave the frame in the ring until a gateway slot is free
+                if (!forwardRequest(conn, slot, size, &response_size))
+                {
+                    gateway_blocked = true;
+                    break;
+                }
+            }
+            else
+            {
+                response_size = processRequest(slot, size, protocol_type);
+            }
+            conn->rx_head += size;
+            conn->last_activity = now;
+            conn->throttled = false;
+            server->stats->requests++;
+            num_requests++;
+
+            if (response_size > 0)
+            {
+                conn->pending[num_responses].iov_base = slot;
+                conn->pending[num_responses].iov_len = response_size;
+                num_responses++;
+            }
+        }
+
+        if (num_responses == 0)
+            break;
+        conn->num_pending = num_responses;
+        if (!flushConnection(epoll_fd, conn))
+            return false;
+    }
+
+    //the unused deficit is kept only while frames are waiting, and never
+    //more than one quantum, so a connection can't save up turns
+    conn->deficit -= num_requests;
+    if (!frameReady(conn, protocol_type))
+        conn->deficit = 0;
+    else if (conn->deficit > quantum)
+        conn->deficit = quantum;
+
+    //a connection with a response pending goes on once it is sent, and one
+    //waiting for the gateway once a response comes back
+    if (conn->num_pending == 0 && !gateway_blocked && frameReady(conn, protocol_type))
+        scheduleConnection(conn);
+
+    return updateEvents(epoll_fd, conn);
+}
+
+//-----------------------------------------------------------------------------
+// Reads everything the socket has into the free space of the receive ring.
+// Returns the number of bytes read, 0 if the client closed the connection
+// and -1 on errors
+//-----------------------------------------------------------------------------
+int receiveData(struct connection *conn)
+{
+    int free_space = RX_BUFFER_SIZE - (conn->rx_tail - conn->rx_head);
+    unsigned int start = conn->rx_tail & (RX_BUFFER_SIZE - 1);
+    struct iovec iov[2];
+
+    //the ring is full of requests waiting for their turn
+    if (free_space == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    iov[0].iov_base = conn->rx + start;
+    iov[0].iov_len = (RX_BUFFER_SIZE - start < (unsigned int)free_space) ? RX_BUFFER_SIZE - start : free_space;
+    iov[1].iov_base = conn->rx;
+    iov[1].iov_len = free_space - iov[0].iov_len;
+
+    int n;
+    do
+    {
+        n = readv(conn->fd, iov, iov[1].iov_len > 0 ? 2 : 1);
+    } while (n < 0 && errno == EINTR);
+
+    if (n > 0)
+        conn->rx_tail += n;
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// Accepts every client waiting on the listening socket. Clients over the
+// connection limit are disconnected right away
+//-----------------------------------------------------------------------------
+void acceptClients(int epoll_fd, int socket_fd, struct server_state *server, struct connection *connections, int *num_connections)
+{
+    unsigned char log_msg[1000];
+    int max_connections = server->max_connections;
+
+    while (true)
+    {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_fd = accept4(socket_fd, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                sprintf(log_msg, "Server: Error accepting client! => %s\n", strerror(errno));
+                log(log_msg);
+            }
+            return;
+        }
+
+        struct connection *conn = NULL;
+        for (int i = 0; i < max_connections && conn == NULL; i++)
+        {
+            if (connections[i].fd < 0) conn = &connections[i];
+        }
+        if (conn == NULL)
+        {
+            server->stats->rejected++;
+            sprintf(log_msg, "Server: Connection limit of %d clients reached. Rejecting client ID: %d\n", max_connections, client_fd);
+            log(log_msg);
+            close(client_fd);
+            continue;
+        }
+
+        //connections from the same address share its bucket. There is
+        //always a free entry, since there are as many as connections
+        struct client_ip *ip = NULL;
+        struct client_ip *free_ip = NULL;
+        for (int i = 0; i < max_connections && ip == NULL; i++)
+        {
+            if (server->ips[i].connections == 0)
+            {
+                if (free_ip == NULL) free_ip = &server->ips[i];
+            }
+            else if (server->ips[i].addr == client_addr.sin_addr.s_addr)
+                ip = &server->ips[i];
+        }
+        unsigned long long now = getTimeNs();
+        if (ip == NULL)
+        {
+            ip = free_ip;
+            ip->addr = client_addr.sin_addr.s_addr;
+            ip->bucket.tokens = (server->limits.ip_burst > 0) ? server->limits.ip_burst : server->limits.ip_rate;
+            ip->bucket.last_refill = now;
+        }
+
+        int enable = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        conn->fd = client_fd;
+        conn->last_activity = now;
+        conn->rx_head = 0;
+        conn->rx_tail = 0;
+        conn->first_pending = 0;
+        conn->num_pending = 0;
+        conn->events = EPOLLIN;
+        conn->server = server;
+        conn->ip = ip;
+        conn->bucket.tokens = (server->limits.client_burst > 0) ? server->limits.client_burst : server->limits.client_rate;
+        conn->bucket.last_refill = now;
+        conn->throttled = false;
+        conn->deficit = 0;
+        conn->wake_time = 0;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) < 0)
+        {
+            close(client_fd);
+            conn->fd = -1;
+            continue;
+        }
+
+        ip->connections++;
+        server->stats->accepted++;
+        (*num_connections)++;
+        sprintf(log_msg, "Server: Client accepted! Client ID: %d (%d connected)\n", client_fd, *num_connections);
+        log(log_msg);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reads the rate limits and the turn weights of the protocol from the
+// runtime config
+//-----------------------------------------------------------------------------
+void loadRateLimits(struct rate_limits *limits, const char *protocol_name)
+{
+    char key[100];
+    char action[20] = "";
+
+    sprintf(key, "%s_client_rate", protocol_name);
+    limits->client_rate = getConfigInt(key, 0);
+    sprintf(key, "%s_client_burst", protocol_name);
+    limits->client_burst = getConfigInt(key, 0);
+    sprintf(key, "%s_ip_rate", protocol_name);
+    limits->ip_rate = getConfigInt(key, 0);
+    sprintf(key, "%s_ip_burst", protocol_name);
+    limits->ip_burst = getConfigInt(key, 0);
+    sprintf(key, "%s_rate_limit_action", protocol_name);
+    getConfigString(key, action, sizeof(action));
+    limits->reply_busy = !strcmp(action, "busy");
+
+    //turn weights, a list such as "10.0.0.5:4, 10.0.0.6:2"
+    char list[1000] = "";
+    sprintf(key, "%s_client_weights", protocol_name);
+    getConfigString(key, list, sizeof(list));
+    limits->num_weights = 0;
+    const char *c = list;
+    while (*c != '\0' && limits->num_weights < MAX_CLIENT_WEIGHTS)
+    {
+        while (*c == ' ' || *c == ',') c++;
+        const char *end = c;
+        while (*end != '\0' && *end != ' ' && *end != ',') end++;
+        if (end == c)
+            break;
+
+        char entry[64];
+        int len = (end - c < (int)sizeof(entry)) ? end - c : sizeof(entry) - 1;
+        memcpy(entry, c, len);
+        entry[len] = '\0';
+        c = end;
+
+        char *weight = strchr(entry, ':');
+        if (weight != NULL) *weight++ = '\0';
+        int value = (weight != NULL) ? atoi(weight) : 0;
+        struct in_addr addr;
+        if (inet_pton(AF_INET, entry, &addr) != 1 || value < 1)
+            continue;
+
+        limits->weight_addr[limits->num_weights] = addr.s_addr;
+        limits->weight[limits->num_weights] = (value > MAX_CLIENT_WEIGHT) ? MAX_CLIENT_WEIGHT : value;
+        limits->num_weights++;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Gives every connection in the ready list one more turn. Returns the epoll
+// timeout in milliseconds until the next turn is due
+//-----------------------------------------------------------------------------
+int serveReadyConnections(int epoll_fd, struct server_state *server, int protocol_type, int *num_connections)
+{
+    unsigned char log_msg[1000];
+    unsigned long long now = getTimeNs();
+
+    //connections that get another turn go to the other list
+    struct connection **turn = server->ready;
+    int num_turns = server->num_ready;
+    server->ready = server->turn;
+    server->turn = turn;
+    server->num_ready = 0;
+
+    //connections still waiting for tokens keep their place ahead of the
+    //ones that just had their turn, so clients sharing an address take turns
+    int num_waiting = 0;
+    for (int i = 0; i < num_turns; i++)
+    {
+        struct connection *conn = turn[i];
+        conn->ready = false;
+        if (conn->fd < 0)
+            continue;
+
+        if (conn->wake_time > now)
+        {
+            conn->ready = true;
+            turn[num_waiting++] = conn;
+            continue;
+        }
+
+        unsigned long long requests = server->stats->requests;
+        if (!serveConnection(epoll_fd, conn, protocol_type))
+        {
+            sprintf(log_msg, "Server: Invalid frame from client ID: %d. Closing connection\n", conn->fd);
+            log(log_msg);
+            closeConnection(epoll_fd, conn, num_connections);
+        }
+        else if (conn->ready && conn->throttled && server->stats->requests == requests)
+        {
+            //it was the last one scheduled
+            server->num_ready--;
+            turn[num_waiting++] = conn;
+        }
+    }
+    if (num_waiting > 0)
+    {
+        memmove(server->ready + num_waiting, server->ready, server->num_ready * sizeof(struct connection *));
+        memcpy(server->ready, turn, num_waiting * sizeof(struct connection *));
+        server->num_ready += num_waiting;
+    }
+
+    //wake up periodically to see if the server was stopped
+    unsigned long long timeout = 100000000ULL;
+    now = getTimeNs();
+    for (int i = 0; i < server->num_ready; i++)
+    {
+        struct connection *conn = server->ready[i];
+        if (conn->wake_time <= now)
+            return 0;
+        if (conn->wake_time - now < timeout)
+            timeout = conn->wake_time - now;
+    }
+
+    return (int)((timeout + 999999) / 1000000);
+}
+
+//-----------------------------------------------------------------------------
+// Function to start the server. It receives the port number as argument and
+// creates an infinite loop to listen and parse the messages sent by the
+// clients. The connection limit, the idle timeout (in seconds, 0 for no
+// timeout) and the rate limits of each protocol come from runtime.cfg. All
+// but the connection limit are read again every second
+//-----------------------------------------------------------------------------
+void startServer(uint16_t port, int protocol_type)
+{
+    unsigned char log_msg[1000];
+    struct epoll_event events[MAX_EVENTS];
+    bool *run_server;
+    const char *protocol_name;
+    char key[100];
+
+    if (protocol_type == MODBUS_PROTOCOL)
+    {
+        run_server = &run_modbus;
+        protocol_name = "modbus";
+    }
+    else if (protocol_type == ENIP_PROTOCOL)
+    {
+        run_server = &run_enip;
+        protocol_name = "enip";
+    }
+    else
+        return;
+
+    sprintf(key, "%s_max_connections", protocol_name);
+    int max_connections = getConfigInt(key, DEFAULT_MAX_CONNECTIONS);
+    if (max_connections < 1) max_connections = 1;
+    sprintf(key, "%s_idle_timeout", protocol_name);
+    unsigned long long idle_timeout = (unsigned long long)getConfigInt(key, 0) * 1000000000ULL;
+
+    struct server_state server;
+    memset(&server, 0, sizeof(server));
+    loadRateLimits(&server.limits, protocol_name);
+    server.stats = &server_stats[protocol_type];
+    server.max_connections = max_connections;
+
+    int socket_fd = createSocket(port);
+    if (socket_fd < 0)
+        return;
+
+    //the buffers of every connection are allocated up front, so serving
+    //clients doesn't allocate memory
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct connection *connections = (struct connection *)calloc(max_connections, sizeof(struct connection));
+    unsigned char *buffers = (unsigned char *)malloc((size_t)max_connections * (RX_BUFFER_SIZE + NET_BUFFER_SIZE));
+    server.ips = (struct client_ip *)calloc(max_connections, sizeof(struct client_ip));
+    struct connection **ready_lists = (struct connection **)calloc(2 * max_connections, sizeof(struct connection *));
+    server.ready = ready_lists;
+    server.turn = ready_lists + max_connections;
+    if (epoll_fd < 0 || connections == NULL || buffers == NULL || server.ips == NULL || ready_lists == NULL)
+    {
+        sprintf(log_msg, "Server: error creating the event loop => %s\n", strerror(errno));
+        log(log_msg);
+        close(socket_fd);
+        if (epoll_fd >= 0) close(epoll_fd);
+        free(connections);
+        free(buffers);
+        free(server.ips);
+        free(ready_lists);
+        return;
+    }
+    for (int i = 0; i < max_connections; i++)
+    {
+        connections[i].fd = -1;
+        connections[i].rx = buffers + (size_t)i * (RX_BUFFER_SIZE + NET_BUFFER_SIZE);
+        connections[i].tx = connections[i].rx + RX_BUFFER_SIZE;
+    }
+    int num_connections = 0;
+
+    //the listening socket is the only one without a connection
+    struct epoll_event listen_event;
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &listen_event);
+
+    //responses from the Modbus gateway wake the loop through an eventfd
+    if (protocol_type == MODBUS_PROTOCOL)
+    {
+        gateway_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event gateway_event;
+        gateway_event.events = EPOLLIN;
+        gateway_event.data.ptr = &gateway_event_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, gateway_event_fd, &gateway_event);
+    }
+
+    unsigned long long last_config_check = getTimeNs();
+    int timeout = 100;
+    while (*run_server)
+    {
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        if (num_events < 0 && errno != EINTR)
+        {
+            sprintf(log_msg, "Server: error waiting for events => %s\n", strerror(errno));
+            log(log_msg);
+            break;
+        }
+
+        for (int i = 0; i < num_events; i++)
+        {
+            struct connection *conn = (struct connection *)events[i].data.ptr;
+            if (conn == NULL)
+            {
+                acceptClients(epoll_fd, socket_fd, &server, connections, &num_connections);
+                continue;
+            }
+            if (events[i].data.ptr == &gateway_event_fd)
+            {
+                deliverGatewayResponses(epoll_fd, &num_connections);
+                continue;
+            }
+
+            //a client that hung up while its requests wait for their turn
+            if (conn->events == 0 && (events[i].events & (EPOLLHUP | EPOLLERR)))
+            {
+                closeConnection(epoll_fd, conn, &num_connections);
+                continue;
+            }
+
+            //once a pending batch is sent, carry on with the frames behind it
+            if (events[i].events & EPOLLOUT)
+            {
+                if (!flushConnection(epoll_fd, conn) || !serveConnection(epoll_fd, conn, protocol_type))
+                    closeConnection(epoll_fd, conn, &num_connections);
+                continue;
+            }
+
+            int messageSize = receiveData(conn);
+            if (messageSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                continue;
+            if (messageSize <= 0)
+            {
+                // something has gone wrong or the client has closed connection
+                if (messageSize == 0)
+                    sprintf(log_msg, "Server: client ID: %d has closed the connection\n", conn->fd);
+                else
+                    sprintf(log_msg, "Server: Something is wrong with the client ID: %d => %s\n", conn->fd, strerror(errno));
+                log(log_msg);
+                closeConnection(epoll_fd, conn, &num_connections);
+                continue;
+            }
+
+            conn->last_activity = getTimeNs();
+            if (!serveConnection(epoll_fd, conn, protocol_type))
+            {
+                sprintf(log_msg, "Server: Invalid frame from client ID: %d. Closing connection\n", conn->fd);
+                log(log_msg);
+                closeConnection(epoll_fd, conn, &num_connections);
+            }
+        }
+
+        timeout = serveReadyConnections(epoll_fd, &server, protocol_type, &num_connections);
+
+        //pick up changes to the limits, and drop clients that have been
+        //quiet for too long
+        unsigned long long now = getTimeNs();
+        if (now - last_config_check > 1000000000ULL)
+        {
+            last_config_check = now;
+            loadRateLimits(&server.limits, protocol_name);
+            sprintf(key, "%s_idle_timeout", protocol_name);
+            idle_timeout = (unsigned long long)getConfigInt(key, 0) * 1000000000ULL;
+
+            //clients with requests waiting for their turn or for a token are
+            //not idle, however long they have been waiting
+            for (int i = 0; i < max_connections && idle_timeout > 0; i++)
+            {
+                if (connections[i].fd >= 0 && !connections[i].ready && !connections[i].throttled &&
+                    now - connections[i].last_activity > idle_timeout)
+                {
+                    sprintf(log_msg, "Server: client ID: %d was idle for too long. Closing connection\n", connections[i].fd);
+                    log(log_msg);
+                    closeConnection(epoll_fd, &connections[i], &num_connections);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < max_connections; i++)
+    {
+        if (connections[i].fd >= 0)
+            closeConnection(epoll_fd, &connections[i], &num_connections);
+    }
+
+    //the gateway must be done with the buffers before they are freed
+    if (protocol_type == MODBUS_PROTOCOL)
+    {
+        cancelModbusRequests(gatewayComplete);
+        gateway_done = NULL;
+        close(gateway_event_fd);
+        gateway_event_fd = -1;
+    }
+    free(connections);
+    free(buffers);
+    free(server.ips);
+    free(ready_lists);
+    close(epoll_fd);
+    close(socket_fd);
+    sprintf(log_msg, "Terminating Server thread\r\n");
+    log(log_msg);
+}
+
+#else
 //-----------------------------------------------------------------------------
 // Blocking call. Wait here for the client to connect. Returns the file
 // descriptor to communicate with the client.
@@ -163,33 +1224,13 @@ int waitForClient(int socket_fd, int protocol_type)
     return client_fd;
 }
 
-//-----------------------------------------------------------------------------
-// Blocking call. Holds here until something is received from the client.
-// Once the message is received, it is stored on the buffer and the function
-// returns the number of bytes received.
-//-----------------------------------------------------------------------------
-int listenToClient(int client_fd, unsigned char *buffer)
-{
-    bzero(buffer, NET_BUFFER_SIZE);
-    int n = read(client_fd, buffer, NET_BUFFER_SIZE);
-    return n;
-}
-
 //-----------------------------------------------------------------------------
 // Process client's request
 //-----------------------------------------------------------------------------
 void processMessage(unsigned char *buffer, int bufferSize, int client_fd, int protocol_type)
 {
-    if (protocol_type == MODBUS_PROTOCOL)
-    {
-        int messageSize = processModbusMessage(buffer, bufferSize);
-        write(client_fd, buffer, messageSize);
-    }
-    else if (protocol_type == ENIP_PROTOCOL)
-    {
-        int messageSize = processEnipMessage(buffer, bufferSize);
-        write(client_fd, buffer, messageSize);
-    }
+    int messageSize = processRequest(buffer, bufferSize, protocol_type);
+    write(client_fd, buffer, messageSize);
 }
 
 //-----------------------------------------------------------------------------
@@ -294,4 +1335,205 @@ void startServer(uint16_t port, int protocol_type)
     close(client_fd);
     sprintf(log_msg, "Terminating Server thread\r\n");
     log(log_msg);
-}
\ No newline at end of file
+}
+#endif
+
+#ifdef __linux__
+//-----------------------------------------------------------------------------
+// Parses a list of addresses such as "239.0.0.1:5020, 10.0.0.5:5020" into
+// targets. Returns the number of addresses parsed
+//-----------------------------------------------------------------------------
+int parsePublishTargets(const char *list, struct sockaddr_in *targets, int max_targets)
+{
+    unsigned char log_msg[1000];
+    int num_targets = 0;
+    const char *c = list;
+
+    while (*c != '\0' && num_targets < max_targets)
+    {
+        while (*c == ' ' || *c == ',') c++;
+        const char *end = c;
+        while (*end != '\0' && *end != ' ' && *end != ',') end++;
+        if (end == c)
+            break;
+
+        char target[64];
+        int len = (end - c < (int)sizeof(target)) ? end - c : sizeof(target) - 1;
+        memcpy(target, c, len);
+        target[len] = '\0';
+        c = end;
+
+        char *port = strchr(target, ':');
+        if (port != NULL) *port++ = '\0';
+
+        struct sockaddr_in *addr = &targets[num_targets];
+        memset(addr, 0, sizeof(*addr));
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port != NULL ? atoi(port) : 502);
+        if (inet_pton(AF_INET, target, &addr->sin_addr) != 1 || addr->sin_port == 0)
+        {
+            sprintf(log_msg, "Modbus/UDP: invalid publish target %s\n", target);
+            log(log_msg);
+            continue;
+        }
+        num_targets++;
+    }
+
+    return num_targets;
+}
+
+//-----------------------------------------------------------------------------
+// Serves Modbus/UDP, where each datagram carries one request with its MBAP
+// header and is answered to the address it came from, and publishes a block
+// of holding registers to a list of unicast or multicast addresses after
+// every scan cycle. Requests and publications are received and sent in
+// batches with recvmmsg() and sendmmsg(). The settings come from
+// runtime.cfg when the server starts
+//-----------------------------------------------------------------------------
+void startUdpServer()
+{
+    unsigned char log_msg[1000];
+    char target_list[1000] = "";
+
+    int port = getConfigInt("modbus_udp_port", 0);
+    getConfigString("modbus_publish_targets", target_list, sizeof(target_list));
+    int publish_start = getConfigInt("modbus_publish_start", 0);
+    int publish_count = getConfigInt("modbus_publish_count", 0);
+    int publish_ttl = getConfigInt("modbus_publish_ttl", 1);
+
+    struct sockaddr_in targets[MAX_PUBLISH_TARGETS];
+    int num_targets = parsePublishTargets(target_list, targets, MAX_PUBLISH_TARGETS);
+
+    unsigned char publish_buffer[MODBUS_SLOT_SIZE];
+    if (num_targets > 0 && buildRegisterPublish(publish_buffer, publish_start, publish_count, 0) == 0)
+    {
+        sprintf(log_msg, "Modbus/UDP: invalid publish block of %d registers at %d\n", publish_count, publish_start);
+        log(log_msg);
+        num_targets = 0;
+    }
+    if (port <= 0 && num_targets == 0)
+        return;
+
+    int socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0)
+    {
+        sprintf(log_msg, "Modbus/UDP: error creating socket => %s\n", strerror(errno));
+        log(log_msg);
+        return;
+    }
+    if (port > 0)
+    {
+        int enable = 1;
+        setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        struct sockaddr_in server_addr;
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(port);
+        if (bind(socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+        {
+            sprintf(log_msg, "Modbus/UDP: error binding socket => %s\n", strerror(errno));
+            log(log_msg);
+            close(socket_fd);
+            return;
+        }
+        sprintf(log_msg, "Modbus/UDP: Listening on port %d\n", port);
+        log(log_msg);
+    }
+
+    //every publication goes out in one sendmmsg() to all the targets
+    struct iovec publish_iov = {publish_buffer, 0};
+    struct mmsghdr publish_msgs[MAX_PUBLISH_TARGETS];
+    memset(publish_msgs, 0, sizeof(publish_msgs));
+    for (int i = 0; i < num_targets; i++)
+    {
+        publish_msgs[i].msg_hdr.msg_name = &targets[i];
+        publish_msgs[i].msg_hdr.msg_namelen = sizeof(targets[i]);
+        publish_msgs[i].msg_hdr.msg_iov = &publish_iov;
+        publish_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int event_fd = -1;
+    if (num_targets > 0)
+    {
+        unsigned char ttl = publish_ttl;
+        setsockopt(socket_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        event_fd = imagePublishedEvent();
+        sprintf(log_msg, "Modbus/UDP: Publishing %d registers at %d to %d targets\n", publish_count, publish_start, num_targets);
+        log(log_msg);
+    }
+
+    //requests are processed in place, each in its own slot
+    unsigned char buffers[MAX_BATCH][MODBUS_SLOT_SIZE];
+    struct sockaddr_in sources[MAX_BATCH];
+    struct iovec iov[MAX_BATCH];
+    struct mmsghdr msgs[MAX_BATCH];
+    struct mmsghdr responses[MAX_BATCH];
+    uint16_t sequence = 0;
+
+    while (run_modbus_udp)
+    {
+        //wake up periodically to see if the server was stopped
+        struct pollfd fds[2] = {{socket_fd, POLLIN, 0}, {event_fd, POLLIN, 0}};
+        if (poll(fds, (event_fd >= 0) ? 2 : 1, 100) < 0 && errno != EINTR)
+            break;
+
+        if (event_fd >= 0 && (fds[1].revents & POLLIN))
+        {
+            uint64_t scans;
+            read(event_fd, &scans, sizeof(scans));
+
+            publish_iov.iov_len = buildRegisterPublish(publish_buffer, publish_start, publish_count, sequence++);
+            if (publish_iov.iov_len > 0)
+                sendmmsg(socket_fd, publish_msgs, num_targets, 0);
+        }
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        for (int i = 0; i < MAX_BATCH; i++)
+        {
+            iov[i].iov_base = buffers[i];
+            iov[i].iov_len = MODBUS_MAX_ADU;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = &sources[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int num_msgs = recvmmsg(socket_fd, msgs, MAX_BATCH, MSG_DONTWAIT, NULL);
+        int num_responses = 0;
+        for (int i = 0; i < num_msgs; i++)
+        {
+            //drop datagrams that are not exactly one request
+            unsigned char *request = buffers[i];
+            int size = msgs[i].msg_len;
+            if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) || size < MBAP_HEADER_SIZE + 1 ||
+                request[2] != 0 || request[3] != 0 || ((request[4] << 8) | request[5]) != size - 6)
+                continue;
+
+            int response_size = processModbusMessage(request, size);
+            if (response_size > 0)
+            {
+                iov[i].iov_len = response_size;
+                responses[num_responses++] = msgs[i];
+            }
+        }
+        if (num_responses > 0)
+            sendmmsg(socket_fd, responses, num_responses, 0);
+    }
+
+    close(socket_fd);
+    sprintf(log_msg, "Terminating Modbus/UDP thread\r\n");
+    log(log_msg);
+}
+
+#else
+void startUdpServer()
+{
+    unsigned char log_msg[1000];
+    sprintf(log_msg, "Modbus/UDP: only supported on Linux\n");
+    log(log_msg);
+}
+#endif
@@ -0,0 +1,747 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file implements the multitask scheduler. Each periodic IEC TASK runs
+// on its own real-time thread at the interval and priority declared in the
+// program, while the main loop keeps doing the I/O and runs the programs
+// without a task. The I/O side works on its own copy of the located
+// variables: a task copies them in, runs without any lock and copies back
+// only what it changed, so bufferLock is held for the copies alone. SINGLE
+// tasks sleep on an eventfd. Their trigger is only evaluated when the input
+// variable changes, and a protocol write to the input wakes the task without
+// waiting for the next scan. Enabled with task_scheduler = multitask in runtime.cfg
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "ladder.h"
+
+#define MAX_TASKS               32
+
+#define LOCATED_INPUT           0
+#define LOCATED_OUTPUT          1
+#define LOCATED_MEMORY          2
+
+struct plc_task
+{
+    int index;
+    const char *name;
+    unsigned long long interval;
+    int priority;
+    int rt_priority;
+    pthread_t thread;
+    bool started;
+    int event_fd;
+    IEC_BOOL *input;
+    IEC_BOOL last_input;
+    uint64_t *entry_values;
+    std::atomic<uint64_t> trigger_time;
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint64_t> last_exec;
+    std::atomic<uint64_t> max_exec;
+    std::atomic<uint64_t> last_latency;
+    std::atomic<uint64_t> max_latency;
+};
+
+static struct plc_task plc_tasks[MAX_TASKS];
+static int num_plc_tasks = 0;
+static int task_priority_base = 29;
+static std::atomic<bool> run_tasks(false);
+static bool has_event_tasks = false;
+
+//A located variable of the program and the slot the pointer tables hold for
+//it while the scheduler runs
+struct located_var
+{
+    void *program;
+    uint64_t *image;
+    uint8_t size;
+    uint8_t kind;
+    bool task_input;
+};
+
+//Pointer tables as they were before the located variables were split off
+struct pointer_tables
+{
+    IEC_BOOL *bool_input[BUFFER_SIZE][8];
+    IEC_BOOL *bool_output[BUFFER_SIZE][8];
+    IEC_BYTE *byte_input[BUFFER_SIZE];
+    IEC_BYTE *byte_output[BUFFER_SIZE];
+    IEC_UINT *int_input[BUFFER_SIZE];
+    IEC_UINT *int_output[BUFFER_SIZE];
+    IEC_UINT *int_memory[BUFFER_SIZE];
+    IEC_DINT *dint_memory[BUFFER_SIZE];
+    IEC_LINT *lint_memory[BUFFER_SIZE];
+};
+
+static struct located_var *located_vars = NULL;
+static uint64_t *located_image = NULL;
+static uint64_t *located_synced = NULL; //image value at the last copy
+static uint64_t *background_entry = NULL;
+static int num_located_vars = 0;
+static uint8_t task_input_coils[BUFFER_SIZE]; //coils that are the input of a SINGLE task
+static bool unlocated_inputs = false; //some SINGLE input is not a located variable
+
+#ifdef __linux__
+//The task functions are only present in programs generated by a MatIEC
+//that supports them. Weak references let older programs still link
+extern int config_task_count__(void) __attribute__((weak));
+extern int config_task_info__(int task, const char **name, unsigned long long *interval, int *priority) __attribute__((weak));
+extern void config_run_task__(int task, unsigned long tick) __attribute__((weak));
+extern int config_task_trigger__(int task) __attribute__((weak));
+extern IEC_BOOL *config_task_input__(int task) __attribute__((weak));
+
+//-----------------------------------------------------------------------------
+// Moves one position of the pointer tables to a slot of the located image if
+// glueVars() set it, or puts back what was there before otherwise. With
+// located_vars still NULL it only counts the located positions
+//-----------------------------------------------------------------------------
+template <typename T>
+static void splitPosition(T **pointer, T *saved, uint8_t kind)
+{
+    if (*pointer == NULL)
+    {
+        *pointer = saved;
+        return;
+    }
+
+    if (located_vars != NULL)
+    {
+        struct located_var *var = &located_vars[num_located_vars];
+        var->program = *pointer;
+        var->image = &located_image[num_located_vars];
+        var->size = sizeof(T);
+        var->kind = kind;
+        memcpy(var->image, var->program, sizeof(T));
+        located_synced[num_located_vars] = *var->image;
+        *pointer = (T *)var->image;
+    }
+    num_located_vars++;
+}
+
+//-----------------------------------------------------------------------------
+// Runs splitPosition() over every position of the pointer tables
+//-----------------------------------------------------------------------------
+static void splitPointerTables(struct pointer_tables *saved)
+{
+    num_located_vars = 0;
+    for (int i = 0; i < BUFFER_SIZE; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            splitPosition(&bool_input[i][j], saved->bool_input[i][j], LOCATED_INPUT);
+            splitPosition(&bool_output[i][j], saved->bool_output[i][j], LOCATED_OUTPUT);
+        }
+        splitPosition(&byte_input[i], saved->byte_input[i], LOCATED_INPUT);
+        splitPosition(&byte_output[i], saved->byte_output[i], LOCATED_OUTPUT);
+        splitPosition(&int_input[i], saved->int_input[i], LOCATED_INPUT);
+        splitPosition(&int_output[i], saved->int_output[i], LOCATED_OUTPUT);
+        splitPosition(&int_memory[i], saved->int_memory[i], LOCATED_MEMORY);
+        splitPosition(&dint_memory[i], saved->dint_memory[i], LOCATED_MEMORY);
+        splitPosition(&lint_memory[i], saved->lint_memory[i], LOCATED_MEMORY);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Gives the I/O side its own copy of the located variables. From here on the
+// pointer tables point to located_image, which the scan, the protocols and
+// the slave devices use under bufferLock, while the programs keep working on
+// their variables. The tables also hold positions the protocols mapped to
+// their own buffers, so glueVars() is run on empty tables to tell the
+// located ones apart. Must be called with bufferLock held
+//-----------------------------------------------------------------------------
+static bool splitLocatedVariables()
+{
+    struct pointer_tables *saved = (struct pointer_tables *)malloc(sizeof(struct pointer_tables));
+    if (saved == NULL)
+        return false;
+
+    memcpy(saved->bool_input, bool_input, sizeof(saved->bool_input));
+    memcpy(saved->bool_output, bool_output, sizeof(saved->bool_output));
+    memcpy(saved->byte_input, byte_input, sizeof(saved->byte_input));
+    memcpy(saved->byte_output, byte_output, sizeof(saved->byte_output));
+    memcpy(saved->int_input, int_input, sizeof(saved->int_input));
+    memcpy(saved->int_output, int_output, sizeof(saved->int_output));
+    memcpy(saved->int_memory, int_memory, sizeof(saved->int_memory));
+    memcpy(saved->dint_memory, dint_memory, sizeof(saved->dint_memory));
+    memcpy(saved->lint_memory, lint_memory, sizeof(saved->lint_memory));
+
+    //first pass counts the located positions, the second one moves them
+    for (int pass = 0; pass < 2; pass++)
+    {
+        memset(bool_input, 0, sizeof(saved->bool_input));
+        memset(bool_output, 0, sizeof(saved->bool_output));
+        memset(byte_input, 0, sizeof(saved->byte_input));
+        memset(byte_output, 0, sizeof(saved->byte_output));
+        memset(int_input, 0, sizeof(saved->int_input));
+        memset(int_output, 0, sizeof(saved->int_output));
+        memset(int_memory, 0, sizeof(saved->int_memory));
+        memset(dint_memory, 0, sizeof(saved->dint_memory));
+        memset(lint_memory, 0, sizeof(saved->lint_memory));
+        glueVars();
+
+        if (pass == 1)
+        {
+            located_vars = (struct located_var *)calloc(num_located_vars + 1, sizeof(struct located_var));
+            located_image = (uint64_t *)calloc(num_located_vars + 1, sizeof(uint64_t));
+            located_synced = (uint64_t *)calloc(num_located_vars + 1, sizeof(uint64_t));
+            background_entry = (uint64_t *)calloc(num_located_vars + 1, sizeof(uint64_t));
+            if (located_vars == NULL || located_image == NULL || located_synced == NULL || background_entry == NULL)
+            {
+                free(located_vars);
+                free(located_image);
+                free(located_synced);
+                free(background_entry);
+                located_vars = NULL;
+            }
+        }
+        splitPointerTables(saved);
+    }
+
+    free(saved);
+    if (located_vars == NULL)
+        return false;
+
+    mapProcessImage();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Returns true once the pointer tables point to the located image of the task
+// scheduler instead of the program variables
+//-----------------------------------------------------------------------------
+bool taskImagesActive()
+{
+    return located_vars != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Copies one located variable from the image into the program variables.
+// Inputs are always copied. Outputs and memory only if the I/O side changed
+// them since the last copy, so a value written by another task is not lost.
+// Returns true if the variable is the input of a SINGLE task and changed
+//-----------------------------------------------------------------------------
+static bool copyLocatedIn(int k)
+{
+    struct located_var *var = &located_vars[k];
+    if (var->kind != LOCATED_INPUT && *var->image == located_synced[k])
+        return false;
+
+    bool changed = var->task_input && memcmp(var->program, var->image, var->size);
+    memcpy(var->program, var->image, var->size);
+    located_synced[k] = *var->image;
+    return changed;
+}
+
+//-----------------------------------------------------------------------------
+// Copies the located image into the program variables before a task cycle.
+// entry keeps what the task started with. Returns true if the input of a
+// SINGLE task changed. Must be called with bufferLock held
+//-----------------------------------------------------------------------------
+static bool copyTaskImageIn(uint64_t *entry)
+{
+    bool inputs_changed = false;
+
+    for (int k = 0; k < num_located_vars; k++)
+    {
+        struct located_var *var = &located_vars[k];
+        if (copyLocatedIn(k))
+            inputs_changed = true;
+
+        if (var->kind != LOCATED_INPUT)
+        {
+            entry[k] = 0;
+            memcpy(&entry[k], var->program, var->size);
+        }
+    }
+
+    return inputs_changed;
+}
+
+//-----------------------------------------------------------------------------
+// Copies the outputs and memory a task changed back into the located image.
+// Outputs stay where they are while the watchdog has them disabled. Returns
+// true if the task changed the input of a SINGLE task, or may have changed
+// one that is not located. Must be called with bufferLock held
+//-----------------------------------------------------------------------------
+static bool copyTaskImageOut(uint64_t *entry)
+{
+    bool outputs_disabled = watchdog_tripped;
+    bool inputs_changed = unlocated_inputs;
+
+    for (int k = 0; k < num_located_vars; k++)
+    {
+        struct located_var *var = &located_vars[k];
+        if (var->kind == LOCATED_INPUT)
+            continue;
+
+        uint64_t value = 0;
+        memcpy(&value, var->program, var->size);
+        if (value == entry[k])
+            continue;
+
+        if (var->task_input)
+            inputs_changed = true;
+        if (var->kind == LOCATED_OUTPUT && outputs_disabled)
+            continue;
+
+        *var->image = value;
+        located_synced[k] = value;
+    }
+
+    return inputs_changed;
+}
+
+//-----------------------------------------------------------------------------
+// Finds the located variable and the coil of the SINGLE input of every event
+// task, so that only changes to them are checked
+//-----------------------------------------------------------------------------
+static void findTaskInputs()
+{
+    memset(task_input_coils, 0, sizeof(task_input_coils));
+    unlocated_inputs = false;
+
+    for (int i = 0; i < num_plc_tasks; i++)
+    {
+        struct plc_task *task = &plc_tasks[i];
+        if (task->event_fd < 0)
+            continue;
+
+        int k = 0;
+        while (k < num_located_vars && (task->input == NULL || located_vars[k].program != task->input))
+            k++;
+        if (k == num_located_vars)
+        {
+            unlocated_inputs = true;
+            continue;
+        }
+
+        located_vars[k].task_input = true;
+        for (int b = 0; b < BUFFER_SIZE * 8; b++)
+        {
+            if (bool_output[b/8][b%8] == (IEC_BOOL *)located_vars[k].image)
+                task_input_coils[b/8] |= 1 << (b%8);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Runs one cycle of a task and updates its counters. latency is the time
+// between when the task should have started and when it did
+//-----------------------------------------------------------------------------
+void runTaskCycle(struct plc_task *task, unsigned long tick, unsigned long long latency)
+{
+    task->last_latency.store(latency, std::memory_order_relaxed);
+    if (latency > task->max_latency.load(std::memory_order_relaxed))
+        task->max_latency.store(latency, std::memory_order_relaxed);
+
+    PLC_LOCK(&bufferLock);
+    if (copyTaskImageIn(task->entry_values))
+        checkTaskEvents();
+    PLC_UNLOCK(&bufferLock);
+
+    unsigned long long exec_start = getTimeNs();
+    config_run_task__(task->index, tick);
+    unsigned long long exec_time = getTimeNs() - exec_start;
+
+    task->last_exec.store(exec_time, std::memory_order_relaxed);
+    if (exec_time > task->max_exec.load(std::memory_order_relaxed))
+        task->max_exec.store(exec_time, std::memory_order_relaxed);
+    task->cycles.store(task->cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    PLC_LOCK(&bufferLock);
+    if (copyTaskImageOut(task->entry_values))
+        checkTaskEvents();
+    PLC_UNLOCK(&bufferLock);
+}
+
+//-----------------------------------------------------------------------------
+// Task thread. Runs the programs of one task at its own interval
+//-----------------------------------------------------------------------------
+void *taskThread(void *arg)
+{
+    struct plc_task *task = (struct plc_task *)arg;
+    unsigned long tick = 0;
+    struct timespec timer_start;
+
+    configureThread("task", SCHED_FIFO, task->rt_priority);
+    clock_gettime(CLOCK_MONOTONIC, &timer_start);
+    while (run_tasks)
+    {
+        unsigned long long now = getTimeNs();
+        unsigned long long scheduled = (unsigned long long)timer_start.tv_sec * 1000000000ULL + timer_start.tv_nsec;
+        runTaskCycle(task, tick++, now > scheduled ? now - scheduled : 0);
+
+        if (waitNextCycle(&timer_start, task->interval))
+            task->overruns.store(task->overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Event task thread. Sleeps on the task eventfd and runs the programs of a
+// SINGLE task once every time it is triggered
+//-----------------------------------------------------------------------------
+void *eventTaskThread(void *arg)
+{
+    struct plc_task *task = (struct plc_task *)arg;
+    unsigned long tick = 0;
+    uint64_t events;
+
+    configureThread("task", SCHED_FIFO, task->rt_priority);
+
+    while (run_tasks)
+    {
+        if (read(task->event_fd, &events, sizeof(events)) != sizeof(events))
+            continue;
+        if (!run_tasks)
+            break;
+
+        //triggers that arrive while the task is running are merged into one
+        //execution, the same way an edge is only seen once per scan
+        unsigned long long now = getTimeNs();
+        unsigned long long triggered = task->trigger_time.load(std::memory_order_relaxed);
+        if (events > 1)
+            task->overruns.store(task->overruns.load(std::memory_order_relaxed) + events - 1, std::memory_order_relaxed);
+        runTaskCycle(task, tick++, now > triggered ? now - triggered : 0);
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Wakes up a SINGLE task
+//-----------------------------------------------------------------------------
+static void wakeTask(struct plc_task *task)
+{
+    uint64_t event = 1;
+    task->trigger_time.store(getTimeNs(), std::memory_order_relaxed);
+    if (write(task->event_fd, &event, sizeof(event)) != sizeof(event))
+    {
+        //counter saturated. The task is already pending
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Evaluates the SINGLE input of every event task that changed since the last
+// check and wakes up the ones with a rising edge. Called when a copy of the
+// located image changed an input. The caller must hold bufferLock, which
+// keeps the edge detectors of two callers from racing
+//-----------------------------------------------------------------------------
+void checkTaskEvents()
+{
+    if (!has_event_tasks)
+        return;
+
+    for (int i = 0; i < num_plc_tasks; i++)
+    {
+        struct plc_task *task = &plc_tasks[i];
+        if (task->event_fd < 0)
+            continue;
+
+        //the edge detector can only fire when its input changes
+        if (task->input != NULL)
+        {
+            if (*task->input == task->last_input)
+                continue;
+            task->last_input = *task->input;
+        }
+        if (config_task_trigger__(task->index))
+            wakeTask(task);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns true if a write to coils at byte index with the bits of mask (up
+// to 8 bytes, see queueImageWrite()) hits the input of a SINGLE task
+//-----------------------------------------------------------------------------
+bool isTaskInput(int index, uint64_t mask)
+{
+    if (!has_event_tasks)
+        return false;
+
+    for (int b = 0; b < 8 && index + b < BUFFER_SIZE; b++)
+    {
+        if (task_input_coils[index + b] & (uint8_t)(mask >> (b * 8)))
+            return true;
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+// Applies the queued protocol writes right away and checks the SINGLE task
+// inputs they hit, so the task does not wait for the next scan. Called by
+// the protocols when isTaskInput() is true for one of their writes
+//-----------------------------------------------------------------------------
+void applyTaskInputWrites()
+{
+    PLC_LOCK(&bufferLock);
+    applyImageWrites();
+
+    bool inputs_changed = false;
+    for (int k = 0; k < num_located_vars; k++)
+    {
+        if (located_vars[k].task_input && copyLocatedIn(k))
+            inputs_changed = true;
+    }
+    if (inputs_changed)
+        checkTaskEvents();
+    PLC_UNLOCK(&bufferLock);
+}
+
+//-----------------------------------------------------------------------------
+// Wakes up the SINGLE task with the given name, regardless of its input.
+// Used for external triggers such as hardware interrupts. Returns false if
+// there is no event task with that name
+//-----------------------------------------------------------------------------
+bool triggerTask(const char *task_name)
+{
+    for (int i = 0; i < num_plc_tasks; i++)
+    {
+        if (plc_tasks[i].event_fd >= 0 && !strcasecmp(plc_tasks[i].name, task_name))
+        {
+            wakeTask(&plc_tasks[i]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+// Starts one thread per periodic task if task_scheduler = multitask. Returns
+// true if the scheduler is running, in which case the main loop must call
+// runBackgroundTasks(tick) instead of config_run__(tick)
+//-----------------------------------------------------------------------------
+bool startTaskScheduler()
+{
+    unsigned char log_msg[1000];
+    char scheduler[100];
+
+    if (!getConfigString("task_scheduler", scheduler, sizeof(scheduler)) || strcmp(scheduler, "multitask"))
+        return false;
+
+    if (config_task_count__ == NULL || config_task_info__ == NULL || config_run_task__ == NULL || config_task_trigger__ == NULL)
+    {
+        sprintf(log_msg, "PLC program was compiled without task support. Using the single task scheduler\n");
+        log(log_msg);
+        return false;
+    }
+
+    PLC_LOCK(&bufferLock);
+    bool split = splitLocatedVariables();
+    PLC_UNLOCK(&bufferLock);
+    if (!split)
+    {
+        sprintf(log_msg, "Not enough memory for the task images. Using the single task scheduler\n");
+        log(log_msg);
+        return false;
+    }
+
+    task_priority_base = getConfigInt("task_priority_base", 29);
+    run_tasks = true;
+    num_plc_tasks = 0;
+    has_event_tasks = false;
+
+    int task_count = config_task_count__();
+    for (int i = 0; i < task_count && num_plc_tasks < MAX_TASKS; i++)
+    {
+        struct plc_task *task = &plc_tasks[num_plc_tasks];
+        if (!config_task_info__(i, &task->name, &task->interval, &task->priority))
+            continue;
+
+        task->index = i;
+        task->input = (config_task_input__ != NULL) ? config_task_input__(i) : NULL;
+        task->last_input = false;
+        task->entry_values = (uint64_t *)calloc(num_located_vars + 1, sizeof(uint64_t));
+        task->cycles.store(0);
+        task->overruns.store(0);
+        task->last_exec.store(0);
+        task->max_exec.store(0);
+        task->last_latency.store(0);
+        task->max_latency.store(0);
+
+        //SINGLE tasks have no interval and are woken up through an eventfd
+        task->event_fd = -1;
+        if (task->interval == 0)
+        {
+            task->event_fd = eventfd(0, EFD_CLOEXEC);
+            if (task->event_fd < 0)
+            {
+                sprintf(log_msg, "Failed to create event for task %s\n", task->name);
+                log(log_msg);
+                continue;
+            }
+        }
+        void *(*thread_function)(void *) = (task->event_fd >= 0) ? eventTaskThread : taskThread;
+
+        //IEC priority 0 is the highest. Map it below the I/O loop priority.
+        //The thread sets its own priority and CPUs when it starts
+        task->rt_priority = task_priority_base - task->priority;
+        if (task->rt_priority < 1) task->rt_priority = 1;
+        if (task->rt_priority > 99) task->rt_priority = 99;
+
+        task->started = (pthread_create(&task->thread, NULL, thread_function, task) == 0);
+
+        if (task->started)
+        {
+            if (task->event_fd >= 0)
+                sprintf(log_msg, "Task %s started (event triggered, priority: %d)\n", task->name, task->priority);
+            else
+                sprintf(log_msg, "Task %s started (interval: %llu ns, priority: %d)\n", task->name, task->interval, task->priority);
+            log(log_msg);
+            num_plc_tasks++;
+        }
+        else
+        {
+            if (task->event_fd >= 0) close(task->event_fd);
+            free(task->entry_values);
+        }
+    }
+
+    PLC_LOCK(&bufferLock);
+    findTaskInputs();
+    for (int i = 0; i < num_plc_tasks; i++)
+    {
+        if (plc_tasks[i].event_fd >= 0) has_event_tasks = true;
+    }
+    PLC_UNLOCK(&bufferLock);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Runs the programs without a task and checks the SINGLE task triggers
+// against the new input image. Called from the main loop on every tick with
+// bufferLock held. The lock is released while the programs run
+//-----------------------------------------------------------------------------
+void runBackgroundTasks(unsigned long tick)
+{
+    if (copyTaskImageIn(background_entry))
+        checkTaskEvents();
+    PLC_UNLOCK(&bufferLock);
+
+    config_run_task__(-1, tick);
+
+    PLC_LOCK(&bufferLock);
+    if (copyTaskImageOut(background_entry))
+        checkTaskEvents();
+}
+
+//-----------------------------------------------------------------------------
+// Stops all task threads and waits for them to finish
+//-----------------------------------------------------------------------------
+void stopTaskScheduler()
+{
+    run_tasks = false;
+    for (int i = 0; i < num_plc_tasks; i++)
+    {
+        if (plc_tasks[i].event_fd >= 0) wakeTask(&plc_tasks[i]);
+    }
+
+    for (int i = 0; i < num_plc_tasks; i++)
+    {
+        if (plc_tasks[i].started) pthread_join(plc_tasks[i].thread, NULL);
+        if (plc_tasks[i].event_fd >= 0) close(plc_tasks[i].event_fd);
+        free(plc_tasks[i].entry_values);
+        plc_tasks[i].entry_values = NULL;
+        plc_tasks[i].started = false;
+        plc_tasks[i].event_fd = -1;
+    }
+    has_event_tasks = false;
+    num_plc_tasks = 0;
+}
+
+#else
+bool startTaskScheduler()
+{
+    return false;
+}
+
+bool taskImagesActive()
+{
+    return false;
+}
+
+void stopTaskScheduler()
+{
+}
+
+void runBackgroundTasks(unsigned long tick)
+{
+    config_run__(tick);
+}
+
+void checkTaskEvents()
+{
+}
+
+bool isTaskInput(int index, uint64_t mask)
+{
+    return false;
+}
+
+void applyTaskInputWrites()
+{
+}
+
+bool triggerTask(const char *task_name)
+{
+    return false;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Writes a text report of the task counters into buffer. Times are in
+// nanoseconds. Returns the number of characters written
+//-----------------------------------------------------------------------------
+int printTaskStats(char *buffer, int buffer_size)
+{
+    int count_char = snprintf(buffer, buffer_size, "tasks: %d\n", num_plc_tasks);
+
+    for (int i = 0; i < num_plc_tasks && count_char < buffer_size; i++)
+    {
+        struct plc_task *task = &plc_tasks[i];
+        count_char += snprintf(buffer + count_char, buffer_size - count_char, "%s: interval=%llu priority=%d cycles=%llu overruns=%llu last=%llu max=%llu latency_last=%llu latency_max=%llu\n",
+                               task->name, task->interval, task->priority,
+                               (unsigned long long)task->cycles.load(std::memory_order_relaxed),
+                               (unsigned long long)task->overruns.load(std::memory_order_relaxed),
+                               (unsigned long long)task->last_exec.load(std::memory_order_relaxed),
+                               (unsigned long long)task->max_exec.load(std::memory_order_relaxed),
+                               (unsigned long long)task->last_latency.load(std::memory_order_relaxed),
+                               (unsigned long long)task->max_latency.load(std::memory_order_relaxed));
+    }
+
+    if (count_char >= buffer_size) count_char = buffer_size - 1;
+    return count_char;
+}
@@ -0,0 +1,240 @@
+//-----------------------------------------------------------------------------
+// Copyright 2026 Thiago Alves
+// This file is part of the OpenPLC Software Stack.
+//
+// OpenPLC is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// OpenPLC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with OpenPLC.  If not, see <http://www.gnu.org/licenses/>.
+//------
+//
+// This file applies the CPU affinity and scheduling settings of each thread
+// class (scan, task, modbus, dnp3, ...) from runtime.cfg. Each thread calls
+// configureThread() with its class name when it starts. Threads created
+// afterwards by that thread inherit the same settings.
+// Oct 2026
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ladder.h"
+
+#ifdef __linux__
+
+//-----------------------------------------------------------------------------
+// Parses a CPU list such as "2", "2,3" or "0-1,4" into set. Returns the
+// number of CPUs in the set
+//-----------------------------------------------------------------------------
+int parseCpuList(const char *cpu_list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *c = cpu_list;
+
+    while (*c != '\0')
+    {
+        char *end;
+        long first = strtol(c, &end, 10);
+        if (end == c)
+        {
+            c++;
+            continue;
+        }
+
+        long last = first;
+        c = end;
+        if (*c == '-')
+        {
+            last = strtol(c + 1, &end, 10);
+            c = end;
+        }
+
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            if (cpu >= 0) CPU_SET(cpu, set);
+        }
+    }
+
+    return CPU_COUNT(set);
+}
+
+//-----------------------------------------------------------------------------
+// Converts a policy name from runtime.cfg into a scheduling policy. Returns
+// -1 for unknown names
+//-----------------------------------------------------------------------------
+int parsePolicy(const char *policy)
+{
+    if (!strcmp(policy, "fifo")) return SCHED_FIFO;
+    if (!strcmp(policy, "rr")) return SCHED_RR;
+    if (!strcmp(policy, "other")) return SCHED_OTHER;
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Applies the <thread_class>_cpus, <thread_class>_policy and
+// <thread_class>_priority settings to the calling thread. default_policy
+// and default_priority are used when the class has no policy set. Pass -1
+// as default_policy to leave the scheduling untouched in that case
+//-----------------------------------------------------------------------------
+void configureThread(const char *thread_class, int default_policy, int default_priority)
+{
+    unsigned char log_msg[1000];
+    char key[100];
+    char value[256];
+
+    //name the thread after its class so it can be told apart in the lock stats.
+    //The scan thread keeps the process name
+    if (strcmp(thread_class, "scan"))
+        pthread_setname_np(pthread_self(), thread_class);
+
+    //CPU affinity
+    sprintf(key, "%s_cpus", thread_class);
+    if (getConfigString(key, value, sizeof(value)))
+    {
+        cpu_set_t set;
+        if (parseCpuList(value, &set) == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        {
+            sprintf(log_msg, "WARNING: Failed to pin %s thread to CPUs %s\n", thread_class, value);
+            log(log_msg);
+        }
+    }
+
+    //Scheduling policy and priority
+    int policy = default_policy;
+    int priority = default_priority;
+    sprintf(key, "%s_policy", thread_class);
+    if (getConfigString(key, value, sizeof(value)))
+    {
+        policy = parsePolicy(value);
+        if (policy < 0)
+        {
+            sprintf(log_msg, "Unknown %s '%s'. Valid options are fifo, rr and other\n", key, value);
+            log(log_msg);
+            policy = default_policy;
+        }
+    }
+    //task priorities are mapped from the IEC priorities through
+    //task_priority_base, so each task keeps its own
+    sprintf(key, "%s_priority", thread_class);
+    if (strcmp(thread_class, "task") != 0)
+        priority = getConfigInt(key, priority);
+
+    if (policy < 0)
+        return;
+
+    struct sched_param sp;
+    if (policy == SCHED_OTHER)
+    {
+        priority = 0;
+    }
+    else
+    {
+        int min_priority = sched_get_priority_min(policy);
+        int max_priority = sched_get_priority_max(policy);
+        if (priority < min_priority) priority = min_priority;
+        if (priority > max_priority) priority = max_priority;
+    }
+    sp.sched_priority = priority;
+
+    if (pthread_setschedparam(pthread_self(), policy, &sp))
+    {
+        sprintf(log_msg, "WARNING: Failed to set %s thread to priority %d\n", thread_class, priority);
+        log(log_msg);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reads a CPU list from a sysfs file. Returns false if the file can't be read
+//-----------------------------------------------------------------------------
+bool readSysCpuList(const char *path, cpu_set_t *set)
+{
+    char cpu_list[1024];
+    FILE *sys_file = fopen(path, "r");
+
+    CPU_ZERO(set);
+    if (sys_file == NULL)
+        return false;
+
+    if (fgets(cpu_list, sizeof(cpu_list), sys_file) != NULL)
+        parseCpuList(cpu_list, set);
+    fclose(sys_file);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Logs whether the CPUs of the scan thread are isolated from the rest of the
+// system (isolcpus and nohz_full), and warns if other thread classes were
+// pinned to the same CPUs
+//-----------------------------------------------------------------------------
+void reportCpuIsolation()
+{
+    unsigned char log_msg[1000];
+    char scan_cpus[256];
+    cpu_set_t scan_set, isolated_set, nohz_set;
+
+    readSysCpuList("/sys/devices/system/cpu/isolated", &isolated_set);
+    readSysCpuList("/sys/devices/system/cpu/nohz_full", &nohz_set);
+
+    if (!getConfigString("scan_cpus", scan_cpus, sizeof(scan_cpus)) || parseCpuList(scan_cpus, &scan_set) == 0)
+    {
+        if (CPU_COUNT(&isolated_set) > 0)
+        {
+            sprintf(log_msg, "System has %d isolated CPUs, but scan_cpus is not set. The scan thread can run on any CPU\n", CPU_COUNT(&isolated_set));
+            log(log_msg);
+        }
+        return;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &scan_set))
+            continue;
+
+        sprintf(log_msg, "Scan CPU %d: isolcpus %s, nohz_full %s\n", cpu,
+                CPU_ISSET(cpu, &isolated_set) ? "yes" : "no",
+                CPU_ISSET(cpu, &nohz_set) ? "yes" : "no");
+        log(log_msg);
+    }
+
+    const char *thread_classes[] = {"task", "modbus", "modbus_master", "dnp3", "enip", "pstorage", "interactive"};
+    for (int i = 0; i < (int)(sizeof(thread_classes) / sizeof(thread_classes[0])); i++)
+    {
+        char key[100];
+        char value[256];
+        cpu_set_t set, shared;
+
+        sprintf(key, "%s_cpus", thread_classes[i]);
+        if (!getConfigString(key, value, sizeof(value)))
+            continue;
+
+        parseCpuList(value, &set);
+        CPU_AND(&shared, &set, &scan_set);
+        if (CPU_COUNT(&shared) > 0 && strcmp(thread_classes[i], "task"))
+        {
+            sprintf(log_msg, "WARNING: %s threads share CPUs with the scan thread\n", thread_classes[i]);
+            log(log_msg);
+        }
+    }
+}
+
+#else
+void configureThread(const char *thread_class, int default_policy, int default_priority)
+{
+}
+
+void reportCpuIsolation()
+{
+}
+#endif
@@ -157,6 +157,50 @@ class runtime:
             except:
                 print("Error connecting to OpenPLC runtime")
 
+    def start_modbus_rtu(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('start_modbus_rtu()\n')
+                data = s.recv(1000)
+                s.close()
+            except:
+                print("Error connecting to OpenPLC runtime")
+
+    def stop_modbus_rtu(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('stop_modbus_rtu()\n')
+                data = s.recv(1000)
+                s.close()
+            except:
+                print("Error connecting to OpenPLC runtime")
+
+    def start_modbus_udp(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('start_modbus_udp()\n')
+                data = s.recv(1000)
+                s.close()
+            except:
+                print("Error connecting to OpenPLC runtime")
+
+    def stop_modbus_udp(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('stop_modbus_udp()\n')
+                data = s.recv(1000)
+                s.close()
+            except:
+                print("Error connecting to OpenPLC runtime")
+
     def start_dnp3(self, port_num):
         if (self.status() == "Running"):
             try:
@@ -254,3 +298,89 @@ class runtime:
             return "Error connecting to OpenPLC runtime"
         else:
             return "N/A"
+
+    def scan_stats(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('scan_stats()\n')
+                data = s.recv(10000)
+                s.close()
+                return data
+            except:
+                print("Error connecting to OpenPLC runtime")
+            
+            return "Error connecting to OpenPLC runtime"
+        else:
+            return "OpenPLC Runtime is not running"
+
+    def task_stats(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('task_stats()\n')
+                data = s.recv(10000)
+                s.close()
+                return data
+            except:
+                print("Error connecting to OpenPLC runtime")
+            
+            return "Error connecting to OpenPLC runtime"
+        else:
+            return "OpenPLC Runtime is not running"
+
+    def lock_stats(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('lock_stats()\n')
+                data = s.recv(20000)
+                s.close()
+                return data
+            except:
+                print("Error connecting to OpenPLC runtime")
+            
+            return "Error connecting to OpenPLC runtime"
+        else:
+            return "OpenPLC Runtime is not running"
+
+    def server_stats(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('server_stats()\n')
+                data = s.recv(1000)
+                s.close()
+                return data
+            except:
+                print("Error connecting to OpenPLC runtime")
+            
+            return "Error connecting to OpenPLC runtime"
+        else:
+            return "OpenPLC Runtime is not running"
+
+    def reload_config(self):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('reload_config()\n')
+                data = s.recv(1000)
+                s.close()
+            except:
+                print("Error connecting to OpenPLC runtime")
+
+    def trigger_task(self, task_name):
+        if (self.status() == "Running"):
+            try:
+                s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                s.connect(('localhost', 43628))
+                s.send('trigger_task(' + str(task_name) + ')\n')
+                data = s.recv(1000)
+                s.close()
+            except:
+                print("Error connecting to OpenPLC runtime")
@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+#
+# Checks the Modbus RTU slave of a compiled runtime over a pseudo terminal,
+# without any serial hardware. The runtime is started in a temporary
+# directory with a copy of runtime.cfg that points modbus_rtu_device to the
+# slave side of a pty, and known frames are written to the master side:
+#
+#   01 03 00 00 00 01 84 0A   Read Holding Registers, unit 1, register 0
+#
+# The slave must answer with unit 1, function 3, a byte count of 2 and a
+# valid CRC, and stay silent for a frame with a bad CRC or for another unit.
+#
+# Usage, from the webserver directory once a program has been compiled:
+#   python scripts/check_modbus_rtu_slave.py [core/openplc] [runtime.cfg]
+# Exits with 0 if every check passed.
+
+import os
+import re
+import select
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+INTERACTIVE_PORT = 43628
+READ_HOLDING = bytearray([0x01, 0x03, 0x00, 0x00, 0x00, 0x01, 0x84, 0x0A])
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+def command(cmd):
+    s = socket.create_connection(('localhost', INTERACTIVE_PORT))
+    s.sendall((cmd + '\n').encode())
+    s.settimeout(1)
+    try:
+        s.recv(1000)
+    except socket.timeout:
+        pass
+    s.close()
+
+def receive(fd, timeout=0.5):
+    data = bytearray()
+    end = time.time() + timeout
+    while True:
+        ready, _, _ = select.select([fd], [], [], max(0, end - time.time()))
+        if not ready:
+            return data
+        data += bytearray(os.read(fd, 300))
+        #the frame is over after a short silence
+        end = time.time() + 0.05
+
+def main():
+    binary = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else 'core/openplc')
+    config = sys.argv[2] if len(sys.argv) > 2 else 'runtime.cfg'
+
+    master, slave = os.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+
+    workdir = tempfile.mkdtemp()
+    with open(config) as f:
+        cfg = f.read()
+    cfg = re.sub(r'^modbus_rtu_device =.*$', 'modbus_rtu_device = ' + os.ttyname(slave), cfg, flags=re.M)
+    cfg = re.sub(r'^modbus_rtu_slave_id =.*$', 'modbus_rtu_slave_id = 1', cfg, flags=re.M)
+    with open(os.path.join(workdir, 'runtime.cfg'), 'w') as f:
+        f.write(cfg)
+
+    runtime = subprocess.Popen([binary], cwd=workdir, stdout=open(os.devnull, 'w'), stderr=subprocess.STDOUT)
+    failures = 0
+    try:
+        time.sleep(1)
+        command('start_modbus_rtu()')
+        time.sleep(0.5)
+
+        os.write(master, bytes(READ_HOLDING))
+        response = receive(master)
+        ok = (len(response) == 7 and response[0] == 0x01 and response[1] == 0x03 and response[2] == 2 and
+              crc16(response[:-2]) == response[-2] | (response[-1] << 8))
+        print('Read Holding Registers: %s %s' % (' '.join('%02X' % b for b in response), 'OK' if ok else 'FAILED'))
+        failures += not ok
+
+        bad_crc = bytearray(READ_HOLDING)
+        bad_crc[-1] ^= 0x01
+        os.write(master, bytes(bad_crc))
+        ok = len(receive(master)) == 0
+        print('Bad CRC ignored: %s' % ('OK' if ok else 'FAILED'))
+        failures += not ok
+
+        other_unit = bytearray([0x02]) + READ_HOLDING[1:6]
+        crc = crc16(other_unit)
+        other_unit += bytearray([crc & 0xFF, crc >> 8])
+        os.write(master, bytes(other_unit))
+        ok = len(receive(master)) == 0
+        print('Other unit ignored: %s' % ('OK' if ok else 'FAILED'))
+        failures += not ok
+    finally:
+        try:
+            command('quit()')
+            time.sleep(0.5)
+        except socket.error:
+            pass
+        if runtime.poll() is None:
+            runtime.kill()
+        runtime.wait()
+        os.close(master)
+        os.close(slave)
+        shutil.rmtree(workdir)
+
+    return 1 if failures else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -33,6 +33,13 @@ fi
 
 #compiling for each platform
 cd core
+
+#the compact process image is selected in runtime.cfg
+GLUE_OPTIONS=""
+if grep -q "^process_image *= *compact" ../runtime.cfg 2>/dev/null; then
+    GLUE_OPTIONS="--compact"
+fi
+
 if [ "$OPENPLC_PLATFORM" = "win" ]; then
     echo "Compiling for Windows"
     echo "Generating object files..."
@@ -49,7 +56,7 @@ if [ "$OPENPLC_PLATFORM" = "win" ]; then
         exit 1
     fi
     echo "Generating glueVars..."
-    ./glue_generator
+    ./glue_generator $GLUE_OPTIONS
     echo "Compiling main program..."
     g++ *.cpp *.o -o openplc -I ./lib -pthread -fpermissive -I /usr/local/include/modbus -L /usr/local/lib -lmodbus -w
     if [ $? -ne 0 ]; then
@@ -76,7 +83,7 @@ elif [ "$OPENPLC_PLATFORM" = "linux" ]; then
         exit 1
     fi
     echo "Generating glueVars..."
-    ./glue_generator
+    ./glue_generator $GLUE_OPTIONS
     echo "Compiling main program..."
     g++ -std=gnu++11 *.cpp *.o -o openplc -I ./lib -pthread -fpermissive `pkg-config --cflags --libs libmodbus` -lasiodnp3 -lasiopal -lopendnp3 -lopenpal -w
     if [ $? -ne 0 ]; then
@@ -103,7 +110,7 @@ elif [ "$OPENPLC_PLATFORM" = "rpi" ]; then
         exit 1
     fi
     echo "Generating glueVars..."
-    ./glue_generator
+    ./glue_generator $GLUE_OPTIONS
     echo "Compiling main program..."
     g++ -std=gnu++11 *.cpp *.o -o openplc -I ./lib -lrt -lwiringPi -lpthread -fpermissive `pkg-config --cflags --libs libmodbus` -lasiodnp3 -lasiopal -lopendnp3 -lopenpal -w
     if [ $? -ne 0 ]; then
@@ -70,6 +70,10 @@ def configure_runtime():
                         print("Disabling Persistent Storage")
                         openplc_runtime.stop_pstorage()
                         delete_persistent_file()
+
+            #the RTU slave and Modbus/UDP are set up in runtime.cfg and only start if enabled there
+            openplc_runtime.start_modbus_rtu()
+            openplc_runtime.start_modbus_udp()
         except Error as e:
             print("error connecting to the database" + str(e))
     else: